@@ -0,0 +1,81 @@
+// AllocationCounter.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "AllocationCounter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> s_total(0);
+    thread_local uint64_t s_thread = 0;
+} // namespace
+
+namespace khmz
+{
+
+uint64_t thread_allocation_count()
+{
+    return s_thread;
+}
+
+uint64_t total_allocation_count()
+{
+    return s_total.load(std::memory_order_relaxed);
+}
+
+} // namespace khmz
+
+void *operator new(std::size_t size)
+{
+    ++s_thread;
+    s_total.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return operator new(size);
+    }
+    catch (...)
+    {
+        return NULL;
+    }
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+//////////////////////////////////////////////////////////////////////////////
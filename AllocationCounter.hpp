@@ -0,0 +1,42 @@
+// AllocationCounter.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// allocation counting
+//
+// AllocationCounter.cpp replaces the global operator new to count the heap
+// allocations. It is linked only into the test and benchmark programs,
+// never into the library.
+
+// the allocations made by the calling thread so far
+uint64_t thread_allocation_count();
+// the allocations made by all the threads so far
+uint64_t total_allocation_count();
+
+// evaluates expr and fails with a report if it allocated
+#define KHMZ_ASSERT_NO_ALLOCATION(expr) \
+    do \
+    { \
+        const uint64_t khmz_before_ = khmz::thread_allocation_count(); \
+        expr; \
+        const uint64_t khmz_count_ = khmz::thread_allocation_count() - khmz_before_; \
+        if (khmz_count_) \
+        { \
+            std::fprintf(stderr, "%s:%d: '%s' allocated %llu time(s)\n", \
+                         __FILE__, __LINE__, #expr, (unsigned long long)khmz_count_); \
+            assert(!"unexpected allocation"); \
+        } \
+    } while (0)
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
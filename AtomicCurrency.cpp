@@ -0,0 +1,126 @@
+// AtomicCurrency.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "AtomicCurrency.hpp"
+
+namespace khmz
+{
+
+void AtomicCurrency::unittest()
+{
+    AtomicCurrency balance(Currency("100"), -2);
+    assert(balance.load() == "100");
+    assert(balance.fetch_add(Currency("0.25")) == "100");
+    assert(balance.fetch_sub(Currency("1.5")) == "100.25");
+    assert(balance.load() == "98.75");
+    balance += Currency("-98.75");
+    assert(balance.load() == "0");
+
+    // out of scale
+    bool catched = false;
+    try
+    {
+        balance.fetch_add(Currency("0.001"));
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+    assert(balance.load() == "0");
+
+    // overflow
+    balance.store(Currency(max_significand, -2));
+    catched = false;
+    try
+    {
+        balance += Currency("0.01");
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+    assert(balance.load() == Currency(max_significand, -2));
+
+    // a sum of INT64_MIN units has no Currency significand
+    balance.store(Currency(-max_significand, -2));
+    catched = false;
+    try
+    {
+        balance -= Currency("0.01");
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+    assert(balance.load() == Currency(-max_significand, -2));
+
+    ShardedAtomicCurrency one_shard(-2, 1);
+    one_shard += Currency(max_significand, -2);
+    catched = false;
+    try
+    {
+        one_shard += Currency("0.01");
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+    assert(one_shard.load() == Currency(max_significand, -2));
+    one_shard.clear();
+    one_shard -= Currency(max_significand, -2);
+    catched = false;
+    try
+    {
+        one_shard -= Currency("0.01");
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+
+    // zero fits a positive scale
+    AtomicCurrency thousands(3);
+    thousands.store(Currency(0));
+    thousands += Currency(5000);
+    assert(thousands.load() == "5000");
+
+    // compare_exchange
+    balance.store(Currency("5"));
+    Currency expected("4");
+    assert(!balance.compare_exchange_strong(expected, Currency("6")));
+    assert(expected == "5");
+    assert(balance.compare_exchange_strong(expected, Currency("6")));
+    assert(balance.load() == "6");
+
+    // concurrent updates
+    const int threads = 4, loops = 10000;
+    AtomicCurrency total(-2);
+    ShardedAtomicCurrency sharded(-2, 8);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&]() {
+            const Currency cent("0.01");
+            for (int i = 0; i < loops; ++i)
+            {
+                total += cent;
+                sharded += cent;
+            }
+        });
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    assert(total.load() == "400");
+    assert(sharded.load() == "400");
+    sharded -= Currency("400");
+    assert(sharded.load() == "0");
+
+    puts("AtomicCurrency::unittest: OK.");
+}
+
+} // namespace khmz
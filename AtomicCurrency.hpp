@@ -0,0 +1,271 @@
+// AtomicCurrency.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <atomic>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// AtomicCurrency
+//
+// A lock-free Currency at a fixed scale. The value is kept as a single
+// std::atomic<int64_t> of units of 10^scale (e.g. scale -2 for cents).
+// An operand that is finer than the scale, or a result that overflows,
+// throws std::runtime_error; an overflowing add leaves the value as it was.
+
+class AtomicCurrency
+{
+protected:
+    std::atomic<int64_t> m_units;
+    exp10_t m_scale;
+
+public:
+    explicit AtomicCurrency(exp10_t scale = -2)
+        : m_units(0)
+        , m_scale(scale)
+    {
+    }
+    AtomicCurrency(const Currency& value, exp10_t scale)
+        : m_units(0)
+        , m_scale(scale)
+    {
+        m_units.store(to_units(value), std::memory_order_relaxed);
+    }
+
+    AtomicCurrency(const AtomicCurrency&) = delete;
+    AtomicCurrency& operator=(const AtomicCurrency&) = delete;
+
+    exp10_t scale() const
+    {
+        return m_scale;
+    }
+
+    int64_t to_units(const Currency& value) const
+    {
+        int64_t units;
+        if (!currency_to_units(value, m_scale, units))
+            throw std::runtime_error("AtomicCurrency: out of scale");
+        return units;
+    }
+    Currency from_units(int64_t units) const
+    {
+        return Currency(significand_t(units), m_scale);
+    }
+
+    Currency load(std::memory_order order = std::memory_order_seq_cst) const
+    {
+        return from_units(m_units.load(order));
+    }
+    void store(const Currency& value, std::memory_order order = std::memory_order_seq_cst)
+    {
+        m_units.store(to_units(value), order);
+    }
+    Currency exchange(const Currency& value, std::memory_order order = std::memory_order_seq_cst)
+    {
+        return from_units(m_units.exchange(to_units(value), order));
+    }
+
+    // returns the previous value
+    int64_t fetch_add_units(int64_t units, std::memory_order order = std::memory_order_seq_cst)
+    {
+        int64_t old = m_units.load(std::memory_order_relaxed);
+        int64_t sum;
+        do
+        {
+            if (__builtin_add_overflow(old, units, &sum) ||
+                sum == std::numeric_limits<int64_t>::min())
+                throw std::runtime_error("AtomicCurrency: overflow");
+        }
+        while (!m_units.compare_exchange_weak(old, sum, order, std::memory_order_relaxed));
+        return old;
+    }
+    Currency fetch_add(const Currency& value, std::memory_order order = std::memory_order_seq_cst)
+    {
+        return from_units(fetch_add_units(to_units(value), order));
+    }
+    Currency fetch_sub(const Currency& value, std::memory_order order = std::memory_order_seq_cst)
+    {
+        int64_t units = to_units(value);
+        if (units == std::numeric_limits<int64_t>::min())
+            throw std::runtime_error("AtomicCurrency: overflow");
+        return from_units(fetch_add_units(-units, order));
+    }
+
+    bool compare_exchange_weak(Currency& expected, const Currency& desired,
+                               std::memory_order order = std::memory_order_seq_cst)
+    {
+        int64_t units = to_units(expected);
+        bool ret = m_units.compare_exchange_weak(units, to_units(desired), order);
+        if (!ret)
+            expected = from_units(units);
+        return ret;
+    }
+    bool compare_exchange_strong(Currency& expected, const Currency& desired,
+                                 std::memory_order order = std::memory_order_seq_cst)
+    {
+        int64_t units = to_units(expected);
+        bool ret = m_units.compare_exchange_strong(units, to_units(desired), order);
+        if (!ret)
+            expected = from_units(units);
+        return ret;
+    }
+
+    AtomicCurrency& operator+=(const Currency& value)
+    {
+        fetch_add(value);
+        return *this;
+    }
+    AtomicCurrency& operator-=(const Currency& value)
+    {
+        fetch_sub(value);
+        return *this;
+    }
+
+    operator Currency() const
+    {
+        return load();
+    }
+
+    bool is_lock_free() const
+    {
+        return m_units.is_lock_free();
+    }
+
+    static void unittest();
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// ShardedAtomicCurrency
+//
+// A write-heavy counter split into per-thread shards on separate cache lines.
+// Each thread adds to its own shard; load() combines the shards.
+
+class ShardedAtomicCurrency
+{
+protected:
+    // one cache line each; std::allocator does not honor the alignment
+    // before C++17, so the shards are placed in an aligned buffer
+    struct alignas(64) Shard
+    {
+        std::atomic<int64_t> units;
+
+        Shard()
+            : units(0)
+        {
+        }
+    };
+    static_assert(sizeof(Shard) == 64, "a shard fills its cache line");
+
+    std::vector<char> m_storage;
+    Shard *m_shards;
+    size_t m_count;
+    exp10_t m_scale;
+
+    Shard& local_shard()
+    {
+        static std::atomic<unsigned int> s_next(0);
+        static thread_local unsigned int s_index = s_next.fetch_add(1);
+        return m_shards[s_index % m_count];
+    }
+
+public:
+    explicit ShardedAtomicCurrency(exp10_t scale = -2, size_t shards = 0)
+        : m_count(shards ? shards : std::max(1U, std::thread::hardware_concurrency()))
+        , m_scale(scale)
+    {
+        m_storage.resize((m_count + 1) * sizeof(Shard));
+        const uintptr_t address = reinterpret_cast<uintptr_t>(m_storage.data());
+        const uintptr_t aligned = (address + alignof(Shard) - 1) & ~uintptr_t(alignof(Shard) - 1);
+        m_shards = reinterpret_cast<Shard *>(aligned);
+        for (size_t i = 0; i < m_count; ++i)
+            new (&m_shards[i]) Shard();
+    }
+
+    ShardedAtomicCurrency(const ShardedAtomicCurrency&) = delete;
+    ShardedAtomicCurrency& operator=(const ShardedAtomicCurrency&) = delete;
+
+    exp10_t scale() const
+    {
+        return m_scale;
+    }
+    size_t shard_count() const
+    {
+        return m_count;
+    }
+
+    int64_t to_units(const Currency& value) const
+    {
+        int64_t units;
+        if (!currency_to_units(value, m_scale, units))
+            throw std::runtime_error("ShardedAtomicCurrency: out of scale");
+        return units;
+    }
+
+    void add_units(int64_t units)
+    {
+        std::atomic<int64_t>& shard = local_shard().units;
+        int64_t old = shard.load(std::memory_order_relaxed);
+        int64_t sum;
+        do
+        {
+            if (__builtin_add_overflow(old, units, &sum) ||
+                sum == std::numeric_limits<int64_t>::min())
+                throw std::runtime_error("ShardedAtomicCurrency: overflow");
+        }
+        while (!shard.compare_exchange_weak(old, sum, std::memory_order_relaxed));
+    }
+    void add(const Currency& value)
+    {
+        add_units(to_units(value));
+    }
+    void sub(const Currency& value)
+    {
+        int64_t units = to_units(value);
+        if (units == std::numeric_limits<int64_t>::min())
+            throw std::runtime_error("ShardedAtomicCurrency: overflow");
+        add_units(-units);
+    }
+
+    ShardedAtomicCurrency& operator+=(const Currency& value)
+    {
+        add(value);
+        return *this;
+    }
+    ShardedAtomicCurrency& operator-=(const Currency& value)
+    {
+        sub(value);
+        return *this;
+    }
+
+    // the sum of the shards
+    Currency load() const
+    {
+        __int128 sum = 0;
+        for (size_t i = 0; i < m_count; ++i)
+            sum += m_shards[i].units.load(std::memory_order_relaxed);
+        return currency_from_wide(sum, m_scale);
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < m_count; ++i)
+            m_shards[i].units.store(0, std::memory_order_relaxed);
+    }
+
+    operator Currency() const
+    {
+        return load();
+    }
+};
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -2,6 +2,31 @@
 //////////////////////////////////////////////////////////////////////////////
 
 #include "Currency.hpp"
+#include "CurrencyCsv.hpp"
+#include "CurrencyBinary.hpp"
+#include "CurrencySeries.hpp"
+#include "AtomicCurrency.hpp"
+#include "CurrencyRangeIndex.hpp"
+#include "CurrencyFx.hpp"
+#include "CurrencyAllocate.hpp"
+#include "CurrencyFinance.hpp"
+#include "CurrencyCounters.hpp"
+#include "CurrencyBcd.hpp"
+#include "CurrencyBid.hpp"
+#include "CurrencyArrow.hpp"
+#include "CurrencyLocale.hpp"
+#include "CurrencyJson.hpp"
+#include "PriceLadder.hpp"
+#include "CurrencyBars.hpp"
+#include "CurrencyPipeline.hpp"
+#include "CurrencyReconcile.hpp"
+#include "CurrencyStats.hpp"
+#include "CurrencyFilter.hpp"
+#include "CurrencyDivisor.hpp"
+#include "CurrencyLedger.hpp"
+#ifdef UNITTEST
+    #include "AllocationCounter.hpp"
+#endif
 
 namespace khmz
 {
@@ -204,6 +229,14 @@ void Currency::unittest()
     assert(Currency("123.45") == "+123.45");
     assert(Currency("-0.0000012345") == "-0.0000012345");
 
+    const char *text = " -12.50,";
+    Currency cur;
+    assert(cur.try_parse(text, text + 7));
+    assert(cur == "-12.5");
+    assert(cur.significand() == -125);
+    assert(cur.exp10() == -1);
+    assert(!cur.try_parse(text, text + 8));
+
     Currency inf;
     inf.set_inf();
     assert(inf.to_string() == "inf");
@@ -298,9 +331,136 @@ void Currency::unittest()
     assert(Currency(833, -4) > Currency(83, -3));
     assert(Currency(833, -4) >= Currency(83, -3));
 
+    // rounding
+    assert(Currency("1.245").get_round(-2) == "1.25");
+    assert(Currency("-1.245").get_round(-2) == "-1.25");
+    assert(Currency("1.244").get_round(-2) == "1.24");
+    assert(Currency("1.245").get_bankers_rounding(-2) == "1.24");
+    assert(Currency("1.255").get_bankers_rounding(-2) == "1.26");
+    assert(Currency("1.2451").get_bankers_rounding(-2) == "1.25");
+    assert(Currency("1.241").get_round_up(-2) == "1.25");
+    assert(Currency("-1.241").get_round_up(-2) == "-1.25");
+    assert(Currency("1.249").get_round_down(-2) == "1.24");
+    assert(Currency("-1.249").get_round_down(-2) == "-1.24");
+    assert(Currency("1.25").get_round(-2) == "1.25");
+    assert(Currency("0.4").get_round() == "0");
+    assert(Currency("-0.5").get_round() == "-1");
+    assert(Currency("1234").get_round(2) == "1200");
+    assert(Currency("0.000000000000000000001").get_round_up(-2) == "0.01");
+    assert(Currency("0.000000000000000000001").get_round(-2) == "0");
+    Currency value("-1.231");
+    value.round(-2, ROUND_CEILING);
+    assert(value == "-1.23");
+    value = Currency("-1.231");
+    value.round(-2, ROUND_FLOOR);
+    assert(value == "-1.24");
+
     puts("Currency::unittest: OK.");
 }
 
+#ifdef UNITTEST
+// compare, +=, -=, *=, normalize, try_parse, to_chars, round, parse_amount
+// and format_to must not allocate; allocation_unittest checks them over a
+// corpus of values
+void allocation_unittest()
+{
+    static const char *const s_corpus[] =
+    {
+        "0", "1", "-1", "0.01", "-0.01", "12.34", "-12.34", "1000",
+        "0.000000000001", "123456789012345678", "-9223372036854775807",
+        "0.9223372036854775807", "922337203685477580700000", "1.5", "2.25",
+        "99999.99999", "-0.5", "7000000", "0.00000000000000000001", "inf"
+    };
+    const size_t count = sizeof(s_corpus) / sizeof(s_corpus[0]);
+
+    Currency values[count];
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char *str = s_corpus[i];
+        KHMZ_ASSERT_NO_ALLOCATION(values[i].try_parse(str, str + std::strlen(str)));
+    }
+    for (size_t i = 0; i < count; ++i)
+        values[i] = Currency(s_corpus[i]);
+
+    char buf[64];
+    for (size_t i = 0; i < count; ++i)
+    {
+        char *end;
+        KHMZ_ASSERT_NO_ALLOCATION(end = values[i].to_chars(buf, buf + sizeof(buf)));
+        assert(end && std::string(buf, end) == values[i].to_string());
+        assert(values[i].to_chars(buf, buf + 1) == NULL || values[i].to_string().size() <= 1);
+
+        const FormatSpec spec(2, '.', ',', 20, NEGATIVE_PARENTHESES);
+        if (formatted_size(values[i], spec) <= sizeof(buf))
+        {
+            KHMZ_ASSERT_NO_ALLOCATION(end = format_to(buf, values[i], spec));
+            Currency parsed;
+            KHMZ_ASSERT_NO_ALLOCATION(parse_amount(buf, end, AmountFormat::us(), parsed));
+        }
+
+        for (int mode = ROUND_HALF_UP; mode <= ROUND_FLOOR; ++mode)
+        {
+            Currency cur(values[i]);
+            KHMZ_ASSERT_NO_ALLOCATION(cur.round(-2, RoundingMode(mode)));
+        }
+        significand_t sig = values[i].significand();
+        if (values[i].is_inf() || sig > max_significand / 10 || sig < -max_significand / 10)
+            continue;
+        // the constructor normalizes
+        KHMZ_ASSERT_NO_ALLOCATION(Currency(sig * 10, values[i].exp10() - 1));
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (size_t j = 0; j < count; ++j)
+        {
+            const Currency& a = values[i];
+            const Currency& b = values[j];
+            if (a.is_inf() || b.is_inf())
+                continue;
+
+            Currency cur(a);
+            KHMZ_ASSERT_NO_ALLOCATION(cur.compare(b));
+            KHMZ_ASSERT_NO_ALLOCATION(cur += b);
+            cur = a;
+            KHMZ_ASSERT_NO_ALLOCATION(cur -= b);
+            cur = a;
+            KHMZ_ASSERT_NO_ALLOCATION(cur *= b);
+
+            UnsignedCurrency ua(a.base()), ub(b.base());
+            KHMZ_ASSERT_NO_ALLOCATION(ua.compare(ub));
+            KHMZ_ASSERT_NO_ALLOCATION(ua += ub);
+            ua = a.base();
+            if (ua >= ub)
+                KHMZ_ASSERT_NO_ALLOCATION(ua -= ub);
+        }
+    }
+
+    // a cached FxTable conversion is shared, not copied
+    FxTable table("USD");
+    table.set_rate("EUR", Currency("1.0842"));
+    const std::string eur("EUR"), usd("USD");
+    table.convert(Currency(1), eur, usd);
+    Currency converted;
+    KHMZ_ASSERT_NO_ALLOCATION(converted = table.convert(Currency(100), eur, usd));
+    assert(converted == "108.42");
+
+    // the aligned paths against the exact results
+    assert(Currency("1.5") + Currency("2.25") == "3.75");
+    assert(Currency("2.25") - Currency("1.5") == "0.75");
+    assert(Currency("1.5") - Currency("2.25") == "-0.75");
+    assert(Currency("0.001") < Currency("0.01"));
+    assert(Currency(1, 30) > Currency(max_significand, -3));
+    assert(Currency(1, 18) + Currency(1, -5) == Currency(1, 18));
+    assert(Currency(1, 19) - Currency(1, -40) == Currency(significand_t(999999999999999999), 1));
+    assert(Currency(1, -40) < Currency(3, -40));
+    assert(Currency(1, -40).compare(Currency()) > 0);
+    assert((Currency(max_significand) + Currency(max_significand)).exp10() == 1);
+
+    puts("allocation_unittest: OK.");
+}
+#endif  // def UNITTEST
+
 } // namespace khmz
 
 #ifdef UNITTEST
@@ -309,5 +469,31 @@ int main(void)
     using namespace khmz;
     UnsignedCurrency::unittest();
     Currency::unittest();
+    CsvAmountReader::unittest();
+    CurrencyBinaryReader::unittest();
+    CurrencySeries::unittest();
+    AtomicCurrency::unittest();
+    CurrencyRangeIndex::unittest();
+    FxTable::unittest();
+    allocate_unittest();
+    finance_unittest();
+    CurrencyCounters::unittest();
+    allocation_unittest();
+    bcd_unittest();
+    bid_unittest();
+    ArrowDecimal128View::unittest();
+    locale_unittest();
+    JsonAmountScanner::unittest();
+    PriceLadder::unittest();
+    BarAggregator::unittest();
+    CurrencyPipeline::unittest();
+    Reconciler::unittest();
+    CurrencyStats::unittest();
+    CurrencyQuantiles::unittest();
+    ColumnPredicate::unittest();
+    CurrencyHistogram::unittest();
+    CurrencyDivisor::unittest();
+    LedgerFile::unittest();
+    LedgerWriter::unittest();
 }
 #endif
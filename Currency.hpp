@@ -14,6 +14,8 @@
 #include <iostream>
 #include <algorithm>
 
+#include "CurrencyCounters.hpp"
+
 namespace khmz
 {
 
@@ -23,6 +25,65 @@ typedef int32_t exp10_t;
 static const significand_t max_significand = std::numeric_limits<significand_t>::max();
 static const exp10_t max_exp10 = std::numeric_limits<exp10_t>::max();
 
+// 10^e10 for 0 <= e10 <= 19
+inline uint64_t pow10_u64(int e10)
+{
+    static const uint64_t s_table[] =
+    {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+        1000000000, 10000000000, 100000000000, 1000000000000,
+        10000000000000, 100000000000000, 1000000000000000,
+        10000000000000000, 100000000000000000, 1000000000000000000,
+        10000000000000000000ULL
+    };
+    assert(0 <= e10 && e10 <= 19);
+    return s_table[e10];
+}
+
+enum RoundingMode
+{
+    ROUND_HALF_UP,      // round half away from zero
+    ROUND_HALF_EVEN,    // bankers' rounding
+    ROUND_UP,           // away from zero
+    ROUND_DOWN,         // toward zero (truncation)
+    ROUND_CEILING,      // toward +inf
+    ROUND_FLOOR         // toward -inf
+};
+
+// the sign of (r - d / 2) for a remainder r < d, without overflow
+template <typename T>
+inline int half_compare(T r, T d)
+{
+    return (r < d - r) ? -1 : (r == d - r) ? 0 : 1;
+}
+
+// whether a truncated quotient must be incremented (in magnitude).
+// half_cmp is the sign of (remainder - divisor / 2); inexact is
+// whether the remainder is nonzero.
+inline bool
+round_increment(RoundingMode mode, bool odd, int half_cmp, bool inexact, bool negative)
+{
+    if (!inexact)
+        return false;
+
+    switch (mode)
+    {
+    case ROUND_HALF_UP:
+        return half_cmp >= 0;
+    case ROUND_HALF_EVEN:
+        return half_cmp > 0 || (half_cmp == 0 && odd);
+    case ROUND_UP:
+        return true;
+    case ROUND_DOWN:
+        return false;
+    case ROUND_CEILING:
+        return !negative;
+    case ROUND_FLOOR:
+        return negative;
+    }
+    return false;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // UnsignedCurrency
 
@@ -32,8 +93,10 @@ protected:
     significand_t m_significand;
     exp10_t m_exp10;
     static significand_t upow10(exp10_t e10);
-    static std::string add_helper(std::string a, std::string b);
-    static std::string sub_helper(std::string a, std::string b);
+    static exp10_t align(const UnsignedCurrency& a, const UnsignedCurrency& b,
+                         unsigned __int128& x, unsigned __int128& y,
+                         bool round_up_b, bool& inexact);
+    void assign_wide(unsigned __int128 significand, exp10_t exp10);
 
 public:
     UnsignedCurrency()
@@ -55,7 +118,16 @@ public:
 
     void normalize();
 
-    explicit UnsignedCurrency(significand_t significand, exp10_t exp10 = 0)
+    significand_t significand() const
+    {
+        return m_significand;
+    }
+    exp10_t exp10() const
+    {
+        return m_exp10;
+    }
+
+    explicit UnsignedCurrency(long long significand, exp10_t exp10 = 0)
         : m_significand(significand)
         , m_exp10(exp10)
     {
@@ -63,20 +135,24 @@ public:
     }
 
     explicit UnsignedCurrency(int significand, exp10_t exp10 = 0)
-        : UnsignedCurrency(significand_t(significand), exp10)
+        : UnsignedCurrency((long long)significand, exp10)
     {
     }
     explicit UnsignedCurrency(unsigned int significand, exp10_t exp10 = 0)
-        : UnsignedCurrency(significand_t(significand), exp10)
+        : UnsignedCurrency((long long)significand, exp10)
     {
     }
 
     explicit UnsignedCurrency(long significand, exp10_t exp10 = 0)
-        : UnsignedCurrency(significand_t(significand), exp10)
+        : UnsignedCurrency((long long)significand, exp10)
     {
     }
     explicit UnsignedCurrency(unsigned long significand, exp10_t exp10 = 0)
-        : UnsignedCurrency(significand_t(significand), exp10)
+        : UnsignedCurrency((long long)significand, exp10)
+    {
+    }
+    explicit UnsignedCurrency(unsigned long long significand, exp10_t exp10 = 0)
+        : UnsignedCurrency((long long)significand, exp10)
     {
     }
 
@@ -84,6 +160,7 @@ public:
     UnsignedCurrency& operator=(const UnsignedCurrency&) = default;
 
     void parse(const char *str);
+    bool try_parse(const char *first, const char *last);
 
     UnsignedCurrency(const char *str)
     {
@@ -291,6 +368,10 @@ public:
 
     std::string to_string() const;
 
+    // writes to_string() into [first, last) without allocating.
+    // returns the end of the output, or NULL if it does not fit.
+    char *to_chars(char *first, char *last) const;
+
     const char *c_str() const
     {
         return to_string().c_str();
@@ -364,31 +445,36 @@ public:
         return m_base;
     }
 
-    explicit Currency(significand_t significand, exp10_t exp10 = 0)
+    explicit Currency(long long significand, exp10_t exp10 = 0)
         : m_base(std::abs(significand), exp10)
         , m_negative(significand < 0)
     {
         normalize();
     }
     explicit Currency(int significand, exp10_t exp10 = 0)
-        : Currency(significand_t(significand), exp10)
+        : Currency((long long)significand, exp10)
     {
     }
     explicit Currency(unsigned int significand, exp10_t exp10 = 0)
-        : Currency(significand_t(significand), exp10)
+        : Currency((long long)significand, exp10)
     {
     }
     explicit Currency(long significand, exp10_t exp10 = 0)
-        : Currency(significand_t(significand), exp10)
+        : Currency((long long)significand, exp10)
     {
     }
     explicit Currency(unsigned long significand, exp10_t exp10 = 0)
-        : Currency(significand_t(significand), exp10)
+        : Currency((long long)significand, exp10)
+    {
+    }
+    explicit Currency(unsigned long long significand, exp10_t exp10 = 0)
+        : Currency((long long)significand, exp10)
     {
     }
     explicit Currency(double value);
 
     void parse(const char *str);
+    bool try_parse(const char *first, const char *last);
 
     Currency(const char *str)
     {
@@ -423,6 +509,14 @@ public:
     {
         return m_negative;
     }
+    significand_t significand() const
+    {
+        return m_negative ? -m_base.significand() : m_base.significand();
+    }
+    exp10_t exp10() const
+    {
+        return m_base.exp10();
+    }
     void set_negative(bool negative = true)
     {
         m_negative = negative;
@@ -613,6 +707,7 @@ public:
     Currency get_inverted() const;
 
     std::string to_string() const;
+    char *to_chars(char *first, char *last) const;
 
     const char *c_str() const
     {
@@ -624,21 +719,24 @@ public:
         std::printf("%s\n", to_string().c_str());
     }
 
+    // rounds to a multiple of 10^e10
+    void round(exp10_t e10, RoundingMode mode);
+
     void round(exp10_t e10 = 0)
     {
-        // TODO:
+        round(e10, ROUND_HALF_UP);
     }
     void round_up(exp10_t e10 = 0)
     {
-        // TODO:
+        round(e10, ROUND_UP);
     }
     void round_down(exp10_t e10 = 0)
     {
-        // TODO:
+        round(e10, ROUND_DOWN);
     }
     void bankers_rounding(exp10_t e10 = 0)
     {
-        // TODO:
+        round(e10, ROUND_HALF_EVEN);
     }
 
     Currency get_round(exp10_t e10 = 0)
@@ -659,10 +757,10 @@ public:
         ret.round_down(e10);
         return ret;
     }
-    Currency get_bankers_rounding(exp10_t e10)
+    Currency get_bankers_rounding(exp10_t e10 = 0)
     {
         Currency ret(*this);
-        ret.get_bankers_rounding(e10);
+        ret.bankers_rounding(e10);
         return ret;
     }
 
@@ -0,0 +1,84 @@
+// CurrencyAllocate.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyAllocate.hpp"
+
+namespace khmz
+{
+
+void allocate_unittest()
+{
+    Currency out[7];
+
+    split_even(Currency("100"), 3, -2, out);
+    assert(out[0] == "33.34");
+    assert(out[1] == "33.33");
+    assert(out[2] == "33.33");
+    split_even(Currency("-0.05"), 7, -2, out);
+    assert(out[4] == "-0.01");
+    assert(out[5] == "0");
+    assert(!out[5].is_negative());
+    split_even(Currency(0), 2, 3, out);
+    assert(out[0].is_zero() && out[1].is_zero());
+
+    // 100 by 1:1:1
+    Currency ones[3] = { Currency(1), Currency(1), Currency(1) };
+    allocate(Currency("100"), ones, 3, -2, out);
+    assert(out[0] == "33.34");
+    assert(out[1] == "33.33");
+    assert(out[2] == "33.33");
+
+    // largest remainders get the left units
+    Currency weights[4] = { Currency("0.2"), Currency("0.35"), Currency("0"), Currency("0.45") };
+    allocate(Currency("0.07"), weights, 4, -2, out);
+    // shares: 1.4, 2.45, 0, 3.15
+    assert(out[0] == "0.01");
+    assert(out[1] == "0.03");
+    assert(out[2] == "0");
+    assert(out[3] == "0.03");
+
+    allocate(Currency("-10"), ones, 3, 0, out);
+    assert(out[0] == "-4");
+    assert(out[1] == "-3");
+    assert(out[2] == "-3");
+
+    // many recipients with mixed exponents add up exactly
+    std::vector<Currency> many;
+    for (int i = 0; i < 100000; ++i)
+        many.push_back(Currency(significand_t(i % 97 + 1), -(i % 5)));
+    std::vector<Currency> parts(many.size());
+    Currency total("1234567.89");
+    allocate(total, many.data(), many.size(), -2, parts.data());
+    Currency sum;
+    for (size_t i = 0; i < parts.size(); ++i)
+        sum += parts[i];
+    assert(sum == total);
+
+    bool catched = false;
+    try
+    {
+        allocate(Currency("1.001"), ones, 3, -2, out);
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+
+    // a weight that fits at its own exponent but not at the smallest one
+    const Currency uneven[2] = { Currency(significand_t(9000000000000000001ULL)), Currency("0.1") };
+    catched = false;
+    try
+    {
+        allocate(Currency("100"), uneven, 2, -2, out);
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+
+    puts("allocate_unittest: OK.");
+}
+
+} // namespace khmz
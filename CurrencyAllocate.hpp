@@ -0,0 +1,155 @@
+// CurrencyAllocate.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <vector>
+#include <functional>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// allocate / split_even
+//
+// Loss-free splitting of a total into parts at the scale 10^scale. The
+// parts always add up exactly to the total. allocate() splits by weights
+// with the largest remainder method: each part gets the floor of its
+// share and the units left over go to the largest remainders, earlier
+// parts first on ties. A negative total splits like its magnitude.
+
+void allocate_unittest();
+
+// units of 10^scale for allocation; throws if total is finer than scale
+inline int64_t allocation_units(const Currency& total, exp10_t scale)
+{
+    int64_t units;
+    if (!currency_to_units(total, scale, units))
+        throw std::runtime_error("allocate: out of scale");
+    return units;
+}
+
+inline void
+split_even(const Currency& total, size_t count, exp10_t scale, Currency *out)
+{
+    if (count == 0)
+        throw std::runtime_error("split_even: no parts");
+
+    int64_t units = allocation_units(total, scale);
+    bool negative = units < 0;
+    uint64_t magnitude = negative ? 0 - uint64_t(units) : uint64_t(units);
+    uint64_t q = magnitude / count, r = magnitude % count;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t part = q + (i < r);
+        out[i] = Currency(significand_t(part), scale);
+        if (negative && part)
+            out[i].set_negative();
+    }
+}
+
+inline void
+allocate(const Currency& total, const Currency *weights, size_t count,
+         exp10_t scale, Currency *out)
+{
+    if (count == 0)
+        throw std::runtime_error("allocate: no parts");
+
+    int64_t units = allocation_units(total, scale);
+    bool negative = units < 0;
+    uint64_t magnitude = negative ? 0 - uint64_t(units) : uint64_t(units);
+
+    // the sum of the weights at their smallest exponent
+    exp10_t base = max_exp10;
+    unsigned __int128 sum = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Currency& weight = weights[i];
+        if (weight.is_negative() || weight.is_inf())
+            throw std::runtime_error("allocate: invalid weight");
+        if (weight.is_zero())
+            continue;
+        if (weight.exp10() < base)
+        {
+            if (sum)
+            {
+                for (int64_t k = int64_t(base) - weight.exp10(); k > 0; k -= 19)
+                {
+                    if (__builtin_mul_overflow(sum, pow10_u64(int(std::min<int64_t>(k, 19))), &sum))
+                        throw std::runtime_error("allocate: weights out of range");
+                }
+            }
+            base = weight.exp10();
+        }
+        significand_t scaled;
+        if (!rescale_significand(weight.significand(), weight.exp10(), base, scaled))
+            throw std::runtime_error("allocate: weights out of range");
+        sum += uint64_t(scaled);
+    }
+    if (sum == 0)
+        throw std::runtime_error("allocate: zero weights");
+
+    // floors of the shares and their remainders; a weight checked at an
+    // earlier base may not fit at the final one
+    std::vector<unsigned __int128> remainders(count);
+    uint64_t left = magnitude;
+    for (size_t i = 0; i < count; ++i)
+    {
+        significand_t scaled = 0;
+        if (!weights[i].is_zero() &&
+            !rescale_significand(weights[i].significand(), weights[i].exp10(), base, scaled))
+            throw std::runtime_error("allocate: weights out of range");
+        unsigned __int128 n = (unsigned __int128)magnitude * uint64_t(scaled);
+        uint64_t part = uint64_t(n / sum);
+        remainders[i] = n % sum;
+        out[i] = Currency(significand_t(part), scale);
+        left -= part;
+    }
+
+    // the left units go to the largest remainders, less than one per part
+    assert(left < count);
+    if (left)
+    {
+        std::vector<unsigned __int128> sorted(remainders);
+        std::nth_element(sorted.begin(), sorted.begin() + (left - 1), sorted.end(),
+                         std::greater<unsigned __int128>());
+        unsigned __int128 threshold = sorted[left - 1];
+
+        size_t above = 0;
+        for (size_t i = 0; i < count; ++i)
+            above += (remainders[i] > threshold);
+        size_t ties = left - above;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            bool bump = remainders[i] > threshold;
+            if (!bump && remainders[i] == threshold && ties)
+            {
+                bump = true;
+                --ties;
+            }
+            if (bump)
+            {
+                int64_t part = 0;
+                currency_to_units(out[i], scale, part);
+                out[i] = Currency(significand_t(part + 1), scale);
+            }
+        }
+    }
+
+    if (negative)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!out[i].is_zero())
+                out[i].set_negative();
+        }
+    }
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,113 @@
+// CurrencyArrow.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyArrow.hpp"
+
+namespace khmz
+{
+
+void ArrowDecimal128View::unittest()
+{
+    // decimal128(10, 2): 1.23, null, -4.50, 100.00, 0.01
+    CurrencyColumn column;
+    column.push_back(Currency("1.23"));
+    column.push_back(Currency(1, 0));
+    column.push_back(Currency("-4.5"));
+    column.push_back(Currency(100));
+    column.push_back(Currency("0.01"));
+
+    std::vector<unsigned char> values, validity;
+    assert(export_decimal128(column, 10, 2, values, validity) == 0);
+    assert(values.size() == 5 * 16 && validity.size() == 1);
+    assert(values[0] == 123 && values[15] == 0);
+    assert(values[2 * 16] == (unsigned char)-450 && values[2 * 16 + 15] == 0xFF);
+    validity[0] &= ~0x02;   // make the second one null
+
+    ArrowDecimal128View view(values.data(), validity.data(), 5, 10, 2);
+    assert(view.size() == 5 && view.null_count() == 1);
+    assert(view.units(3) == 10000);
+    assert(view[0] == "1.23");
+    assert(view[1].is_zero() && !view.is_valid(1));
+    assert(view[2] == "-4.5");
+    Currency cur;
+    assert(!view.get(1, cur));
+    assert(view.get(4, cur) && cur == "0.01");
+    assert(view.sum_units() == 123 - 450 + 10000 + 1);
+    assert(view.sum() == "96.74");
+
+    std::vector<size_t> indices;
+    assert(view.filter(CMP_GT, Currency(1), indices) == 2);
+    assert(indices[0] == 0 && indices[1] == 3);
+    indices.clear();
+    assert(view.filter(CMP_LE, Currency("1.23"), indices) == 3);
+    indices.clear();
+    // an operand finer than the scale
+    assert(view.filter(CMP_LT, Currency("1.235"), indices) == 3);
+    indices.clear();
+    assert(view.filter(CMP_GE, Currency("1.225"), indices) == 2);
+    indices.clear();
+    assert(view.filter(CMP_EQ, Currency("1.225"), indices) == 0);
+    assert(view.filter(CMP_NE, Currency("1.225"), indices) == 4);
+    indices.clear();
+    assert(view.filter(CMP_LT, Currency(1, 100), indices) == 4);
+    indices.clear();
+    assert(view.filter(CMP_GT, Currency("-0.000000000000000000001"), indices) == 3);
+
+    std::vector<unsigned char> bitmap;
+    assert(view.compare(CMP_EQ, Currency(100), bitmap) == 1);
+    assert(bitmap.size() == 1 && bitmap[0] == 0x08);
+
+    // a slice with an offset and no bitmap
+    ArrowDecimal128View slice(values.data(), NULL, 2, 10, 2, 3);
+    assert(slice[0] == 100 && slice[1] == "0.01");
+    CurrencyColumn back;
+    slice.to_column(back);
+    assert(back.size() == 2 && back[0] == 100);
+
+    // rounding to the scale and precision
+    column.clear();
+    column.push_back(Currency("2.675"));
+    column.push_back(Currency(1, 0).get_inverted());
+    Currency inf;
+    inf.set_inf();
+    column.push_back(inf);
+    assert(export_decimal128(column, 5, 2, values, validity) == 1);
+    assert(validity[0] == 0x03);
+    ArrowDecimal128View rounded(values.data(), validity.data(), 3, 5, 2);
+    assert(rounded[0] == "2.68" && rounded[1] == 1 && rounded[2].is_zero());
+    column.push_back(Currency(1000));
+    bool thrown = false;
+    try
+    {
+        export_decimal128(column, 5, 2, values, validity);
+    }
+    catch (std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // a negative Arrow scale (hundreds) with zeros, as elements and operands
+    column.clear();
+    column.push_back(Currency());
+    column.push_back(Currency(500));
+    assert(export_decimal128(column, 10, -2, values, validity) == 0);
+    ArrowDecimal128View hundreds(values.data(), validity.data(), 2, 10, -2);
+    assert(hundreds[0].is_zero() && hundreds[1] == 500);
+    indices.clear();
+    assert(hundreds.filter(CMP_EQ, Currency(), indices) == 1 && indices[0] == 0);
+    indices.clear();
+    assert(hundreds.filter(CMP_GT, Currency(0), indices) == 1 && indices[0] == 1);
+
+    // 38 digits do not fit into Currency exactly
+    __int128 big = (__int128)pow10_u64(19) * pow10_u64(18) + 1;
+    ArrowDecimal128View wide(&big, NULL, 1, 38, 0);
+    assert(!wide.get(0, cur));
+    assert(wide[0] == Currency(significand_t(1000000000000000000), 19));
+
+    puts("ArrowDecimal128View::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
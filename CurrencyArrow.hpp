@@ -0,0 +1,333 @@
+// CurrencyArrow.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// ArrowDecimal128View
+//
+// A read-only view of an Apache Arrow decimal128 array: length 16-byte
+// little-endian two's complement integers (on a little-endian host) and an
+// optional validity bitmap (bit i of byte i / 8, LSB first; NULL if all
+// valid). The value of element i is integer * 10^-scale. Nothing is copied;
+// the buffers must outlive the view. The bulk kernels work on the 128-bit
+// integers directly and skip null elements.
+
+class ArrowDecimal128View
+{
+protected:
+    const unsigned char *m_values;
+    const unsigned char *m_validity;
+    size_t m_offset;    // of the first element, in elements
+    size_t m_length;
+    int m_precision;
+    int m_scale;
+
+    // operand as units of 10^-scale, rounded down if inexact; values
+    // outside 128 bits are clamped, which is enough since |units| < 10^38
+    void operand_units(const Currency& operand, __int128& units, bool& exact) const;
+
+    // calls fn(i) for each valid i with pred(units(i))
+    template <typename Pred, typename Fn>
+    void scan(Pred pred, Fn fn) const
+    {
+        for (size_t i = 0; i < m_length; ++i)
+        {
+            if (is_valid(i) && pred(units(i)))
+                fn(i);
+        }
+    }
+
+    // calls fn(i) for each valid i with value op operand
+    template <typename Fn>
+    void select(CompareOp op, const Currency& operand, Fn fn) const;
+
+public:
+    ArrowDecimal128View(const void *values, const void *validity, size_t length,
+                        int precision, int scale, size_t offset = 0)
+        : m_values((const unsigned char *)values)
+        , m_validity((const unsigned char *)validity)
+        , m_offset(offset)
+        , m_length(length)
+        , m_precision(precision)
+        , m_scale(scale)
+    {
+        if (precision < 1 || precision > 38)
+            throw std::runtime_error("ArrowDecimal128View: invalid precision");
+    }
+
+    size_t size() const
+    {
+        return m_length;
+    }
+    int precision() const
+    {
+        return m_precision;
+    }
+    int scale() const
+    {
+        return m_scale;
+    }
+
+    bool is_valid(size_t index) const
+    {
+        assert(index < m_length);
+        if (!m_validity)
+            return true;
+        size_t bit = m_offset + index;
+        return (m_validity[bit >> 3] >> (bit & 7)) & 1;
+    }
+
+    // the integer of element index
+    __int128 units(size_t index) const
+    {
+        assert(index < m_length);
+        __int128 ret;
+        std::memcpy(&ret, m_values + (m_offset + index) * 16, 16);
+        return ret;
+    }
+
+    // element index as Currency. returns false if it is null or does not
+    // fit into a Currency exactly.
+    bool get(size_t index, Currency& out) const
+    {
+        if (!is_valid(index))
+            return false;
+        __int128 value = units(index);
+        unsigned __int128 magnitude = (value < 0) ? 0 - (unsigned __int128)value : value;
+        return currency_from_exact(magnitude, value < 0, exp10_t(-m_scale), out);
+    }
+
+    // element index as Currency; null is zero, and the lowest digits are
+    // truncated if the value does not fit
+    Currency operator[](size_t index) const
+    {
+        if (!is_valid(index))
+            return Currency();
+        return currency_from_wide(units(index), exp10_t(-m_scale));
+    }
+
+    size_t null_count() const;
+
+    // the sum of the valid elements in units of 10^-scale; throws
+    // std::runtime_error on overflow
+    __int128 sum_units() const;
+    Currency sum() const
+    {
+        return currency_from_wide(sum_units(), exp10_t(-m_scale));
+    }
+
+    // sets bit i of bitmap (LSB first) if element i is valid and
+    // element op operand holds. returns the number of bits set.
+    size_t compare(CompareOp op, const Currency& operand, std::vector<unsigned char>& bitmap) const;
+
+    // appends the indices of the valid elements with element op operand
+    size_t filter(CompareOp op, const Currency& operand, std::vector<size_t>& indices) const;
+
+    // appends all the elements; nulls become zero
+    void to_column(CurrencyColumn& column) const;
+
+    static void unittest();
+};
+
+inline void
+ArrowDecimal128View::operand_units(const Currency& operand, __int128& units, bool& exact) const
+{
+    const __int128 max = ~(unsigned __int128)0 >> 1;
+    if (operand.is_inf())
+    {
+        units = operand.is_negative() ? -max - 1 : max;
+        exact = false;
+        return;
+    }
+
+    exact = currency_to_wide_units(operand, exp10_t(-m_scale), units);
+    if (exact)
+        return;
+
+    int64_t diff = int64_t(operand.exp10()) + m_scale;
+    if (diff > 0)
+    {
+        // too large for 128 bits
+        units = operand.is_negative() ? -max - 1 : max;
+        return;
+    }
+
+    // finer than the scale: floor(significand / 10^-diff)
+    significand_t sig = operand.significand();
+    if (diff <= -19)
+    {
+        units = (sig < 0) ? -1 : 0;
+        return;
+    }
+    significand_t p = significand_t(pow10_u64(int(-diff)));
+    significand_t q = sig / p;
+    if (sig % p != 0 && sig < 0)
+        --q;
+    units = q;
+}
+
+template <typename Fn>
+inline void
+ArrowDecimal128View::select(CompareOp op, const Currency& operand, Fn fn) const
+{
+    __int128 q;
+    bool exact;
+    operand_units(operand, q, exact);
+
+    // with an inexact operand v, q < v < q + 1
+    if (!exact)
+    {
+        switch (op)
+        {
+        case CMP_EQ:
+            return;
+        case CMP_NE:
+            break;
+        case CMP_LT:
+        case CMP_LE:
+            op = CMP_LE;
+            break;
+        case CMP_GT:
+        case CMP_GE:
+            op = CMP_GT;
+            break;
+        }
+    }
+
+    switch (op)
+    {
+    case CMP_EQ:
+        scan([q](__int128 x) { return x == q; }, fn);
+        break;
+    case CMP_NE:
+        if (exact)
+            scan([q](__int128 x) { return x != q; }, fn);
+        else
+            scan([](__int128) { return true; }, fn);
+        break;
+    case CMP_LT:
+        scan([q](__int128 x) { return x < q; }, fn);
+        break;
+    case CMP_LE:
+        scan([q](__int128 x) { return x <= q; }, fn);
+        break;
+    case CMP_GT:
+        scan([q](__int128 x) { return x > q; }, fn);
+        break;
+    case CMP_GE:
+        scan([q](__int128 x) { return x >= q; }, fn);
+        break;
+    }
+}
+
+inline size_t ArrowDecimal128View::null_count() const
+{
+    if (!m_validity)
+        return 0;
+    size_t ret = 0;
+    for (size_t i = 0; i < m_length; ++i)
+        ret += !is_valid(i);
+    return ret;
+}
+
+inline __int128 ArrowDecimal128View::sum_units() const
+{
+    __int128 ret = 0;
+    for (size_t i = 0; i < m_length; ++i)
+    {
+        if (is_valid(i) && __builtin_add_overflow(ret, units(i), &ret))
+            throw std::runtime_error("ArrowDecimal128View: overflow");
+    }
+    return ret;
+}
+
+inline size_t
+ArrowDecimal128View::compare(CompareOp op, const Currency& operand,
+                             std::vector<unsigned char>& bitmap) const
+{
+    bitmap.assign((m_length + 7) / 8, 0);
+    size_t ret = 0;
+    select(op, operand, [&](size_t i) {
+        bitmap[i >> 3] |= (unsigned char)(1 << (i & 7));
+        ++ret;
+    });
+    return ret;
+}
+
+inline size_t
+ArrowDecimal128View::filter(CompareOp op, const Currency& operand,
+                            std::vector<size_t>& indices) const
+{
+    size_t count = indices.size();
+    select(op, operand, [&](size_t i) {
+        indices.push_back(i);
+    });
+    return indices.size() - count;
+}
+
+inline void ArrowDecimal128View::to_column(CurrencyColumn& column) const
+{
+    column.reserve(column.size() + m_length);
+    for (size_t i = 0; i < m_length; ++i)
+        column.push_back((*this)[i]);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// export to the Arrow layout
+
+// writes column as decimal128(precision, scale) into values (16 bytes per
+// element) and validity (infinities become nulls). each value is rounded to
+// the scale; std::runtime_error is thrown if one needs more digits than
+// precision. returns the number of nulls.
+inline size_t
+export_decimal128(const CurrencyColumn& column, int precision, int scale,
+                  std::vector<unsigned char>& values, std::vector<unsigned char>& validity,
+                  RoundingMode mode = ROUND_HALF_EVEN)
+{
+    if (precision < 1 || precision > 38)
+        throw std::runtime_error("export_decimal128: invalid precision");
+
+    const unsigned __int128 limit = [precision]() {
+        unsigned __int128 ret = 1;
+        for (int i = 0; i < precision; ++i)
+            ret *= 10;
+        return ret;
+    }();
+
+    const size_t size = column.size();
+    values.assign(size * 16, 0);
+    validity.assign((size + 7) / 8, 0);
+    size_t nulls = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        Currency value = column[i];
+        if (value.is_inf())
+        {
+            ++nulls;
+            continue;
+        }
+        value.round(exp10_t(-scale), mode);
+
+        __int128 units;
+        if (!currency_to_wide_units(value, exp10_t(-scale), units) ||
+            (unsigned __int128)(units < 0 ? -units : units) >= limit)
+        {
+            throw std::runtime_error("export_decimal128: value exceeds precision");
+        }
+        std::memcpy(&values[i * 16], &units, 16);
+        validity[i >> 3] |= (unsigned char)(1 << (i & 7));
+    }
+    return nulls;
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
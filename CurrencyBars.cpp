@@ -0,0 +1,118 @@
+// CurrencyBars.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyBars.hpp"
+#include <random>
+
+namespace khmz
+{
+
+void BarAggregator::unittest()
+{
+    // one-minute bars of cents and whole shares
+    BarAggregator bars(60, -2, 0, -4);
+    const int64_t timestamps[] = { 0, 10, 59, 60, 61, 30, 200, 250 };
+    const Currency prices[] =
+    {
+        Currency("10.00"), Currency("10.50"), Currency("9.75"), Currency("11"),
+        Currency("11.01"), Currency("10"), Currency("10.001"), Currency("12")
+    };
+    const Currency qtys[] =
+    {
+        Currency(100), Currency(200), Currency(300), Currency(1),
+        Currency(2), Currency(5), Currency(1), Currency(3)
+    };
+    std::vector<OhlcBar> out;
+    std::vector<size_t> invalid;
+    assert(bars.add(timestamps, prices, qtys, 8, out, invalid) == 2);
+    assert(invalid.size() == 2 && invalid[0] == 5 && invalid[1] == 6);
+    assert(out.size() == 2 && bars.has_open_bar());
+    bars.flush(out);
+    assert(out.size() == 3 && !bars.has_open_bar());
+
+    assert(out[0].start == 0 && out[0].ticks == 3);
+    assert(out[0].open == "10" && out[0].high == "10.5" && out[0].low == "9.75");
+    assert(out[0].close == "9.75" && out[0].volume == "600");
+    // (1000 + 2100 + 2925) / 600 = 10.0416666...
+    assert(out[0].vwap == "10.0417");
+    assert(out[1].start == 60 && out[1].vwap == "11.0067" && out[1].volume == "3");
+    assert(out[2].start == 240 && out[2].open == "12" && out[2].vwap == "12");
+
+    // negative timestamps and prices, no volume
+    BarAggregator spread(10, -2, 0, -2, ROUND_HALF_UP);
+    const int64_t ts[] = { -15, -11, -5 };
+    const int64_t price_units[] = { -150, -250, 300 };
+    const int64_t qty_units[] = { 1, 1, 0 };
+    out.clear();
+    invalid.clear();
+    assert(spread.add_units(ts, price_units, qty_units, 3, out, invalid) == 0);
+    spread.flush(out);
+    assert(out.size() == 2 && out[0].start == -20 && out[1].start == -10);
+    assert(out[0].vwap == "-2" && out[0].high == "-1.5" && out[0].low == "-2.5");
+    assert(out[1].vwap.is_zero() && out[1].volume.is_zero() && out[1].ticks == 1);
+
+    // qtys in lots of 100, one of them zero
+    BarAggregator lots(10, 0, 2, 0);
+    const int64_t lot_ts[] = { 0, 1 };
+    const Currency lot_prices[] = { Currency(5), Currency(7) };
+    const Currency lot_qtys[] = { Currency(0), Currency(200) };
+    out.clear();
+    invalid.clear();
+    assert(lots.add(lot_ts, lot_prices, lot_qtys, 2, out, invalid) == 0);
+    lots.flush(out);
+    assert(out.size() == 1 && out[0].volume == "200" && out[0].vwap == "7");
+
+    // exact against a Currency reference over random ticks, in parallel
+    const size_t instruments = 4, count = 5000;
+    std::vector<std::vector<int64_t> > all_ts(instruments);
+    std::vector<std::vector<Currency> > all_prices(instruments), all_qtys(instruments);
+    std::vector<TickBatch> batches;
+    std::mt19937_64 rng(44);
+    for (size_t k = 0; k < instruments; ++k)
+    {
+        int64_t t = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            t += int64_t(rng() % 10);
+            all_ts[k].push_back(t);
+            all_prices[k].push_back(Currency(significand_t(10000 + rng() % 1000), -2));
+            all_qtys[k].push_back(Currency(significand_t(1 + rng() % 500)));
+        }
+        TickBatch batch = { all_ts[k].data(), all_prices[k].data(), all_qtys[k].data(), count };
+        batches.push_back(batch);
+    }
+    std::vector<BarAggregator> aggregators(instruments, BarAggregator(1000, -2, 0, -8));
+    std::vector<std::vector<OhlcBar> > results(instruments);
+    std::vector<std::vector<size_t> > invalids(instruments);
+    aggregate_bars(aggregators.data(), batches.data(), instruments, results.data(),
+                   invalids.data(), 3);
+    for (size_t k = 0; k < instruments; ++k)
+    {
+        aggregators[k].flush(results[k]);
+        assert(invalids[k].empty());
+
+        size_t i = 0, ticks = 0;
+        for (size_t b = 0; b < results[k].size(); ++b)
+        {
+            const OhlcBar& bar = results[k][b];
+            Currency notional, volume, high = all_prices[k][i];
+            for (; i < count && all_ts[k][i] < bar.start + 1000; ++i, ++ticks)
+            {
+                notional += all_prices[k][i] * all_qtys[k][i];
+                volume += all_qtys[k][i];
+                if (all_prices[k][i] > high)
+                    high = all_prices[k][i];
+            }
+            assert(bar.volume == volume && bar.high == high);
+            WideDecimal vwap = WideDecimal::from(notional) / WideDecimal::from(volume);
+            assert(bar.vwap == vwap.to_currency(-8, ROUND_HALF_EVEN));
+        }
+        assert(ticks == count);
+    }
+
+    puts("BarAggregator::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
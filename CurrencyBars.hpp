@@ -0,0 +1,266 @@
+// CurrencyBars.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "WideDecimal.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// OhlcBar
+
+struct OhlcBar
+{
+    int64_t start;      // timestamp of the start of the interval
+    Currency open;
+    Currency high;
+    Currency low;
+    Currency close;
+    Currency volume;
+    Currency vwap;      // sum(price * qty) / sum(qty), zero if no volume
+    uint64_t ticks;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// BarAggregator
+//
+// Aggregates the ticks (timestamp, price, qty) of one instrument into bars
+// of interval timestamp units. Prices and quantities are taken as integer
+// units of 10^price_scale and 10^qty_scale, so a tick costs integer compares
+// and one 64x64-bit multiply; the notional and the volume are summed exactly
+// in 128 bits. The VWAP is divided once per bar, exactly in 256 bits, and
+// rounded to vwap_scale.
+//
+// Timestamps must not decrease. A tick older than the open bar, with a
+// negative qty, or with a price or qty finer than its scale is skipped and
+// its index appended to invalid. Only the open bar is held in memory.
+
+class BarAggregator
+{
+protected:
+    int64_t m_interval;
+    exp10_t m_price_scale;
+    exp10_t m_qty_scale;
+    exp10_t m_vwap_scale;
+    RoundingMode m_mode;
+
+    // the open bar
+    bool m_open;
+    int64_t m_start;
+    int64_t m_first;
+    int64_t m_high;
+    int64_t m_low;
+    int64_t m_last;
+    __int128 m_notional;    // units of 10^(price_scale + qty_scale)
+    __int128 m_volume;      // units of 10^qty_scale
+    uint64_t m_ticks;
+
+    int64_t bar_start(int64_t timestamp) const
+    {
+        int64_t r = timestamp % m_interval;
+        return timestamp - ((r < 0) ? r + m_interval : r);
+    }
+    void close_bar(std::vector<OhlcBar>& out);
+
+public:
+    BarAggregator(int64_t interval, exp10_t price_scale = -2, exp10_t qty_scale = 0,
+                  exp10_t vwap_scale = -6, RoundingMode mode = ROUND_HALF_EVEN)
+        : m_interval(interval)
+        , m_price_scale(price_scale)
+        , m_qty_scale(qty_scale)
+        , m_vwap_scale(vwap_scale)
+        , m_mode(mode)
+        , m_open(false)
+    {
+        if (interval <= 0 || vwap_scale > price_scale || price_scale - vwap_scale > 19)
+            throw std::runtime_error("BarAggregator: invalid parameters");
+    }
+
+    bool has_open_bar() const
+    {
+        return m_open;
+    }
+
+    // the tick-level interface: prices and qtys in units of their scales.
+    // closed bars are appended to out. returns the number of invalid ticks.
+    size_t add_units(const int64_t *timestamps, const int64_t *prices, const int64_t *qtys,
+                     size_t count, std::vector<OhlcBar>& out, std::vector<size_t>& invalid);
+
+    // Currency ticks, as arrays or columns
+    size_t add(const int64_t *timestamps, const Currency *prices, const Currency *qtys,
+               size_t count, std::vector<OhlcBar>& out, std::vector<size_t>& invalid);
+    size_t add(const int64_t *timestamps, const CurrencyColumn& prices,
+               const CurrencyColumn& qtys, std::vector<OhlcBar>& out,
+               std::vector<size_t>& invalid);
+
+    // closes the open bar, if any
+    void flush(std::vector<OhlcBar>& out)
+    {
+        if (m_open)
+            close_bar(out);
+    }
+
+    static void unittest();
+};
+
+inline void BarAggregator::close_bar(std::vector<OhlcBar>& out)
+{
+    OhlcBar bar;
+    bar.start = m_start;
+    bar.open = Currency(significand_t(m_first), m_price_scale);
+    bar.high = Currency(significand_t(m_high), m_price_scale);
+    bar.low = Currency(significand_t(m_low), m_price_scale);
+    bar.close = Currency(significand_t(m_last), m_price_scale);
+    bar.volume = currency_from_wide(m_volume, m_qty_scale);
+    bar.ticks = m_ticks;
+
+    if (m_volume == 0)
+    {
+        bar.vwap = Currency();
+    }
+    else
+    {
+        // notional * 10^(price_scale - vwap_scale) / volume; it lies between
+        // the low and the high, so the quotient fits into 128 bits
+        const bool negative = m_notional < 0;
+        UInt256 x(negative ? 0 - (unsigned __int128)m_notional : (unsigned __int128)m_notional);
+        x.mul(pow10_u64(int(m_price_scale - m_vwap_scale)));
+        const unsigned __int128 volume = (unsigned __int128)m_volume;
+        const unsigned __int128 r = x.divide(volume);
+        const int half_cmp = half_compare(r, volume);
+        unsigned __int128 q = x.lo;
+        if (round_increment(m_mode, q & 1, half_cmp, r != 0, negative))
+            ++q;
+        bar.vwap = currency_from_wide(negative ? -__int128(q) : __int128(q), m_vwap_scale);
+    }
+    out.push_back(bar);
+    m_open = false;
+}
+
+inline size_t
+BarAggregator::add_units(const int64_t *timestamps, const int64_t *prices, const int64_t *qtys,
+                         size_t count, std::vector<OhlcBar>& out, std::vector<size_t>& invalid)
+{
+    const size_t invalid_count = invalid.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int64_t price = prices[i], qty = qtys[i];
+        if (qty < 0 || (m_open && timestamps[i] < m_start))
+        {
+            invalid.push_back(i);
+            continue;
+        }
+
+        if (m_open && timestamps[i] - m_start >= m_interval)
+            close_bar(out);
+        if (!m_open)
+        {
+            m_open = true;
+            m_start = bar_start(timestamps[i]);
+            m_first = m_high = m_low = price;
+            m_notional = m_volume = 0;
+            m_ticks = 0;
+        }
+
+        m_high = std::max(m_high, price);
+        m_low = std::min(m_low, price);
+        m_last = price;
+        ++m_ticks;
+        if (__builtin_add_overflow(m_notional, __int128(price) * qty, &m_notional))
+            throw std::runtime_error("BarAggregator: overflow");
+        m_volume += qty;
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline size_t
+BarAggregator::add(const int64_t *timestamps, const Currency *prices, const Currency *qtys,
+                   size_t count, std::vector<OhlcBar>& out, std::vector<size_t>& invalid)
+{
+    // converted in runs so that the hot loop sees plain integers
+    const size_t run = 256;
+    int64_t price_units[run], qty_units[run], run_timestamps[run];
+    size_t indices[run];
+    std::vector<size_t> run_invalid;
+    const size_t invalid_count = invalid.size();
+    for (size_t first = 0; first < count; first += run)
+    {
+        const size_t last = std::min(count, first + run);
+        size_t n = 0;
+        for (size_t i = first; i < last; ++i)
+        {
+            if (!currency_to_units(prices[i], m_price_scale, price_units[n]) ||
+                !currency_to_units(qtys[i], m_qty_scale, qty_units[n]))
+            {
+                invalid.push_back(i);
+                continue;
+            }
+            run_timestamps[n] = timestamps[i];
+            indices[n++] = i;
+        }
+        run_invalid.clear();
+        add_units(run_timestamps, price_units, qty_units, n, out, run_invalid);
+        for (size_t k = 0; k < run_invalid.size(); ++k)
+            invalid.push_back(indices[run_invalid[k]]);
+    }
+    std::sort(invalid.begin() + invalid_count, invalid.end());
+    return invalid.size() - invalid_count;
+}
+
+inline size_t
+BarAggregator::add(const int64_t *timestamps, const CurrencyColumn& prices,
+                   const CurrencyColumn& qtys, std::vector<OhlcBar>& out,
+                   std::vector<size_t>& invalid)
+{
+    assert(prices.size() == qtys.size());
+    const size_t run = 256;
+    Currency p[run], q[run];
+    const size_t invalid_count = invalid.size();
+    std::vector<size_t> run_invalid;
+    for (size_t first = 0; first < prices.size(); first += run)
+    {
+        const size_t n = std::min(prices.size() - first, run);
+        for (size_t i = 0; i < n; ++i)
+        {
+            p[i] = prices[first + i];
+            q[i] = qtys[first + i];
+        }
+        run_invalid.clear();
+        add(timestamps + first, p, q, n, out, run_invalid);
+        for (size_t k = 0; k < run_invalid.size(); ++k)
+            invalid.push_back(first + run_invalid[k]);
+    }
+    return invalid.size() - invalid_count;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// aggregating many instruments in parallel
+
+struct TickBatch
+{
+    const int64_t *timestamps;
+    const Currency *prices;
+    const Currency *qtys;
+    size_t count;
+};
+
+// feeds batches[i] to aggregators[i], appending to out[i] and invalid[i],
+// with the instruments spread over threads
+inline void
+aggregate_bars(BarAggregator *aggregators, const TickBatch *batches, size_t count,
+               std::vector<OhlcBar> *out, std::vector<size_t> *invalid, unsigned int threads = 0)
+{
+    parallel_for(count, threads, [=](unsigned int, size_t i) {
+        aggregators[i].add(batches[i].timestamps, batches[i].prices, batches[i].qtys,
+                           batches[i].count, out[i], invalid[i]);
+    });
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,99 @@
+// CurrencyBcd.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyBcd.hpp"
+
+namespace khmz
+{
+
+void bcd_unittest()
+{
+    Currency value;
+
+    // PIC S9(5)V99 COMP-3: 4 bytes
+    const unsigned char packed[4] = { 0x01, 0x23, 0x45, 0x6D };
+    assert(from_packed_bcd(packed, 4, -2, value));
+    assert(value == "-1234.56");
+    const unsigned char unsigned_packed[2] = { 0x99, 0x9F };
+    assert(from_packed_bcd(unsigned_packed, 2, 0, value));
+    assert(value == 999);
+    const unsigned char bad_digit[2] = { 0x1A, 0x2C };
+    assert(!from_packed_bcd(bad_digit, 2, 0, value));
+    const unsigned char bad_sign[2] = { 0x12, 0x34 };
+    assert(!from_packed_bcd(bad_sign, 2, 0, value));
+
+    unsigned char buf[32];
+    assert(to_packed_bcd(Currency("-1234.56"), -2, buf, 4));
+    assert(std::memcmp(buf, packed, 4) == 0);
+    assert(!to_packed_bcd(Currency("1234.567"), -2, buf, 4));
+    assert(!to_packed_bcd(Currency("123456.78"), -2, buf, 4));
+
+    // 31 digits; only trailing zeros may go beyond the significand
+    std::memset(buf, 0, 16);
+    buf[0] = 0x01;
+    buf[15] = 0x0C;
+    assert(from_packed_bcd(buf, 16, -2, value));
+    assert(value == Currency(1, 27));
+    buf[15] = 0x1C;
+    assert(!from_packed_bcd(buf, 16, -2, value));
+    buf[0] = 0x00;
+    buf[7] = 0x12;
+    buf[8] = 0x34;
+    assert(from_packed_bcd(buf, 16, -2, value));
+    assert(value == "123400000000000.01");
+    assert(to_packed_bcd(Currency(max_significand), 0, buf, 16));
+    assert(from_packed_bcd(buf, 16, 0, value));
+    assert(value == Currency(max_significand));
+
+    // zoned PIC S9(5)V99: "0123456" with a negative last zone
+    const unsigned char zoned[7] = { 0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xD6 };
+    assert(from_zoned_decimal(zoned, 7, -2, value));
+    assert(value == "-1234.56");
+    assert(to_zoned_decimal(Currency("-1234.56"), -2, buf, 7));
+    assert(std::memcmp(buf, zoned, 7) == 0);
+    assert(to_zoned_decimal(Currency("1234.56"), -2, buf, 7));
+    assert(buf[6] == 0xC6);
+    const unsigned char bad_zone[3] = { 0xF1, 0x32, 0xC3 };
+    assert(!from_zoned_decimal(bad_zone, 3, 0, value));
+    const unsigned char bad_zoned_digit[3] = { 0xF1, 0xFA, 0xC3 };
+    assert(!from_zoned_decimal(bad_zoned_digit, 3, 0, value));
+
+    // every value round-trips through both encodings
+    for (int i = -1000; i <= 1000; i += 7)
+    {
+        Currency cur(significand_t(i) * 1234567, -3);
+        assert(to_packed_bcd(cur, -3, buf, 8));
+        assert(from_packed_bcd(buf, 8, -3, value) && value == cur);
+        assert(to_zoned_decimal(cur, -3, buf, 13));
+        assert(from_zoned_decimal(buf, 13, -3, value) && value == cur);
+    }
+
+    // records: 2 bytes of id, 4 of packed amount, 7 of zoned amount
+    unsigned char records[3 * 13];
+    for (int i = 0; i < 3; ++i)
+    {
+        unsigned char *record = records + i * 13;
+        record[0] = record[1] = 0;
+        to_packed_bcd(Currency(i * 100 + 1, -2), -2, record + 2, 4);
+        to_zoned_decimal(Currency(-i, 0), -2, record + 6, 7);
+    }
+    records[13 + 5] = 0x11;  // a bad sign in the second record
+
+    CurrencyColumn column;
+    std::vector<size_t> invalid;
+    assert(decode_packed_bcd(records, 3, 13, 2, 4, -2, column, invalid) == 1);
+    assert(invalid.size() == 1 && invalid[0] == 1);
+    assert(column.size() == 3);
+    assert(column[0] == "0.01");
+    assert(column[1].is_zero());
+    assert(column[2] == "2.01");
+    assert(decode_zoned_decimal(records, 3, 13, 6, 7, -2, column, invalid) == 0);
+    assert(column.size() == 6);
+    assert(column[5] == -2);
+
+    puts("bcd_unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,222 @@
+// CurrencyBcd.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+void bcd_unittest();
+
+//////////////////////////////////////////////////////////////////////////////
+// Packed (COMP-3) and zoned decimal
+//
+// A packed field of n bytes holds 2n - 1 digits and a trailing sign nibble
+// (C, A, E, F: plus; D, B: minus). A zoned (EBCDIC) field of n bytes holds
+// n digits as 0xF0 | digit, but the zone of the last byte is the sign.
+// The value of a field is digits * 10^scale (e.g. scale -2 for cents).
+// Fields hold at most 31 digits.
+//
+// The digits are converted to binary eight bytes at a time with SWAR
+// (SIMD within a register) steps instead of one digit at a time.
+
+enum { bcd_max_digits = 31 };
+
+// big-endian 64-bit load
+inline uint64_t bcd_load_be64(const unsigned char *ptr)
+{
+    uint64_t value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return __builtin_bswap64(value);
+}
+
+// true if every nibble of 16 BCD digits is 0 to 9
+inline bool bcd_valid16(uint64_t x)
+{
+    // a nibble over 9 carries when 6 is added to it
+    uint64_t sum;
+    if (__builtin_add_overflow(x, 0x6666666666666666ULL, &sum))
+        return false;
+    return ((sum ^ x ^ 0x6666666666666666ULL) & 0x1111111111111110ULL) == 0;
+}
+
+// 16 BCD digits to binary
+inline uint64_t bcd_to_binary16(uint64_t x)
+{
+    x -= 6 * ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL);           // bytes of 0..99
+    x -= 156 * ((x >> 8) & 0x00FF00FF00FF00FFULL);          // 0..9999
+    x -= 55536 * ((x >> 16) & 0x0000FFFF0000FFFFULL);       // 0..99999999
+    return (x >> 32) * 100000000 + (x & 0xFFFFFFFF);
+}
+
+// 8 bytes of 0 to 9 to binary
+inline uint64_t digits_to_binary8(uint64_t x)
+{
+    x -= 246 * ((x >> 8) & 0x00FF00FF00FF00FFULL);          // 0..99
+    x -= 65436 * ((x >> 16) & 0x0000FFFF0000FFFFULL);       // 0..9999
+    return (x >> 32) * 10000 + (x & 0xFFFFFFFF);
+}
+
+// sign nibble: 1 for plus, -1 for minus, 0 if invalid
+inline int bcd_sign(unsigned int nibble)
+{
+    switch (nibble)
+    {
+    case 0xA: case 0xC: case 0xE: case 0xF:
+        return 1;
+    case 0xB: case 0xD:
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+// decodes a packed field. returns false on a bad nibble or overflow.
+inline bool
+from_packed_bcd(const unsigned char *data, size_t size, exp10_t scale, Currency& out)
+{
+    if (size == 0 || size > (bcd_max_digits + 1) / 2)
+        return false;
+
+    const int sign = bcd_sign(data[size - 1] & 0x0F);
+    if (sign == 0)
+        return false;
+
+    // right-align the field into 16 bytes and drop the sign nibble
+    unsigned char buf[16] = { 0 };
+    std::memcpy(buf + 16 - size, data, size);
+    uint64_t hi = bcd_load_be64(buf), lo = bcd_load_be64(buf + 8);
+    lo = (lo >> 4) | (hi << 60);
+    hi >>= 4;
+    if (!bcd_valid16(hi) || !bcd_valid16(lo))
+        return false;
+
+    unsigned __int128 units = bcd_to_binary16(lo);
+    if (hi)
+        units += (unsigned __int128)bcd_to_binary16(hi) * 10000000000000000ULL;
+    return currency_from_exact(units, sign < 0, scale, out);
+}
+
+// encodes value at the scale into a packed field of size bytes. returns
+// false if value is finer than the scale or does not fit.
+inline bool
+to_packed_bcd(const Currency& value, exp10_t scale, unsigned char *data, size_t size)
+{
+    int64_t units;
+    if (size == 0 || !currency_to_units(value, scale, units))
+        return false;
+
+    uint64_t magnitude = (units < 0) ? 0 - uint64_t(units) : uint64_t(units);
+    std::memset(data, 0, size);
+    data[size - 1] = (units < 0) ? 0x0D : 0x0C;
+    for (size_t i = 0; i < 2 * size - 1 && magnitude; ++i)
+    {
+        // digit i from the right sits after the sign nibble
+        size_t nibble = i + 1;
+        unsigned char digit = (unsigned char)(magnitude % 10);
+        data[size - 1 - nibble / 2] |= (nibble & 1) ? digit << 4 : digit;
+        magnitude /= 10;
+    }
+    return magnitude == 0;
+}
+
+// decodes a zoned field. returns false on a bad byte or overflow.
+inline bool
+from_zoned_decimal(const unsigned char *data, size_t size, exp10_t scale, Currency& out)
+{
+    if (size == 0 || size > bcd_max_digits)
+        return false;
+
+    const int sign = bcd_sign(data[size - 1] >> 4);
+    if (sign == 0)
+        return false;
+
+    // right-align into 32 bytes of 0xF0 and unzone the last byte
+    unsigned char buf[32];
+    std::memset(buf, 0xF0, sizeof(buf));
+    std::memcpy(buf + 32 - size, data, size);
+    buf[31] |= 0xF0;
+
+    unsigned __int128 units = 0;
+    for (size_t i = 0; i < 32; i += 8)
+    {
+        uint64_t x = bcd_load_be64(buf + i);
+        // every zone must be F and every digit at most 9
+        if ((x & 0xF0F0F0F0F0F0F0F0ULL) != 0xF0F0F0F0F0F0F0F0ULL)
+            return false;
+        x &= 0x0F0F0F0F0F0F0F0FULL;
+        if ((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL)
+            return false;
+        units = units * 100000000 + digits_to_binary8(x);
+    }
+    return currency_from_exact(units, sign < 0, scale, out);
+}
+
+// encodes value at the scale into a zoned field of size bytes
+inline bool
+to_zoned_decimal(const Currency& value, exp10_t scale, unsigned char *data, size_t size)
+{
+    int64_t units;
+    if (size == 0 || !currency_to_units(value, scale, units))
+        return false;
+
+    uint64_t magnitude = (units < 0) ? 0 - uint64_t(units) : uint64_t(units);
+    for (size_t i = size; i-- > 0; )
+    {
+        data[i] = (unsigned char)(0xF0 | (magnitude % 10));
+        magnitude /= 10;
+    }
+    data[size - 1] = (unsigned char)(((units < 0) ? 0xD0 : 0xC0) | (data[size - 1] & 0x0F));
+    return magnitude == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// batch decoding of fixed-width records
+//
+// Decodes the field at offset of each record of record_size bytes and
+// appends the values to out. The index of each invalid record is appended
+// to invalid, and the record yields zero. Returns the number of invalid ones.
+
+inline size_t
+decode_packed_bcd(const unsigned char *records, size_t count, size_t record_size,
+                  size_t offset, size_t size, exp10_t scale,
+                  CurrencyColumn& out, std::vector<size_t>& invalid)
+{
+    assert(offset + size <= record_size);
+    const size_t invalid_count = invalid.size();
+    out.reserve(out.size() + count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        Currency value;
+        if (!from_packed_bcd(records + i * record_size + offset, size, scale, value))
+            invalid.push_back(i);
+        out.push_back(value);
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline size_t
+decode_zoned_decimal(const unsigned char *records, size_t count, size_t record_size,
+                     size_t offset, size_t size, exp10_t scale,
+                     CurrencyColumn& out, std::vector<size_t>& invalid)
+{
+    assert(offset + size <= record_size);
+    const size_t invalid_count = invalid.size();
+    out.reserve(out.size() + count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        Currency value;
+        if (!from_zoned_decimal(records + i * record_size + offset, size, scale, value))
+            invalid.push_back(i);
+        out.push_back(value);
+    }
+    return invalid.size() - invalid_count;
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,730 @@
+// CurrencyBenchmark.cpp --- micro benchmarks
+//////////////////////////////////////////////////////////////////////////////
+//
+// usage: currency_benchmark [--json FILE] [--min-time SECONDS] [FILTER]
+//
+// Runs every benchmark whose name contains FILTER and prints ns/op, ops/s
+// and heap allocations per op. The datasets come from fixed seeds, so the
+// numbers of two builds are comparable. --json writes the results as
+//   {"benchmarks":[{"name":...,"iterations":...,"ns_per_op":...,
+//                   "ops_per_sec":...,"allocs_per_op":...},...]}
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "CurrencyCsv.hpp"
+#include "CurrencyBinary.hpp"
+#include "CurrencySeries.hpp"
+#include "CurrencyFx.hpp"
+#include "CurrencyAllocate.hpp"
+#include "CurrencyBcd.hpp"
+#include "CurrencyLocale.hpp"
+#include "CurrencyJson.hpp"
+#include "PriceLadder.hpp"
+#include "CurrencyBars.hpp"
+#include "CurrencyPipeline.hpp"
+#include "CurrencyReconcile.hpp"
+#include "CurrencyStats.hpp"
+#include "CurrencyFilter.hpp"
+#include "CurrencyDivisor.hpp"
+#include "CurrencyLedger.hpp"
+#include "AllocationCounter.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+
+using namespace khmz;
+
+namespace
+{
+
+// keeps the compiler from optimizing value away
+template <typename T>
+inline void keep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+    double ops_per_sec;
+    double allocs_per_op;
+};
+
+std::vector<Result> s_results;
+std::string s_filter;
+double s_min_time = 0.2;
+
+// runs fn(n) with growing n until it takes s_min_time; each call of fn
+// performs n * ops_per_call operations
+template <typename Fn>
+void bench(const char *name, uint64_t ops_per_call, Fn fn)
+{
+    if (!s_filter.empty() && std::string(name).find(s_filter) == std::string::npos)
+        return;
+
+    typedef std::chrono::steady_clock clock;
+    fn(1);  // warm up
+
+    uint64_t n = 1;
+    for (;;)
+    {
+        uint64_t allocations = total_allocation_count();
+        clock::time_point start = clock::now();
+        fn(n);
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        allocations = total_allocation_count() - allocations;
+
+        if (seconds >= s_min_time || n >= (uint64_t(1) << 40))
+        {
+            double ops = double(n) * ops_per_call;
+            Result result;
+            result.name = name;
+            result.iterations = n * ops_per_call;
+            result.ns_per_op = seconds * 1e9 / ops;
+            result.ops_per_sec = ops / seconds;
+            result.allocs_per_op = allocations / ops;
+            s_results.push_back(result);
+            std::printf("%-28s %12.2f ns/op %14.0f ops/s %8.2f allocs/op\n",
+                        name, result.ns_per_op, result.ops_per_sec,
+                        result.allocs_per_op);
+            return;
+        }
+        n = (seconds < s_min_time / 100) ? n * 10 : n * 2;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// datasets
+
+const size_t dataset_size = 1024;
+
+std::string random_digits(std::mt19937_64& rng, size_t count)
+{
+    std::string ret;
+    for (size_t i = 0; i < count; ++i)
+        ret += char('0' + rng() % 10);
+    return ret;
+}
+
+// "123.45"-like strings with int_digits.frac_digits
+std::vector<std::string>
+make_strings(uint64_t seed, size_t int_digits, size_t frac_digits)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<std::string> ret;
+    for (size_t i = 0; i < dataset_size; ++i)
+    {
+        std::string str = random_digits(rng, int_digits);
+        if (frac_digits)
+            str += "." + random_digits(rng, frac_digits);
+        ret.push_back(str);
+    }
+    return ret;
+}
+
+// cents-like amounts; mixed picks the exponent from -6 to 0
+std::vector<Currency> make_amounts(uint64_t seed, bool mixed, int64_t max = 10000000)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<Currency> ret;
+    for (size_t i = 0; i < dataset_size; ++i)
+    {
+        significand_t sig = significand_t(rng() % uint64_t(max)) - max / 2;
+        exp10_t e10 = mixed ? -exp10_t(rng() % 7) : -2;
+        ret.push_back(Currency(sig, e10));
+    }
+    return ret;
+}
+
+std::vector<Currency> to_currencies(const std::vector<std::string>& strings)
+{
+    std::vector<Currency> ret;
+    for (size_t i = 0; i < strings.size(); ++i)
+        ret.push_back(Currency(strings[i].c_str()));
+    return ret;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void bench_parse_format()
+{
+    static const struct
+    {
+        const char *parse_name;
+        const char *format_name;
+        const char *to_chars_name;
+        size_t int_digits;
+        size_t frac_digits;
+    } s_shapes[] =
+    {
+        { "parse/short", "format/short", "to_chars/short", 3, 2 },
+        { "parse/long", "format/long", "to_chars/long", 16, 2 },
+        { "parse/many_fraction", "format/many_fraction", "to_chars/many_fraction", 1, 17 },
+    };
+
+    for (size_t k = 0; k < sizeof(s_shapes) / sizeof(s_shapes[0]); ++k)
+    {
+        const std::vector<std::string> strings =
+            make_strings(1000 + k, s_shapes[k].int_digits, s_shapes[k].frac_digits);
+        const std::vector<Currency> values = to_currencies(strings);
+
+        bench(s_shapes[k].parse_name, dataset_size, [&](uint64_t n) {
+            for (uint64_t j = 0; j < n; ++j)
+            {
+                for (size_t i = 0; i < dataset_size; ++i)
+                {
+                    Currency cur;
+                    cur.try_parse(strings[i].data(), strings[i].data() + strings[i].size());
+                    keep(cur);
+                }
+            }
+        });
+        bench(s_shapes[k].format_name, dataset_size, [&](uint64_t n) {
+            for (uint64_t j = 0; j < n; ++j)
+            {
+                for (size_t i = 0; i < dataset_size; ++i)
+                {
+                    std::string str = values[i].to_string();
+                    keep(str);
+                }
+            }
+        });
+        bench(s_shapes[k].to_chars_name, dataset_size, [&](uint64_t n) {
+            char buf[64];
+            for (uint64_t j = 0; j < n; ++j)
+            {
+                for (size_t i = 0; i < dataset_size; ++i)
+                {
+                    char *end = values[i].to_chars(buf, buf + sizeof(buf));
+                    keep(end);
+                }
+            }
+        });
+    }
+
+    // "$1,234,567.89" and "(1,234.00)"-like strings
+    const AmountFormat us = AmountFormat::us();
+    std::vector<std::string> grouped;
+    {
+        std::mt19937_64 rng(1100);
+        for (size_t i = 0; i < dataset_size; ++i)
+        {
+            std::string str = std::to_string(1 + rng() % 9) + "," + random_digits(rng, 3) +
+                              "," + random_digits(rng, 3) + "." + random_digits(rng, 2);
+            grouped.push_back((i & 1) ? "(" + str + ")" : "$" + str);
+        }
+    }
+    bench("parse_amount/grouped", dataset_size, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            for (size_t i = 0; i < dataset_size; ++i)
+            {
+                Currency cur;
+                parse_amount(grouped[i].data(), grouped[i].data() + grouped[i].size(), us, cur);
+                keep(cur);
+            }
+        }
+    });
+
+    const std::vector<Currency> amounts = make_amounts(1101, true, 1000000000);
+    const FormatSpec spec(2, '.', ',', 16, NEGATIVE_PARENTHESES);
+    bench("format_to/grouped", dataset_size, [&](uint64_t n) {
+        char buf[64];
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            for (size_t i = 0; i < dataset_size; ++i)
+            {
+                char *end = format_to(buf, amounts[i], spec);
+                keep(end);
+            }
+        }
+    });
+    bench("bulk/format_column", dataset_size, [&](uint64_t n) {
+        std::vector<char> out;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            out.clear();
+            format_column(amounts, dataset_size, spec, '\n', out);
+            keep(out);
+        }
+    });
+}
+
+void bench_arithmetic()
+{
+    const std::vector<Currency> a = make_amounts(2000, false);
+    const std::vector<Currency> b = make_amounts(2001, false);
+    const std::vector<Currency> ma = make_amounts(2002, true);
+    const std::vector<Currency> mb = make_amounts(2003, true);
+
+    // pairs over the dataset; fn(x, y) is one op
+    auto pairwise = [](const char *name, const std::vector<Currency>& x,
+                       const std::vector<Currency>& y, void (*fn)(const Currency&, const Currency&)) {
+        bench(name, dataset_size, [&](uint64_t n) {
+            for (uint64_t j = 0; j < n; ++j)
+            {
+                for (size_t i = 0; i < dataset_size; ++i)
+                    fn(x[i], y[i]);
+            }
+        });
+    };
+
+    void (*compare)(const Currency&, const Currency&) = [](const Currency& x, const Currency& y) {
+        int ret = x.compare(y);
+        keep(ret);
+    };
+    void (*add)(const Currency&, const Currency&) = [](const Currency& x, const Currency& y) {
+        Currency ret(x);
+        ret += y;
+        keep(ret);
+    };
+    void (*sub)(const Currency&, const Currency&) = [](const Currency& x, const Currency& y) {
+        Currency ret(x);
+        ret -= y;
+        keep(ret);
+    };
+    void (*mul)(const Currency&, const Currency&) = [](const Currency& x, const Currency& y) {
+        Currency ret(x);
+        ret *= y;
+        keep(ret);
+    };
+    void (*div)(const Currency&, const Currency&) = [](const Currency& x, const Currency& y) {
+        Currency ret(x);
+        if (!y.is_zero())
+            ret /= y;
+        keep(ret);
+    };
+
+    pairwise("compare/equal_exp", a, b, compare);
+    pairwise("compare/mixed_exp", ma, mb, compare);
+    pairwise("add/equal_exp", a, b, add);
+    pairwise("add/mixed_exp", ma, mb, add);
+    pairwise("sub/equal_exp", a, b, sub);
+    pairwise("sub/mixed_exp", ma, mb, sub);
+    pairwise("mul/no_overflow", a, b, mul);
+
+    const std::vector<Currency> big_a = to_currencies(make_strings(2004, 15, 3));
+    const std::vector<Currency> big_b = to_currencies(make_strings(2005, 15, 3));
+    pairwise("mul/overflow", big_a, big_b, mul);
+    pairwise("div", a, b, div);
+
+    const CurrencyDivisor shares(Currency(37));
+    bench("div/invariant", dataset_size, [&](uint64_t n) {
+        std::vector<Currency> out(dataset_size);
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            divide(a.data(), dataset_size, shares, -4, out.data());
+            keep(out);
+        }
+    });
+}
+
+void bench_conversions()
+{
+    std::mt19937_64 rng(3000);
+    std::vector<significand_t> significands;
+    for (size_t i = 0; i < dataset_size; ++i)
+        significands.push_back(significand_t(rng() % 100000) * 1000);
+
+    bench("normalize", dataset_size, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            for (size_t i = 0; i < dataset_size; ++i)
+            {
+                Currency cur(significands[i], -5);
+                keep(cur);
+            }
+        }
+    });
+
+    const std::vector<Currency> values = make_amounts(3001, true);
+    std::vector<double> doubles;
+    for (size_t i = 0; i < dataset_size; ++i)
+        doubles.push_back(double(values[i]));
+
+    bench("double/to", dataset_size, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            for (size_t i = 0; i < dataset_size; ++i)
+            {
+                double value = double(values[i]);
+                keep(value);
+            }
+        }
+    });
+    bench("double/from", dataset_size, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            for (size_t i = 0; i < dataset_size; ++i)
+            {
+                Currency cur(doubles[i]);
+                keep(cur);
+            }
+        }
+    });
+}
+
+void bench_bulk()
+{
+    const size_t rows = 64 * dataset_size;
+    std::mt19937_64 rng(4000);
+
+    std::string csv;
+    CurrencyColumn column;
+    std::vector<Currency> amounts;
+    for (size_t i = 0; i < rows; ++i)
+    {
+        Currency cur(significand_t(rng() % 10000000), -2);
+        csv += std::to_string(i) + "," + cur.to_string() + "\n";
+        column.push_back(cur);
+        amounts.push_back(cur);
+    }
+
+    bench("bulk/csv_read", rows, [&](uint64_t n) {
+        CsvAmountReader reader(std::vector<size_t>(1, 1));
+        reader.set_threads(1);
+        std::vector<CurrencyColumn> out;
+        std::vector<CsvError> errors;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            reader.read(csv.data(), csv.data() + csv.size(), out, errors);
+            keep(out);
+        }
+    });
+
+    std::string binary;
+    {
+        std::ostringstream os;
+        CurrencyBinaryWriter writer(os);
+        writer.write(column);
+        writer.close();
+        binary = os.str();
+    }
+    bench("bulk/binary_write", rows, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            std::ostringstream os;
+            CurrencyBinaryWriter writer(os);
+            writer.write(column);
+            writer.close();
+            keep(os);
+        }
+    });
+    bench("bulk/binary_read", rows, [&](uint64_t n) {
+        CurrencyColumn out;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            out.clear();
+            CurrencyBinaryReader reader(binary.data(), binary.size());
+            reader.read(out);
+            keep(out);
+        }
+    });
+
+    CurrencySeries series;
+    series.append(column);
+    bench("bulk/series_decode", rows, [&](uint64_t n) {
+        CurrencyColumn out;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            out.clear();
+            series.decode(out);
+            keep(out);
+        }
+    });
+
+    FxConversion fx(Currency("1.0842"), Currency("156.37"), -2);
+    std::vector<Currency> converted(rows);
+    bench("bulk/fx_convert", rows, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            fx.convert(amounts.data(), rows, converted.data());
+            keep(converted);
+        }
+    });
+
+    std::vector<unsigned char> packed(rows * 8);
+    for (size_t i = 0; i < rows; ++i)
+        to_packed_bcd(amounts[i], -2, &packed[i * 8], 8);
+    bench("bulk/packed_bcd_decode", rows, [&](uint64_t n) {
+        CurrencyColumn out;
+        std::vector<size_t> invalid;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            out.clear();
+            decode_packed_bcd(packed.data(), rows, 8, 0, 8, -2, out, invalid);
+            keep(out);
+        }
+    });
+
+    std::string json;
+    for (size_t i = 0; i < rows; ++i)
+    {
+        json += "{\"id\":" + std::to_string(i) + ",\"amount\":" + amounts[i].to_string() +
+                ",\"fee\":\"0.25\",\"memo\":\"transfer\"}\n";
+    }
+    const JsonAmountScanner scanner(std::vector<std::string>{ "amount", "fee" });
+    bench("bulk/json_scan", rows, [&](uint64_t n) {
+        std::vector<CurrencyColumn> out;
+        std::vector<size_t> invalid;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            out.clear();
+            scanner.scan(json.data(), json.data() + json.size(), out, invalid);
+            keep(out);
+        }
+    });
+
+    // a random walk of level updates around a moving mid
+    std::vector<int64_t> ladder_ticks(dataset_size), ladder_units(dataset_size);
+    {
+        std::mt19937_64 rng(1200);
+        int64_t mid = 100000;
+        for (size_t i = 0; i < dataset_size; ++i)
+        {
+            mid += int64_t(rng() % 5) - 2;
+            ladder_ticks[i] = mid - int64_t(rng() % 50);
+            ladder_units[i] = (rng() % 4 == 0) ? 0 : int64_t(rng() % 1000);
+        }
+    }
+    PriceLadder ladder(Currency("0.01"));
+    bench("ladder/update_best", dataset_size, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            for (size_t i = 0; i < dataset_size; ++i)
+            {
+                int64_t ticks, units;
+                ladder.set_units(SIDE_BID, ladder_ticks[i], ladder_units[i]);
+                ladder.best(SIDE_BID, ticks, units);
+                keep(units);
+            }
+        }
+    });
+
+    std::vector<int64_t> tick_times(rows);
+    std::vector<Currency> tick_prices(rows), tick_qtys(rows);
+    {
+        std::mt19937_64 rng(1300);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            tick_times[i] = int64_t(i) * 10;
+            tick_prices[i] = Currency(significand_t(10000 + rng() % 1000), -2);
+            tick_qtys[i] = Currency(significand_t(1 + rng() % 500));
+        }
+    }
+    bench("bulk/bars", rows, [&](uint64_t n) {
+        std::vector<OhlcBar> out;
+        std::vector<size_t> invalid;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            BarAggregator bars(1000);
+            out.clear();
+            bars.add(tick_times.data(), tick_prices.data(), tick_qtys.data(), rows, out, invalid);
+            bars.flush(out);
+            keep(out);
+        }
+    });
+
+    std::string lines;
+    for (size_t i = 0; i < rows; ++i)
+        lines += amounts[i].to_string() + "\n";
+    CurrencyPipeline pipeline;
+    pipeline.add_stage(parse_stage(), 2)
+            .add_stage(round_stage(-1), 1)
+            .add_stage(format_stage(), 2);
+    bench("bulk/pipeline", rows, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            size_t size = 0;
+            pipeline.run(text_source(lines.data(), lines.data() + lines.size(), 1024),
+                         [&](const PipelineBatch& batch) { size += batch.text.size(); });
+            keep(size);
+        }
+    });
+
+    std::vector<uint64_t> ledger_keys(rows);
+    const std::vector<Currency>& ledger_amounts = amounts;
+    {
+        std::mt19937_64 rng(1400);
+        for (size_t i = 0; i < rows; ++i)
+            ledger_keys[i] = rng();
+    }
+    std::vector<uint64_t> other_keys(ledger_keys.rbegin(), ledger_keys.rend());
+    std::vector<Currency> other_amounts(ledger_amounts.rbegin(), ledger_amounts.rend());
+    const Reconciler reconciler(Currency("0.01"));
+    bench("bulk/reconcile", rows, [&](uint64_t n) {
+        Reconciliation out;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            reconciler.reconcile(ledger_keys.data(), ledger_amounts.data(), rows,
+                                 other_keys.data(), other_amounts.data(), rows, out);
+            keep(out.matched);
+        }
+    });
+
+    bench("bulk/stats", rows, [&](uint64_t n) {
+        std::vector<size_t> invalid;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            CurrencyStats stats = column_stats(column, -2, invalid, 1);
+            keep(stats.stddev(-4));
+        }
+    });
+
+    bench("bulk/median", rows, [&](uint64_t n) {
+        std::vector<size_t> invalid;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            CurrencyQuantiles quantiles;
+            quantiles.add(column, invalid);
+            keep(quantiles.median());
+        }
+    });
+
+    const ColumnPredicate above(CMP_GT, Currency("50000.00"));
+    bench("bulk/filter", rows, [&](uint64_t n) {
+        std::vector<uint64_t> selection;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            size_t count = filter(column, above, selection);
+            keep(count);
+            keep(masked_sum_units(column, selection, -2));
+        }
+    });
+
+    const Currency edges[] = { Currency(100), Currency(1000), Currency(10000), Currency(50000) };
+    bench("bulk/histogram", rows, [&](uint64_t n) {
+        std::vector<size_t> invalid;
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            CurrencyHistogram histogram(edges, 4);
+            histogram.add(column, invalid);
+            keep(histogram);
+        }
+    });
+
+    const char *ledger_path = "currency_benchmark.ledger";
+    std::remove(ledger_path);
+    {
+        LedgerWriter writer(ledger_path);
+        writer.append(column);
+    }
+    bench("ledger/open", 1, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            LedgerFile ledger(ledger_path);
+            keep(ledger.size());
+        }
+    });
+    {
+        LedgerFile ledger(ledger_path);
+        bench("ledger/sum", rows, [&](uint64_t n) {
+            for (uint64_t j = 0; j < n; ++j)
+                keep(ledger.sum_units(1, ledger.size() - 1));
+        });
+        bench("ledger/filter", rows, [&](uint64_t n) {
+            for (uint64_t j = 0; j < n; ++j)
+            {
+                uint64_t count;
+                __int128 sum;
+                keep(ledger.count_sum(above, count, sum));
+                keep(sum);
+            }
+        });
+    }
+    std::remove(ledger_path);
+
+    std::vector<Currency> parts(dataset_size);
+    bench("bulk/allocate", dataset_size, [&](uint64_t n) {
+        for (uint64_t j = 0; j < n; ++j)
+        {
+            allocate(Currency(1000000), amounts.data(), dataset_size, -2, parts.data());
+            keep(parts);
+        }
+    });
+}
+
+std::string json_escape(const std::string& str)
+{
+    std::string ret;
+    for (size_t i = 0; i < str.size(); ++i)
+    {
+        if (str[i] == '"' || str[i] == '\\')
+            ret += '\\';
+        ret += str[i];
+    }
+    return ret;
+}
+
+bool write_json(const char *path)
+{
+    std::ofstream ofs(path);
+    if (!ofs)
+        return false;
+    ofs << "{\"benchmarks\":[";
+    for (size_t i = 0; i < s_results.size(); ++i)
+    {
+        const Result& result = s_results[i];
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+                      "\"iterations\":%llu,\"ns_per_op\":%.3f,"
+                      "\"ops_per_sec\":%.1f,\"allocs_per_op\":%.4f}",
+                      (unsigned long long)result.iterations, result.ns_per_op,
+                      result.ops_per_sec, result.allocs_per_op);
+        ofs << (i ? ",\n" : "\n") << "{\"name\":\"" << json_escape(result.name) << "\"," << buf;
+    }
+    ofs << "\n]}\n";
+    return bool(ofs);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *json_path = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc)
+        {
+            json_path = argv[++i];
+        }
+        else if (arg == "--min-time" && i + 1 < argc)
+        {
+            s_min_time = std::atof(argv[++i]);
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            std::fprintf(stderr,
+                         "usage: %s [--json FILE] [--min-time SECONDS] [FILTER]\n",
+                         argv[0]);
+            return 1;
+        }
+        else
+        {
+            s_filter = arg;
+        }
+    }
+
+    bench_parse_format();
+    bench_arithmetic();
+    bench_conversions();
+    bench_bulk();
+
+    if (json_path && !write_json(json_path))
+    {
+        std::fprintf(stderr, "%s: cannot write %s\n", argv[0], json_path);
+        return 1;
+    }
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
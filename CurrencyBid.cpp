@@ -0,0 +1,83 @@
+// CurrencyBid.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyBid.hpp"
+
+namespace khmz
+{
+
+void bid_unittest()
+{
+    uint64_t bits;
+    Currency value;
+
+    // known decimal64 patterns
+    assert(to_bid64(Currency(1), bits) && bits == 0x31C0000000000001ULL);
+    assert(to_bid64(Currency("-1.23"), bits) && bits == 0xB18000000000007BULL);
+    assert(to_bid64(Currency(), bits) && bits == 0x31C0000000000000ULL);
+    assert(to_bid64(Currency(significand_t(9999999999999999)), bits));
+    assert(bits == 0x6C7386F26FC0FFFFULL);
+    assert(from_bid64(0x6C7386F26FC0FFFFULL, value));
+    assert(value == Currency(significand_t(9999999999999999)));
+    assert(from_bid64(0xB18000000000007BULL, value) && value == "-1.23");
+    assert(from_bid64(0x7800000000000000ULL, value) && value.is_inf() && !value.is_negative());
+    assert(from_bid64(0xF800000000000000ULL, value) && value.is_inf() && value.is_negative());
+    assert(!from_bid64(0x7C00000000000000ULL, value));
+    // non-canonical: coefficient over 10^16 - 1
+    assert(from_bid64(0x6FFFFFFFFFFFFFFFULL, value) && value.is_zero());
+    // the same value with another cohort member (1.0 = 10 * 10^-1)
+    assert(from_bid64(0x31A000000000000AULL, value) && value == 1);
+
+    // what does not fit fails rather than rounds
+    assert(!to_bid64(Currency(significand_t(12345678901234567)), bits));
+    assert(!to_bid64(Currency(1, -399), bits));
+    assert(to_bid64(Currency(1, 370), bits));   // padded to 10 * 10^369
+    assert(from_bid64(bits, value) && value == Currency(1, 370));
+    assert(!to_bid64(Currency(1, 400), bits));
+
+    // decimal128
+    bid128_t wide;
+    assert(to_bid128(Currency(1), wide));
+    assert(uint64_t(wide >> 64) == 0x3040000000000000ULL && uint64_t(wide) == 1);
+    assert(to_bid128(Currency(max_significand, -20), wide));
+    assert(from_bid128(wide, value) && value == Currency(max_significand, -20));
+    assert(to_bid128(Currency("-0.000001"), wide) && from_bid128(wide, value));
+    assert(value == "-0.000001");
+    assert(!to_bid128(Currency(1, -7000), wide));
+
+    // 34 digits: too wide for Currency but not for WideDecimal
+    WideDecimal big(WideDecimal::pow10(34) - 1, -4);
+    bool negative = true;
+    assert(to_bid128(big, negative, wide));
+    assert(!from_bid128(wide, value));
+    WideDecimal back;
+    assert(from_bid128(wide, back, negative) && negative);
+    assert(back.m == big.m && back.e == big.e);
+    assert(to_bid128(WideDecimal(WideDecimal::pow10(36), 0), false, wide));
+    assert(from_bid128(wide, value) && value == Currency(1, 36));
+
+    // batches
+    Currency values[5] = { Currency("12.5"), Currency(1, 500), Currency("-3"),
+                           Currency("0.01"), Currency() };
+    uint64_t bits64[5];
+    bid128_t bits128[5];
+    std::vector<size_t> invalid;
+    assert(to_bid64(values, 5, bits64, invalid) == 1);
+    assert(invalid.size() == 1 && invalid[0] == 1 && bits64[1] == bid64_nan);
+    Currency decoded[5];
+    invalid.clear();
+    assert(from_bid64(bits64, 5, decoded, invalid) == 1);
+    assert(decoded[0] == "12.5" && decoded[2] == -3 && decoded[3] == "0.01");
+    assert(decoded[1].is_zero() && decoded[4].is_zero());
+    invalid.clear();
+    assert(to_bid128(values, 5, bits128, invalid) == 0);
+    assert(from_bid128(bits128, 5, decoded, invalid) == 0);
+    for (size_t i = 0; i < 5; ++i)
+        assert(decoded[i] == values[i]);
+
+    puts("bid_unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
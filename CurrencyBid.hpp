@@ -0,0 +1,296 @@
+// CurrencyBid.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "WideDecimal.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+void bid_unittest();
+
+//////////////////////////////////////////////////////////////////////////////
+// IEEE 754-2008 decimal64 / decimal128 in the binary integer (BID) encoding
+//
+// decimal64:  sign(1) | exponent(10, bias 398)  | coefficient(53 bits)
+//             sign(1) | 11 | exponent(10) | coefficient(51 bits) + 2^53
+//             up to 16 digits, exponents -398 to 369
+// decimal128: sign(1) | exponent(14, bias 6176) | coefficient(113 bits)
+//             up to 34 digits, exponents -6176 to 6111
+// The top bits 11110 mark an infinity and 11111 a NaN. A coefficient over
+// the maximum is non-canonical and reads as zero.
+//
+// The conversions are exact: encoding fails rather than round, and
+// decoding a decimal128 fails when it does not fit into a Currency.
+
+typedef unsigned __int128 bid128_t;
+
+struct BidFormat
+{
+    int bias;
+    int max_exponent;       // of the coefficient, unbiased
+    int digits;
+};
+
+static const BidFormat bid64_format = { 398, 369, 16 };
+static const BidFormat bid128_format = { 6176, 6111, 34 };
+
+// fits coefficient * 10^exponent into the format, padding the coefficient
+// with zeros if the exponent is too large. returns the biased exponent or -1.
+inline int64_t
+bid_fit(const BidFormat& format, unsigned __int128& coefficient, int64_t exponent)
+{
+    const unsigned __int128 limit = WideDecimal::pow10(format.digits);
+    if (coefficient >= limit)
+        return -1;
+    if (coefficient == 0)
+        exponent = std::max<int64_t>(std::min<int64_t>(exponent, format.max_exponent),
+                                     -format.bias);
+    while (exponent > format.max_exponent)
+    {
+        if (coefficient * 10 >= limit)
+            return -1;
+        coefficient *= 10;
+        --exponent;
+    }
+    if (exponent < -format.bias)
+        return -1;
+    return exponent + format.bias;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// decimal64
+
+// returns false if value is not exactly representable
+inline bool to_bid64(const Currency& value, uint64_t& out)
+{
+    const uint64_t sign = value.is_negative() ? uint64_t(1) << 63 : 0;
+    if (value.is_inf())
+    {
+        out = sign | 0x7800000000000000ULL;
+        return true;
+    }
+
+    unsigned __int128 coefficient = uint64_t(value.base().significand());
+    int64_t biased = bid_fit(bid64_format, coefficient, value.exp10());
+    if (biased < 0)
+        return false;
+
+    const uint64_t c = uint64_t(coefficient);
+    if (c < (uint64_t(1) << 53))
+        out = sign | uint64_t(biased) << 53 | c;
+    else
+        out = sign | 0x6000000000000000ULL | uint64_t(biased) << 51 |
+              (c & ((uint64_t(1) << 51) - 1));
+    return true;
+}
+
+// returns false for a NaN
+inline bool from_bid64(uint64_t bits, Currency& out)
+{
+    const bool negative = (bits >> 63) != 0;
+    if (((bits >> 59) & 0xF) == 0xF)
+    {
+        if (((bits >> 58) & 1) != 0)
+            return false;   // NaN
+        out.set_inf(negative);
+        return true;
+    }
+
+    uint64_t coefficient;
+    int biased;
+    if (((bits >> 61) & 3) == 3)
+    {
+        biased = int((bits >> 51) & 0x3FF);
+        coefficient = (bits & ((uint64_t(1) << 51) - 1)) | (uint64_t(1) << 53);
+    }
+    else
+    {
+        biased = int((bits >> 53) & 0x3FF);
+        coefficient = bits & ((uint64_t(1) << 53) - 1);
+    }
+    if (coefficient > 9999999999999999ULL)
+        coefficient = 0;
+
+    significand_t sig = significand_t(coefficient);
+    out = Currency(negative ? -sig : sig, exp10_t(biased - bid64_format.bias));
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// decimal128
+
+// the sign, coefficient and exponent; coefficient must be below 10^34
+inline bool
+to_bid128(bool negative, unsigned __int128 coefficient, int64_t exponent, bid128_t& out)
+{
+    int64_t biased = bid_fit(bid128_format, coefficient, exponent);
+    if (biased < 0)
+        return false;
+    out = (bid128_t(negative) << 127) | (bid128_t(biased) << 113) | coefficient;
+    return true;
+}
+
+inline bool to_bid128(const Currency& value, bid128_t& out)
+{
+    if (value.is_inf())
+    {
+        out = (bid128_t(value.is_negative()) << 127) | (bid128_t(0x78) << 120);
+        return true;
+    }
+    return to_bid128(value.is_negative(), uint64_t(value.base().significand()),
+                     value.exp10(), out);
+}
+
+// the 128-bit significand variant: a WideDecimal and a sign.
+// value must not carry dropped digits (sticky).
+inline bool to_bid128(const WideDecimal& value, bool negative, bid128_t& out)
+{
+    if (value.sticky)
+        return false;
+    unsigned __int128 m = value.m;
+    int64_t e = value.e;
+    // a WideDecimal may hold up to 38 digits; drop the trailing zeros
+    while (m >= WideDecimal::pow10(bid128_format.digits) && m % 10 == 0)
+    {
+        m /= 10;
+        ++e;
+    }
+    return to_bid128(negative, m, e, out);
+}
+
+// splits bits into the sign, coefficient and exponent.
+// returns -1 for a NaN, 1 for an infinity and 0 otherwise.
+inline int
+bid128_decompose(bid128_t bits, bool& negative, unsigned __int128& coefficient,
+                 int64_t& exponent)
+{
+    const uint64_t hi = uint64_t(bits >> 64);
+    negative = (hi >> 63) != 0;
+    coefficient = 0;
+    exponent = 0;
+    if (((hi >> 59) & 0xF) == 0xF)
+        return ((hi >> 58) & 1) ? -1 : 1;
+
+    int biased;
+    if (((hi >> 61) & 3) == 3)
+    {
+        // the coefficient would be at least 2^113 > 10^34
+        biased = int((hi >> 47) & 0x3FFF);
+    }
+    else
+    {
+        biased = int((hi >> 49) & 0x3FFF);
+        coefficient = bits & ((bid128_t(1) << 113) - 1);
+        if (coefficient >= WideDecimal::pow10(bid128_format.digits))
+            coefficient = 0;
+    }
+    exponent = biased - bid128_format.bias;
+    return 0;
+}
+
+// returns false for a NaN or a value that does not fit into Currency
+inline bool from_bid128(bid128_t bits, Currency& out)
+{
+    bool negative;
+    unsigned __int128 coefficient;
+    int64_t exponent;
+    int kind = bid128_decompose(bits, negative, coefficient, exponent);
+    if (kind < 0)
+        return false;
+    if (kind > 0)
+    {
+        out.set_inf(negative);
+        return true;
+    }
+    return currency_from_exact(coefficient, negative, exp10_t(exponent), out);
+}
+
+// returns false for a NaN or an infinity
+inline bool from_bid128(bid128_t bits, WideDecimal& out, bool& negative)
+{
+    unsigned __int128 coefficient;
+    int64_t exponent;
+    if (bid128_decompose(bits, negative, coefficient, exponent) != 0)
+        return false;
+    out = WideDecimal(coefficient, exponent);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// batch conversion
+//
+// Values that cannot be converted are encoded as a quiet NaN (or decoded
+// as zero), and their indices are appended to invalid. Each returns the
+// number of such values.
+
+static const uint64_t bid64_nan = 0x7C00000000000000ULL;
+static const bid128_t bid128_nan = bid128_t(0x7C) << 120;
+
+inline size_t
+to_bid64(const Currency *values, size_t count, uint64_t *out, std::vector<size_t>& invalid)
+{
+    const size_t invalid_count = invalid.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!to_bid64(values[i], out[i]))
+        {
+            out[i] = bid64_nan;
+            invalid.push_back(i);
+        }
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline size_t
+from_bid64(const uint64_t *bits, size_t count, Currency *out, std::vector<size_t>& invalid)
+{
+    const size_t invalid_count = invalid.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!from_bid64(bits[i], out[i]))
+        {
+            out[i] = Currency();
+            invalid.push_back(i);
+        }
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline size_t
+to_bid128(const Currency *values, size_t count, bid128_t *out, std::vector<size_t>& invalid)
+{
+    const size_t invalid_count = invalid.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!to_bid128(values[i], out[i]))
+        {
+            out[i] = bid128_nan;
+            invalid.push_back(i);
+        }
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline size_t
+from_bid128(const bid128_t *bits, size_t count, Currency *out, std::vector<size_t>& invalid)
+{
+    const size_t invalid_count = invalid.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!from_bid128(bits[i], out[i]))
+        {
+            out[i] = Currency();
+            invalid.push_back(i);
+        }
+    }
+    return invalid.size() - invalid_count;
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
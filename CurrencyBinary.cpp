@@ -0,0 +1,73 @@
+// CurrencyBinary.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyBinary.hpp"
+#include <sstream>
+
+namespace khmz
+{
+
+void CurrencyBinaryReader::unittest()
+{
+    // varint / zigzag
+    assert(zigzag_encode(0) == 0);
+    assert(zigzag_encode(-1) == 1);
+    assert(zigzag_encode(1) == 2);
+    assert(zigzag_decode(zigzag_encode(max_significand)) == max_significand);
+    assert(zigzag_decode(zigzag_encode(-max_significand)) == -max_significand);
+    unsigned char buf[16];
+    uint64_t value;
+    assert(varint_encode(buf, 127) == buf + 1);
+    assert(varint_encode(buf, 300) == buf + 2);
+    assert(varint_decode(buf, buf + 2, value) == buf + 2 && value == 300);
+    assert(varint_decode(buf, buf + 1, value) == NULL);
+
+    // round trip: a sorted price series, mixed values and inf
+    CurrencyColumn column;
+    for (int i = 0; i < 1000; ++i)
+        column.push_back(Currency(1000000 + i * 3, -2));
+    column.push_back(Currency("-0.000001"));
+    column.push_back(Currency("123450000"));
+    column.push_back(Currency());
+    Currency inf;
+    inf.set_inf(true);
+    column.push_back(inf);
+
+    std::ostringstream oss;
+    {
+        CurrencyBinaryWriter writer(oss);
+        writer.write(column);
+    }
+    std::string data = oss.str();
+    assert(data.size() < column.size() * 2);
+
+    CurrencyBinaryReader reader(data.data(), data.size());
+    CurrencyColumn decoded;
+    reader.read(decoded);
+    assert(reader.eof());
+    assert(decoded.size() == column.size());
+    for (size_t i = 0; i < column.size(); ++i)
+    {
+        assert(decoded.significands()[i] == column.significands()[i]);
+        assert(decoded.exp10s()[i] == column.exp10s()[i]);
+    }
+    assert(decoded[1003].to_string() == "-inf");
+
+    // truncated stream
+    bool catched = false;
+    try
+    {
+        CurrencyBinaryReader bad(data.data(), data.size() / 2);
+        CurrencyColumn tmp;
+        bad.read(tmp);
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+
+    puts("CurrencyBinaryReader::unittest: OK.");
+}
+
+} // namespace khmz
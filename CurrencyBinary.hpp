@@ -0,0 +1,338 @@
+// CurrencyBinary.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// varint / zigzag
+
+inline uint64_t zigzag_encode(int64_t value)
+{
+    return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value)
+{
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+inline size_t varint_size(uint64_t value)
+{
+    size_t ret = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++ret;
+    }
+    return ret;
+}
+
+inline unsigned char *varint_encode(unsigned char *out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+// returns NULL on truncated or too long input
+inline const unsigned char *
+varint_decode(const unsigned char *first, const unsigned char *last, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && first != last; shift += 7)
+    {
+        unsigned char byte = *first++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return first;
+    }
+    return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Currency binary stream format (version 1)
+//
+//   header:  "KCUR" version(1 byte)
+//   block:   count(varint, 0 terminates the stream)
+//            flags(1 byte)
+//            base_exp10(zigzag varint)
+//            [exp10 - base_exp10 (varint) x count]   unless CBF_SHARED_EXP10
+//            [significand (zigzag varint) x count]   delta from the previous
+//                                                    one if CBF_DELTA
+//
+// base_exp10 is the smallest exponent of the block. With CBF_SHARED_EXP10,
+// every significand is scaled to base_exp10 and the reader normalizes it.
+
+enum CurrencyBinaryFlags
+{
+    CBF_SHARED_EXP10 = 0x01,
+    CBF_DELTA = 0x02
+};
+
+static const unsigned char currency_binary_version = 1;
+static const size_t currency_binary_block_size = 256;
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyBinaryWriter --- streaming writer; buffers at most one block
+
+class CurrencyBinaryWriter
+{
+protected:
+    std::ostream& m_os;
+    significand_t m_significands[currency_binary_block_size];
+    exp10_t m_exp10s[currency_binary_block_size];
+    size_t m_count;
+    bool m_closed;
+    std::vector<unsigned char> m_buffer;
+
+    void flush_block();
+
+public:
+    explicit CurrencyBinaryWriter(std::ostream& os);
+    ~CurrencyBinaryWriter()
+    {
+        close();
+    }
+
+    CurrencyBinaryWriter(const CurrencyBinaryWriter&) = delete;
+    CurrencyBinaryWriter& operator=(const CurrencyBinaryWriter&) = delete;
+
+    void write(significand_t significand, exp10_t exp10)
+    {
+        assert(!m_closed);
+        m_significands[m_count] = significand;
+        m_exp10s[m_count] = exp10;
+        if (++m_count == currency_binary_block_size)
+            flush_block();
+    }
+    void write(const Currency& cur)
+    {
+        write(cur.significand(), cur.exp10());
+    }
+    void write(const CurrencyColumn& column);
+
+    // writes the pending block and the terminator
+    void close();
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyBinaryReader --- decodes from memory (e.g. a MappedFile)
+
+class CurrencyBinaryReader
+{
+protected:
+    const unsigned char *m_ptr;
+    const unsigned char *m_end;
+    bool m_done;
+
+    void fail() const
+    {
+        throw std::runtime_error("CurrencyBinaryReader: corrupt stream");
+    }
+    uint64_t read_varint()
+    {
+        uint64_t value;
+        m_ptr = varint_decode(m_ptr, m_end, value);
+        if (!m_ptr)
+            fail();
+        return value;
+    }
+
+public:
+    CurrencyBinaryReader(const void *data, size_t size);
+
+    bool eof() const
+    {
+        return m_done;
+    }
+
+    // decodes the next block into the arrays; each needs room for
+    // currency_binary_block_size items. returns 0 at the end of stream.
+    size_t read_block(significand_t *significands, exp10_t *exp10s);
+
+    // decodes the rest of the stream, appending to column
+    void read(CurrencyColumn& column);
+
+    static void unittest();
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+inline CurrencyBinaryWriter::CurrencyBinaryWriter(std::ostream& os)
+    : m_os(os)
+    , m_count(0)
+    , m_closed(false)
+{
+    m_buffer.reserve(16 + currency_binary_block_size * (10 + 5));
+    const char header[5] = { 'K', 'C', 'U', 'R', char(currency_binary_version) };
+    m_os.write(header, sizeof(header));
+}
+
+inline void CurrencyBinaryWriter::flush_block()
+{
+    if (m_count == 0)
+        return;
+
+    exp10_t base = m_exp10s[0];
+    for (size_t i = 1; i < m_count; ++i)
+        base = std::min(base, m_exp10s[i]);
+
+    // try to scale all the significands to the shared exponent
+    significand_t scaled[currency_binary_block_size];
+    bool shared = true;
+    for (size_t i = 0; i < m_count && shared; ++i)
+        shared = rescale_significand(m_significands[i], m_exp10s[i], base, scaled[i]);
+    const significand_t *significands = (shared ? scaled : m_significands);
+
+    // choose delta coding only when it is smaller
+    size_t plain_size = 0, delta_size = 0;
+    uint64_t prev = 0;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        uint64_t sig = uint64_t(significands[i]);
+        plain_size += varint_size(zigzag_encode(int64_t(sig)));
+        delta_size += varint_size(zigzag_encode(int64_t(sig - prev)));
+        prev = sig;
+    }
+    bool delta = delta_size < plain_size;
+
+    unsigned char flags = 0;
+    if (shared)
+        flags |= CBF_SHARED_EXP10;
+    if (delta)
+        flags |= CBF_DELTA;
+
+    m_buffer.resize(16 + m_count * (10 + 5));
+    unsigned char *out = m_buffer.data();
+    out = varint_encode(out, m_count);
+    *out++ = flags;
+    out = varint_encode(out, zigzag_encode(base));
+    if (!shared)
+    {
+        for (size_t i = 0; i < m_count; ++i)
+            out = varint_encode(out, uint64_t(int64_t(m_exp10s[i]) - base));
+    }
+    prev = 0;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        uint64_t sig = uint64_t(significands[i]);
+        out = varint_encode(out, zigzag_encode(int64_t(delta ? sig - prev : sig)));
+        prev = sig;
+    }
+
+    m_os.write((const char *)m_buffer.data(), out - m_buffer.data());
+    m_count = 0;
+}
+
+inline void CurrencyBinaryWriter::write(const CurrencyColumn& column)
+{
+    const significand_t *significands = column.significands();
+    const exp10_t *exp10s = column.exp10s();
+    for (size_t i = 0; i < column.size(); ++i)
+        write(significands[i], exp10s[i]);
+}
+
+inline void CurrencyBinaryWriter::close()
+{
+    if (m_closed)
+        return;
+    flush_block();
+    m_os.put(0);
+    m_os.flush();
+    m_closed = true;
+}
+
+inline CurrencyBinaryReader::CurrencyBinaryReader(const void *data, size_t size)
+    : m_ptr((const unsigned char *)data)
+    , m_end((const unsigned char *)data + size)
+    , m_done(false)
+{
+    if (size < 5 || std::memcmp(m_ptr, "KCUR", 4) != 0)
+        throw std::runtime_error("CurrencyBinaryReader: not a Currency stream");
+    if (m_ptr[4] != currency_binary_version)
+        throw std::runtime_error("CurrencyBinaryReader: unsupported version");
+    m_ptr += 5;
+}
+
+inline size_t
+CurrencyBinaryReader::read_block(significand_t *significands, exp10_t *exp10s)
+{
+    if (m_done)
+        return 0;
+
+    uint64_t count = read_varint();
+    if (count == 0)
+    {
+        m_done = true;
+        return 0;
+    }
+    if (count > currency_binary_block_size || m_ptr == m_end)
+        fail();
+
+    unsigned char flags = *m_ptr++;
+    int64_t base = zigzag_decode(read_varint());
+    if (base < std::numeric_limits<exp10_t>::min() || base > max_exp10)
+        fail();
+
+    if (!(flags & CBF_SHARED_EXP10))
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint64_t diff = read_varint();
+            if (diff > uint64_t(max_exp10 - base))
+                fail();
+            exp10s[i] = exp10_t(base + int64_t(diff));
+        }
+    }
+
+    uint64_t prev = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t sig = uint64_t(zigzag_decode(read_varint()));
+        if (flags & CBF_DELTA)
+            sig += prev;
+        significands[i] = significand_t(sig);
+        prev = sig;
+    }
+
+    if (flags & CBF_SHARED_EXP10)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            exp10s[i] = exp10_t(base);
+            normalize_significand(significands[i], exp10s[i]);
+        }
+    }
+
+    return size_t(count);
+}
+
+inline void CurrencyBinaryReader::read(CurrencyColumn& column)
+{
+    size_t size = column.size();
+    for (;;)
+    {
+        column.resize(size + currency_binary_block_size);
+        size_t count = read_block(column.significands() + size,
+                                  column.exp10s() + size);
+        size += count;
+        if (count == 0)
+            break;
+    }
+    column.resize(size);
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,289 @@
+// CurrencyColumn.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// significand helpers
+
+// scales significand from exponent e10 down to exponent to_e10 (<= e10).
+// returns false on overflow.
+inline bool
+rescale_significand(significand_t significand, exp10_t e10, exp10_t to_e10,
+                    significand_t& out)
+{
+    assert(to_e10 <= e10);
+    int64_t diff = int64_t(e10) - to_e10;
+    if (diff > 18)
+    {
+        out = 0;
+        return significand == 0;
+    }
+    return !__builtin_mul_overflow(significand, significand_t(pow10_u64(int(diff))), &out);
+}
+
+// strips the trailing zeros like UnsignedCurrency::normalize
+inline void normalize_significand(significand_t& significand, exp10_t& e10)
+{
+    if (significand == 0)
+    {
+        e10 = 0;
+        return;
+    }
+    while (significand % 10 == 0)
+    {
+        significand /= 10;
+        ++e10;
+    }
+}
+
+// converts value to units of 10^scale. returns false if value is finer
+// than the scale, infinite, or too large. zero, normalized to exponent 0,
+// fits every scale.
+inline bool currency_to_units(const Currency& value, exp10_t scale, int64_t& units)
+{
+    if (value.is_inf())
+        return false;
+    if (value.is_zero())
+    {
+        units = 0;
+        return true;
+    }
+    if (value.exp10() < scale)
+        return false;
+    return rescale_significand(value.significand(), value.exp10(), scale, units);
+}
+
+// converts value to units of 10^scale in 128 bits. returns false if value
+// is finer than the scale, infinite, or too large. zero fits every scale.
+inline bool currency_to_wide_units(const Currency& value, exp10_t scale, __int128& units)
+{
+    if (value.is_inf())
+        return false;
+    units = value.significand();
+    if (units == 0)
+        return true;
+    if (value.exp10() < scale)
+        return false;
+    for (int64_t k = int64_t(value.exp10()) - scale; k > 0; k -= 19)
+    {
+        if (__builtin_mul_overflow(units, __int128(pow10_u64(int(std::min<int64_t>(k, 19)))),
+                                   &units))
+            return false;
+    }
+    return true;
+}
+
+// converts a wide sum of units of 10^e10 to Currency. the lowest digits
+// are truncated if it does not fit, like UnsignedCurrency::operator*=.
+inline Currency currency_from_wide(__int128 units, exp10_t e10)
+{
+    const __int128 max = max_significand;
+    while (units > max || units < -max)
+    {
+        units /= 10;
+        if (__builtin_add_overflow(e10, 1, &e10))
+        {
+            KHMZ_COUNT(CC_SATURATE_INF);
+            Currency inf;
+            inf.set_inf(units < 0);
+            return inf;
+        }
+    }
+    return Currency(significand_t(units), e10);
+}
+
+// converts a magnitude of units of 10^e10 to Currency. only trailing zeros
+// may be dropped; returns false if it does not fit.
+inline bool
+currency_from_exact(unsigned __int128 units, bool negative, exp10_t e10, Currency& out)
+{
+    while (units > (unsigned __int128)max_significand)
+    {
+        if (units % 10 != 0 || __builtin_add_overflow(e10, 1, &e10))
+            return false;
+        units /= 10;
+    }
+    significand_t sig = significand_t(units);
+    out = Currency(negative ? -sig : sig, e10);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// comparison operators for the bulk kernels
+
+enum CompareOp
+{
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE
+};
+
+// applies op to the result of a three-way comparison
+inline bool compare_result(CompareOp op, int cmp)
+{
+    switch (op)
+    {
+    case CMP_EQ: return cmp == 0;
+    case CMP_NE: return cmp != 0;
+    case CMP_LT: return cmp < 0;
+    case CMP_LE: return cmp <= 0;
+    case CMP_GT: return cmp > 0;
+    case CMP_GE: return cmp >= 0;
+    }
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// parallel_for
+
+// calls fn(thread, i) for i in [0, count) on up to threads threads (0 for
+// the hardware concurrency), handing out the indices one at a time. the
+// first exception thrown by fn is rethrown after all threads have joined.
+template <typename Fn>
+inline void parallel_for(size_t count, unsigned int threads, Fn fn)
+{
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    threads = unsigned(std::min<size_t>(threads, count));
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            fn(0U, i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> errors(threads);
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            try
+            {
+                for (size_t i; (i = next.fetch_add(1)) < count; )
+                    fn(t, i);
+            }
+            catch (...)
+            {
+                errors[t] = std::current_exception();
+            }
+        });
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    for (size_t t = 0; t < errors.size(); ++t)
+    {
+        if (errors[t])
+            std::rethrow_exception(errors[t]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyColumn
+//
+// A columnar (structure-of-arrays) store of Currency values.
+// Each row keeps a signed significand and an exponent in two flat arrays.
+
+class CurrencyColumn
+{
+protected:
+    std::vector<significand_t> m_significands;
+    std::vector<exp10_t> m_exp10s;
+
+public:
+    CurrencyColumn()
+    {
+    }
+
+    size_t size() const
+    {
+        return m_significands.size();
+    }
+    bool empty() const
+    {
+        return m_significands.empty();
+    }
+    void reserve(size_t count)
+    {
+        m_significands.reserve(count);
+        m_exp10s.reserve(count);
+    }
+    void resize(size_t count)
+    {
+        m_significands.resize(count);
+        m_exp10s.resize(count);
+    }
+    void clear()
+    {
+        m_significands.clear();
+        m_exp10s.clear();
+    }
+
+    void push_back(const Currency& cur)
+    {
+        m_significands.push_back(cur.significand());
+        m_exp10s.push_back(cur.exp10());
+    }
+    void push_back(significand_t significand, exp10_t exp10)
+    {
+        m_significands.push_back(significand);
+        m_exp10s.push_back(exp10);
+    }
+
+    void set(size_t index, const Currency& cur)
+    {
+        assert(index < size());
+        m_significands[index] = cur.significand();
+        m_exp10s[index] = cur.exp10();
+    }
+
+    Currency operator[](size_t index) const
+    {
+        assert(index < size());
+        return Currency(m_significands[index], m_exp10s[index]);
+    }
+
+    void append(const CurrencyColumn& another)
+    {
+        m_significands.insert(m_significands.end(),
+                              another.m_significands.begin(),
+                              another.m_significands.end());
+        m_exp10s.insert(m_exp10s.end(),
+                        another.m_exp10s.begin(), another.m_exp10s.end());
+    }
+
+    significand_t *significands()
+    {
+        return m_significands.data();
+    }
+    const significand_t *significands() const
+    {
+        return m_significands.data();
+    }
+    exp10_t *exp10s()
+    {
+        return m_exp10s.data();
+    }
+    const exp10_t *exp10s() const
+    {
+        return m_exp10s.data();
+    }
+};
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,62 @@
+// CurrencyCounters.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Currency.hpp"
+#include <thread>
+
+namespace khmz
+{
+
+void CurrencyCounters::unittest()
+{
+    currency_counters_reset();
+
+    Currency a("1.5"), b("2.25");
+    bool less = a < b;
+    assert(less);
+    a += b;
+    a -= Currency("0.125");
+    UnsignedCurrency big(max_significand);
+    big *= UnsignedCurrency(3);
+    Currency c("1.00000000000000000000001");
+    Currency d(3);
+    d.invert();
+
+    std::thread worker([]() {
+        Currency x("1.5");
+        x += Currency("2.25");
+    });
+    worker.join();
+
+    CurrencyCounters counters = currency_counters_snapshot();
+    if (currency_counters_enabled())
+    {
+        assert(counters[CC_COMPARE_ALIGN] >= 1);
+        assert(counters[CC_ADD_ALIGN] >= 2);
+        assert(counters[CC_SUB_ALIGN] >= 1);
+        assert(counters[CC_MUL_TRUNCATE] >= 1);
+        assert(counters[CC_PARSE_TRUNCATE] >= 1);
+        assert(counters[CC_INVERT_DOUBLE] >= 1);
+
+        currency_counters_reset();
+        assert(currency_counters_snapshot()[CC_ADD_ALIGN] == 0);
+    }
+    else
+    {
+        for (int i = 0; i < CC_COUNT; ++i)
+            assert(counters.counts[i] == 0);
+    }
+
+    std::string text = counters.to_text();
+    assert(text.find("compare_align ") == 0);
+    assert(text.find("\nadd_align ") != std::string::npos);
+    std::string json = counters.to_json();
+    assert(json.find("{\"compare_align\":") == 0);
+    assert(json[json.size() - 1] == '}');
+
+    puts("CurrencyCounters::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
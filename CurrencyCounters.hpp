@@ -0,0 +1,214 @@
+// CurrencyCounters.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#ifdef KHMZ_CURRENCY_COUNTERS
+    #include <algorithm>
+    #include <atomic>
+    #include <mutex>
+    #include <vector>
+#endif
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// slow-path counters
+//
+// Counts how often Currency takes its slower paths. The counters exist
+// only when KHMZ_CURRENCY_COUNTERS is defined; otherwise KHMZ_COUNT() is
+// empty and snapshots are all zero. Each thread bumps its own counters with
+// relaxed loads and stores (no locked instructions); a snapshot adds up the
+// live threads and those that have exited.
+
+enum CurrencyCounter
+{
+    CC_COMPARE_ALIGN,       // compare() with different exponents
+    CC_ADD_ALIGN,           // operator+= with different exponents or overflow
+    CC_SUB_ALIGN,           // operator-= with different exponents
+    CC_MUL_TRUNCATE,        // digits dropped by operator*=
+    CC_PARSE_TRUNCATE,      // digits dropped by parse
+    CC_SATURATE_INF,        // results saturated to inf
+    CC_INVERT_DOUBLE,       // invert() through double
+    CC_COUNT
+};
+
+inline const char *currency_counter_name(CurrencyCounter counter)
+{
+    static const char *const s_names[CC_COUNT] =
+    {
+        "compare_align",
+        "add_align",
+        "sub_align",
+        "mul_truncate",
+        "parse_truncate",
+        "saturate_inf",
+        "invert_double"
+    };
+    return s_names[counter];
+}
+
+struct CurrencyCounters
+{
+    uint64_t counts[CC_COUNT];
+
+    CurrencyCounters()
+    {
+        for (int i = 0; i < CC_COUNT; ++i)
+            counts[i] = 0;
+    }
+
+    uint64_t operator[](CurrencyCounter counter) const
+    {
+        return counts[counter];
+    }
+
+    // "name count" lines
+    std::string to_text() const
+    {
+        std::string ret;
+        for (int i = 0; i < CC_COUNT; ++i)
+        {
+            ret += currency_counter_name(CurrencyCounter(i));
+            ret += ' ';
+            ret += std::to_string(counts[i]);
+            ret += '\n';
+        }
+        return ret;
+    }
+
+    // {"name":count,...}
+    std::string to_json() const
+    {
+        std::string ret("{");
+        for (int i = 0; i < CC_COUNT; ++i)
+        {
+            if (i)
+                ret += ',';
+            ret += '"';
+            ret += currency_counter_name(CurrencyCounter(i));
+            ret += "\":";
+            ret += std::to_string(counts[i]);
+        }
+        ret += '}';
+        return ret;
+    }
+
+    static void unittest();
+};
+
+#ifdef KHMZ_CURRENCY_COUNTERS
+
+struct CurrencyCounterBlock;
+
+// the registry of the live threads' counters
+struct CurrencyCounterRegistry
+{
+    std::mutex mutex;
+    std::vector<CurrencyCounterBlock *> blocks;
+    CurrencyCounters retired;   // counts of exited threads
+
+    static CurrencyCounterRegistry& instance()
+    {
+        static CurrencyCounterRegistry s_registry;
+        return s_registry;
+    }
+};
+
+struct CurrencyCounterBlock
+{
+    std::atomic<uint64_t> counts[CC_COUNT];
+
+    CurrencyCounterBlock()
+    {
+        for (int i = 0; i < CC_COUNT; ++i)
+            counts[i].store(0, std::memory_order_relaxed);
+        CurrencyCounterRegistry& registry = CurrencyCounterRegistry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.blocks.push_back(this);
+    }
+    ~CurrencyCounterBlock()
+    {
+        CurrencyCounterRegistry& registry = CurrencyCounterRegistry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (int i = 0; i < CC_COUNT; ++i)
+            registry.retired.counts[i] += counts[i].load(std::memory_order_relaxed);
+        registry.blocks.erase(std::find(registry.blocks.begin(),
+                                        registry.blocks.end(), this));
+    }
+
+    static CurrencyCounterBlock& local()
+    {
+        static thread_local CurrencyCounterBlock s_block;
+        return s_block;
+    }
+
+    // only the owner thread writes, so no read-modify-write is needed
+    void count(CurrencyCounter counter, uint64_t n)
+    {
+        std::atomic<uint64_t>& c = counts[counter];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+inline CurrencyCounters currency_counters_snapshot()
+{
+    CurrencyCounterRegistry& registry = CurrencyCounterRegistry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    CurrencyCounters ret = registry.retired;
+    for (size_t i = 0; i < registry.blocks.size(); ++i)
+    {
+        for (int j = 0; j < CC_COUNT; ++j)
+            ret.counts[j] += registry.blocks[i]->counts[j].load(std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+// counts made by other threads while resetting may survive the reset
+inline void currency_counters_reset()
+{
+    CurrencyCounterRegistry& registry = CurrencyCounterRegistry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.retired = CurrencyCounters();
+    for (size_t i = 0; i < registry.blocks.size(); ++i)
+    {
+        for (int j = 0; j < CC_COUNT; ++j)
+            registry.blocks[i]->counts[j].store(0, std::memory_order_relaxed);
+    }
+}
+
+inline bool currency_counters_enabled()
+{
+    return true;
+}
+
+    #define KHMZ_COUNT(counter) \
+        khmz::CurrencyCounterBlock::local().count(khmz::counter, 1)
+
+#else   // !KHMZ_CURRENCY_COUNTERS
+
+inline CurrencyCounters currency_counters_snapshot()
+{
+    return CurrencyCounters();
+}
+
+inline void currency_counters_reset()
+{
+}
+
+inline bool currency_counters_enabled()
+{
+    return false;
+}
+
+    #define KHMZ_COUNT(counter) ((void)0)
+
+#endif  // !KHMZ_CURRENCY_COUNTERS
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,90 @@
+// CurrencyCsv.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyCsv.hpp"
+
+namespace khmz
+{
+
+void CsvAmountReader::unittest()
+{
+    // in-memory, single chunk
+    const char text[] =
+        "id,amount,fee\r\n"
+        "1,123.45,0.5\r\n"
+        "2,-0.01,\"1.25\"\r\n"
+        "3,abc,1\r\n"
+        "\r\n"
+        "4,1000\r\n"
+        "5,  7,-2\n";
+    std::vector<size_t> columns;
+    columns.push_back(1);
+    columns.push_back(2);
+    CsvAmountReader reader(columns, ',', true);
+    std::vector<CurrencyColumn> out;
+    std::vector<CsvError> errors;
+    reader.read(text, text + std::strlen(text), out, errors);
+    assert(out.size() == 2);
+    assert(out[0].size() == 3);
+    assert(out[1].size() == 3);
+    assert(out[0][0] == "123.45");
+    assert(out[1][0] == "0.5");
+    assert(out[0][1] == "-0.01");
+    assert(out[1][1] == "1.25");
+    assert(out[0][2] == "7");
+    assert(out[1][2] == "-2");
+    assert(errors.size() == 2);
+    assert(errors[0].line == 4);
+    assert(errors[0].column == 1);
+    assert(errors[1].line == 6);
+
+    // delimiters within quotes do not split fields
+    const char quoted[] =
+        "\"Smith, J\",12.50,\"a \"\"b,\"\" c\",1\n"
+        "\"Doe\",\"1,234.56\",2,3\n";
+    std::vector<size_t> quoted_columns;
+    quoted_columns.push_back(1);
+    quoted_columns.push_back(3);
+    CsvAmountReader quoted_reader(quoted_columns);
+    out.clear();
+    errors.clear();
+    quoted_reader.read(quoted, quoted + std::strlen(quoted), out, errors);
+    assert(out[0].size() == 1 && out[0][0] == "12.5");
+    assert(out[1].size() == 1 && out[1][0] == "1");
+    assert(errors.size() == 1 && errors[0].line == 2 && errors[0].column == 1);
+
+    // file, many chunks
+    const char *path = "CsvAmountReader_unittest.csv";
+    FILE *fp = std::fopen(path, "wb");
+    assert(fp);
+    std::fprintf(fp, "amount\n");
+    for (int i = 0; i < 10000; ++i)
+    {
+        if (i == 5000)
+            std::fprintf(fp, "1.2.x\n");
+        else
+            std::fprintf(fp, "%d.%02d\n", i, i % 100);
+    }
+    std::fclose(fp);
+
+    std::vector<size_t> first_column(1, 0);
+    CsvAmountReader file_reader(first_column, ',', true);
+    file_reader.set_threads(4);
+    file_reader.set_min_chunk_size(1000);
+    out.clear();
+    errors.clear();
+    bool opened = file_reader.read_file(path, out, errors);
+    std::remove(path);
+    assert(opened);
+    assert(out[0].size() == 9999);
+    assert(out[0][0] == "0");
+    assert(out[0][4999] == "4999.99");
+    assert(out[0][5000] == "5001.01");
+    assert(out[0][9998] == "9999.99");
+    assert(errors.size() == 1);
+    assert(errors[0].line == 5002);
+
+    puts("CsvAmountReader::unittest: OK.");
+}
+
+} // namespace khmz
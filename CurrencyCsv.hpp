@@ -0,0 +1,274 @@
+// CurrencyCsv.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "MappedFile.hpp"
+#include <vector>
+#include <thread>
+#include <functional>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// CsvError
+
+struct CsvError
+{
+    size_t line;        // 1-based line number in the input
+    size_t column;      // 0-based column index
+    std::string message;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// CsvAmountReader
+//
+// Parses selected amount columns of a CSV text straight into CurrencyColumn's.
+// The input is split into chunks on newline boundaries and the chunks are
+// parsed in parallel. A malformed row is skipped as a whole and reported
+// by its line number. A quoted field may contain the delimiter (and ""
+// for a quote), but not newlines; a quoted amount is parsed without its
+// quotes, so "1,234.56" is an invalid amount, not two fields.
+
+class CsvAmountReader
+{
+protected:
+    std::vector<size_t> m_columns;
+    char m_delimiter;
+    bool m_has_header;
+    unsigned int m_threads;
+    size_t m_min_chunk_size;
+
+    struct Chunk
+    {
+        const char *first;
+        const char *last;
+        size_t lines;
+        std::vector<CurrencyColumn> columns;
+        std::vector<CsvError> errors;
+    };
+
+    void parse_chunk(Chunk& chunk) const;
+
+public:
+    explicit CsvAmountReader(const std::vector<size_t>& columns,
+                             char delimiter = ',', bool has_header = false)
+        : m_columns(columns)
+        , m_delimiter(delimiter)
+        , m_has_header(has_header)
+        , m_threads(std::thread::hardware_concurrency())
+        , m_min_chunk_size(1024 * 1024)
+    {
+        if (m_threads == 0)
+            m_threads = 1;
+    }
+
+    void set_threads(unsigned int threads)
+    {
+        m_threads = (threads ? threads : 1);
+    }
+    void set_min_chunk_size(size_t size)
+    {
+        m_min_chunk_size = (size ? size : 1);
+    }
+
+    // out[i] receives the values of column m_columns[i]
+    void read(const char *first, const char *last,
+              std::vector<CurrencyColumn>& out,
+              std::vector<CsvError>& errors) const;
+    bool read_file(const char *path,
+                   std::vector<CurrencyColumn>& out,
+                   std::vector<CsvError>& errors) const;
+
+    static void unittest();
+};
+
+inline void CsvAmountReader::parse_chunk(Chunk& chunk) const
+{
+    size_t max_column = 0;
+    for (size_t i = 0; i < m_columns.size(); ++i)
+        max_column = std::max(max_column, m_columns[i]);
+
+    // slots[column] is the index into m_columns, or -1 when not selected
+    std::vector<int> slots(max_column + 1, -1);
+    for (size_t i = 0; i < m_columns.size(); ++i)
+        slots[m_columns[i]] = int(i);
+
+    chunk.columns.assign(m_columns.size(), CurrencyColumn());
+    std::vector<Currency> row(m_columns.size());
+    chunk.lines = 0;
+
+    const char *line = chunk.first;
+    while (line != chunk.last)
+    {
+        const char *eol = (const char *)std::memchr(line, '\n', chunk.last - line);
+        if (!eol)
+            eol = chunk.last;
+        const char *next = (eol == chunk.last ? eol : eol + 1);
+        ++chunk.lines;
+
+        const char *end = eol;
+        if (end != line && end[-1] == '\r')
+            --end;
+
+        if (end == line)
+        {
+            line = next;
+            continue;   // empty line
+        }
+
+        size_t found = 0;
+        const char *field = line;
+        bool ok = true;
+        for (size_t column = 0; column <= max_column; ++column)
+        {
+            const char *field_end = field;
+            if (field != end && *field == '"')
+            {
+                // to the closing quote; "" is a quote within the field
+                for (++field_end; field_end != end; ++field_end)
+                {
+                    if (*field_end != '"')
+                        continue;
+                    if (field_end + 1 == end || field_end[1] != '"')
+                    {
+                        ++field_end;
+                        break;
+                    }
+                    ++field_end;
+                }
+            }
+            while (field_end != end && *field_end != m_delimiter)
+                ++field_end;
+
+            int slot = slots[column];
+            if (slot >= 0)
+            {
+                const char *a = field, *b = field_end;
+                if (b - a >= 2 && *a == '"' && b[-1] == '"')
+                {
+                    ++a;
+                    --b;
+                }
+                if (a == b || !row[slot].try_parse(a, b))
+                {
+                    CsvError error = { chunk.lines, column, "invalid amount" };
+                    chunk.errors.push_back(error);
+                    ok = false;
+                    break;
+                }
+                ++found;
+            }
+
+            if (field_end == end)
+                break;
+            field = field_end + 1;
+        }
+
+        if (ok && found != m_columns.size())
+        {
+            CsvError error = { chunk.lines, max_column, "missing column" };
+            chunk.errors.push_back(error);
+            ok = false;
+        }
+
+        if (ok)
+        {
+            for (size_t i = 0; i < row.size(); ++i)
+                chunk.columns[i].push_back(row[i]);
+        }
+
+        line = next;
+    }
+}
+
+inline void
+CsvAmountReader::read(const char *first, const char *last,
+                      std::vector<CurrencyColumn>& out,
+                      std::vector<CsvError>& errors) const
+{
+    out.assign(m_columns.size(), CurrencyColumn());
+    if (m_columns.empty())
+        return;
+
+    size_t line_base = 0;
+    if (m_has_header && first != last)
+    {
+        const char *eol = (const char *)std::memchr(first, '\n', last - first);
+        first = (eol ? eol + 1 : last);
+        line_base = 1;
+    }
+
+    // split on newline boundaries
+    size_t total = size_t(last - first);
+    size_t count = std::min<size_t>(m_threads, total / m_min_chunk_size + 1);
+    std::vector<Chunk> chunks(count);
+    const char *begin = first;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char *end = (i + 1 == count) ? last : first + total / count * (i + 1);
+        if (end < begin)
+            end = begin;
+        if (end != last)
+        {
+            const char *eol = (const char *)std::memchr(end, '\n', last - end);
+            end = (eol ? eol + 1 : last);
+        }
+        chunks[i].first = begin;
+        chunks[i].last = end;
+        begin = end;
+    }
+
+    if (count == 1)
+    {
+        parse_chunk(chunks[0]);
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            threads.emplace_back(&CsvAmountReader::parse_chunk, this, std::ref(chunks[i]));
+        for (size_t i = 0; i < count; ++i)
+            threads[i].join();
+    }
+
+    size_t rows = 0;
+    for (size_t i = 0; i < count; ++i)
+        rows += chunks[i].columns[0].size();
+    for (size_t k = 0; k < out.size(); ++k)
+        out[k].reserve(rows);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Chunk& chunk = chunks[i];
+        for (size_t k = 0; k < out.size(); ++k)
+            out[k].append(chunk.columns[k]);
+        for (size_t k = 0; k < chunk.errors.size(); ++k)
+        {
+            chunk.errors[k].line += line_base;
+            errors.push_back(chunk.errors[k]);
+        }
+        line_base += chunk.lines;
+    }
+}
+
+inline bool
+CsvAmountReader::read_file(const char *path,
+                           std::vector<CurrencyColumn>& out,
+                           std::vector<CsvError>& errors) const
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+
+    read(file.data(), file.data() + file.size(), out, errors);
+    return true;
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,123 @@
+// CurrencyDivisor.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyDivisor.hpp"
+#include <random>
+
+namespace khmz
+{
+
+#ifndef NDEBUG
+
+namespace
+{
+
+// amount / divisor at scale by bitwise long division, for exponent
+// differences that keep the operands within 256 and 128 bits
+Currency long_divide(const Currency& amount, const Currency& divisor, exp10_t scale,
+                     RoundingMode mode)
+{
+    const bool negative = amount.is_negative() != divisor.is_negative();
+    UInt256 x(uint64_t(amount.base().significand()));
+    unsigned __int128 d = uint64_t(divisor.base().significand());
+    const int64_t k = int64_t(amount.exp10()) - divisor.exp10() - scale;
+    for (int64_t i = k; i > 0; i -= 19)
+        x.mul(pow10_u64(int(std::min<int64_t>(i, 19))));
+    if (k < 0)
+        d *= pow10_u64(int(-k));
+    const unsigned __int128 r = x.divide(d);
+    assert(x.hi == 0);
+    const int half_cmp = half_compare(r, d);
+    unsigned __int128 q = x.lo;
+    if (round_increment(mode, q & 1, half_cmp, r != 0, negative))
+        ++q;
+    return currency_from_wide(negative ? -__int128(q) : __int128(q), scale);
+}
+
+} // namespace
+
+#endif // NDEBUG
+
+void CurrencyDivisor::unittest()
+{
+    const CurrencyDivisor three(Currency(3));
+    assert(three.divisor() == "3");
+    assert(three.divide(Currency(10), -2) == "3.33");
+    assert(three.divide(Currency(2), -2) == "0.67");
+    assert(three.divide(Currency(2), -2, ROUND_DOWN) == "0.66");
+    assert(three.divide(Currency(-2), -2, ROUND_FLOOR) == "-0.67");
+    assert(three.divide(Currency(-2), -2, ROUND_CEILING) == "-0.66");
+    assert(three.divide(Currency("9.99"), -2) == "3.33");
+    assert(three.divide(Currency(1), 2) == "0");
+
+    const CurrencyDivisor eight(Currency(-8));
+    assert(eight.divide(Currency(1), -2) == "-0.12");
+    assert(eight.divide(Currency(1), -2, ROUND_HALF_UP) == "-0.13");
+    assert(eight.divide(Currency(-1), -3) == "0.125");
+
+    const CurrencyDivisor seven(Currency("0.07"));
+    assert(seven.divide(Currency("0.01"), -18) == "0.142857142857142857");
+    assert(seven.divide(Currency(1), 0) == "14");
+    assert(seven.divide(Currency(1, 60), 0).is_inf());
+    // 10^-40 / 0.07 is far below half a unit
+    assert(seven.divide(Currency(1, -40), -2).is_zero());
+    assert(seven.divide(Currency(1, -40), -2, ROUND_UP) == "0.01");
+    assert(seven.divide(Currency(), -2).is_zero());
+
+    // a divisor whose powers of ten overflow early: j past the table
+    const CurrencyDivisor large(Currency(significand_t(999999999999999989LL), 0));
+    assert(large.divide(Currency(5, 17), -1) == "0.5");
+    const Currency five_d(significand_t(4999999999999999945LL), -4);
+    assert(large.divide(five_d, -2).is_zero());
+    assert(large.divide(five_d, -2, ROUND_UP) == "0.01");
+
+    try
+    {
+        CurrencyDivisor zero((Currency()));
+        assert(0);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    // against long division, for all the rounding modes
+    std::mt19937_64 rng(49);
+    const RoundingMode modes[] =
+    {
+        ROUND_HALF_UP, ROUND_HALF_EVEN, ROUND_UP, ROUND_DOWN, ROUND_CEILING, ROUND_FLOOR
+    };
+    std::vector<Currency> amounts;
+    for (int i = 0; i < 2000; ++i)
+    {
+        significand_t sig = significand_t(rng() >> (1 + rng() % 63)) * ((rng() & 1) ? 1 : -1);
+        amounts.push_back(Currency(sig, -exp10_t(rng() % 7)));
+    }
+    std::vector<Currency> out(amounts.size());
+    for (int t = 0; t < 200; ++t)
+    {
+        const significand_t sig = significand_t((rng() >> (1 + rng() % 63)) | 1);
+        const Currency d(rng() & 1 ? sig : -sig, -exp10_t(rng() % 5));
+        const CurrencyDivisor divisor(d);
+        const exp10_t scale = -exp10_t(rng() % 9);
+        const RoundingMode mode = modes[rng() % 6];
+        khmz::divide(amounts.data(), amounts.size(), divisor, scale, out.data(), mode);
+        for (size_t i = 0; i < amounts.size(); ++i)
+        {
+            if (int64_t(amounts[i].exp10()) - d.exp10() - scale + 19 < 0)
+                continue;   // beyond the reference
+            assert(out[i] == long_divide(amounts[i], d, scale, mode));
+        }
+    }
+
+    CurrencyColumn column, quotients;
+    column.push_back(Currency(100));
+    column.push_back(Currency("-0.05"));
+    khmz::divide(column, three, -2, quotients);
+    assert(quotients.size() == 2 && quotients[0] == "33.33" && quotients[1] == "-0.02");
+
+    puts("CurrencyDivisor::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,181 @@
+// CurrencyDivisor.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "InvariantDivider.hpp"
+#include "WideDecimal.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyDivisor
+//
+// Exact division of many amounts by one divisor, correctly rounded to a
+// requested exponent; unlike operator/=, which multiplies by an inverse
+// computed in double, the quotient is the one long division gives.
+//
+// The divisor significand times 10^j, for each j while it fits 64 bits, is
+// precomputed as an InvariantDivider, so a division costs a multiply-high
+// and a few corrections. Results that do not fit the significand lose
+// their lowest digits like operator*=; beyond 128 bits they become inf.
+
+class CurrencyDivisor
+{
+protected:
+    significand_t m_significand;
+    exp10_t m_exp10;
+    std::vector<InvariantDivider> m_dividers;   // [j]: |significand| * 10^j
+
+public:
+    explicit CurrencyDivisor(const Currency& divisor)
+        : m_significand(divisor.significand())
+        , m_exp10(divisor.exp10())
+    {
+        if (divisor.is_zero() || divisor.is_inf())
+            throw std::runtime_error("CurrencyDivisor: invalid divisor");
+
+        uint64_t d = uint64_t(divisor.base().significand());
+        for (;;)
+        {
+            m_dividers.push_back(InvariantDivider(d));
+            if (__builtin_mul_overflow(d, 10, &d))
+                break;
+        }
+    }
+
+    Currency divisor() const
+    {
+        return Currency(m_significand, m_exp10);
+    }
+
+    // amount / divisor rounded to units of 10^scale
+    Currency divide(const Currency& amount, exp10_t scale,
+                    RoundingMode mode = ROUND_HALF_EVEN) const;
+
+    static void unittest();
+};
+
+inline Currency
+CurrencyDivisor::divide(const Currency& amount, exp10_t scale, RoundingMode mode) const
+{
+    const bool negative = amount.is_negative() != (m_significand < 0);
+    if (amount.is_inf())
+    {
+        Currency inf;
+        inf.set_inf(negative);
+        return inf;
+    }
+    if (amount.is_zero())
+        return Currency();
+
+    // q = |amount| * 10^k / |divisor| with k = amount.exp10 - exp10 - scale
+    const uint64_t n = uint64_t(amount.base().significand());
+    const int64_t k = int64_t(amount.exp10()) - m_exp10 - scale;
+    unsigned __int128 q;
+    int half_cmp;
+    bool inexact;
+    if (k <= 19 && (k >= 0 || size_t(-k) < m_dividers.size()))
+    {
+        // the usual case: one 128-by-64-bit division by invariant
+        const InvariantDivider& divider = m_dividers[(k < 0) ? size_t(-k) : 0];
+        const unsigned __int128 x = (k > 0) ? (unsigned __int128)n * pow10_u64(int(k)) : n;
+        const uint64_t d = divider.divisor();
+        uint64_t r;
+        q = divider.divide(x, r);
+        half_cmp = half_compare(r, d);
+        inexact = (r != 0);
+    }
+    else if (k > 0)
+    {
+        UInt256 x(n);
+        for (int64_t i = k; i > 0; i -= 19)
+        {
+            if (!x.mul(pow10_u64(int(std::min<int64_t>(i, 19)))))
+            {
+                Currency inf;
+                inf.set_inf(negative);
+                return inf;
+            }
+        }
+        const uint64_t d = m_dividers[0].divisor();
+        const uint64_t r = x.divide(m_dividers[0]);
+        if (x.hi)
+        {
+            Currency inf;
+            inf.set_inf(negative);
+            return inf;
+        }
+        q = x.lo;
+        half_cmp = half_compare(r, d);
+        inexact = (r != 0);
+    }
+    else
+    {
+        // |divisor| * 10^-k does not fit 64 bits: divide by |divisor|,
+        // then by 10^-k
+        uint64_t r;
+        const unsigned __int128 q1 = m_dividers[0].divide(n, r);
+        const int64_t j = -k;
+        if (j > 38)
+        {
+            q = 0;
+            half_cmp = -1;
+            inexact = true;
+        }
+        else
+        {
+            unsigned __int128 p = 1;
+            for (int64_t i = j; i > 0; i -= 19)
+                p *= pow10_u64(int(std::min<int64_t>(i, 19)));
+            q = q1 / p;
+            const unsigned __int128 rem = q1 % p;
+            if (2 * rem < p)
+                half_cmp = -1;
+            else if (2 * rem == p)
+                half_cmp = (r != 0);
+            else
+                half_cmp = 1;
+            inexact = (rem != 0 || r != 0);
+        }
+    }
+
+    if (round_increment(mode, q & 1, half_cmp, inexact, negative))
+        ++q;
+    if (q >> 127)
+    {
+        Currency inf;
+        inf.set_inf(negative);
+        return inf;
+    }
+    const __int128 units = __int128(q);
+    return currency_from_wide(negative ? -units : units, scale);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// batch division
+
+inline void
+divide(const Currency *amounts, size_t count, const CurrencyDivisor& divisor, exp10_t scale,
+       Currency *out, RoundingMode mode = ROUND_HALF_EVEN)
+{
+    for (size_t i = 0; i < count; ++i)
+        out[i] = divisor.divide(amounts[i], scale, mode);
+}
+
+inline void
+divide(const CurrencyColumn& amounts, const CurrencyDivisor& divisor, exp10_t scale,
+       CurrencyColumn& out, RoundingMode mode = ROUND_HALF_EVEN)
+{
+    out.resize(amounts.size());
+    for (size_t i = 0; i < amounts.size(); ++i)
+        out.set(i, divisor.divide(amounts[i], scale, mode));
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
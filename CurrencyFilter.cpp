@@ -0,0 +1,215 @@
+// CurrencyFilter.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyFilter.hpp"
+#include <random>
+
+namespace khmz
+{
+
+namespace
+{
+
+// amounts mostly in cents, with runs of one exponent, some mixed blocks
+// and some far outside the precomputed exponents
+CurrencyColumn make_filter_column(uint64_t seed, size_t count)
+{
+    std::mt19937_64 rng(seed);
+    CurrencyColumn ret;
+    for (size_t i = 0; i < count; ++i)
+    {
+        significand_t sig = significand_t(rng() % 20001) - 10000;
+        exp10_t e10 = -2;
+        if ((i / 64) % 3 == 1)
+            e10 = -exp10_t(rng() % 5);
+        if (rng() % 1000 == 0)
+            e10 = (rng() & 1) ? 40 : -40;
+        if (rng() % 1000 == 0)
+            sig = (rng() & 1) ? max_significand : -max_significand;
+        ret.push_back(sig, e10);
+    }
+    return ret;
+}
+
+} // namespace
+
+void ColumnPredicate::unittest()
+{
+    int64_t units;
+    assert(floor_units(Currency("1.25"), -2, units) && units == 125);
+    assert(!floor_units(Currency("1.25"), -1, units) && units == 12);
+    assert(!floor_units(Currency("-1.25"), -1, units) && units == -13);
+    assert(!floor_units(Currency(1, 30), -2, units) && units == max_significand);
+    assert(ceil_units_minus_one(Currency("1.25"), -1) == 12);
+    assert(ceil_units_minus_one(Currency("1.2"), -1) == 11);
+
+    CurrencyColumn column;
+    const char *values[] = { "0.5", "1", "1.00", "1.5", "-2", "100.01" };
+    for (int i = 0; i < 6; ++i)
+        column.push_back(Currency(values[i]));
+    column.push_back(Currency(1, -40));
+    column.push_back(Currency(7, 35));
+    std::vector<uint64_t> selection;
+    assert(filter(column, ColumnPredicate(CMP_GT, Currency(1)), selection) == 3);
+    assert(selection.size() == 1 && selection[0] == 0xA8);
+    assert(filter(column, ColumnPredicate(CMP_EQ, Currency("1.0")), selection) == 2);
+    assert(filter(column, ColumnPredicate(CMP_NE, Currency("1.0")), selection) == 6);
+    assert(filter(column, ColumnPredicate(CMP_EQ, Currency("1.001")), selection) == 0);
+    assert(filter(column, ColumnPredicate(CMP_LT, Currency("0.5")), selection) == 2);
+    assert(filter(column, ColumnPredicate(CMP_GE, Currency("0.5")), selection) == 6);
+    assert(filter(column, ColumnPredicate::between(Currency(0), Currency("1.5")),
+                  selection) == 5);
+    assert(filter(column, ColumnPredicate::between(Currency(1), Currency(2)), selection) == 3);
+    assert(masked_sum(column, selection, -2) == "3.5");
+    filter(column, ColumnPredicate(CMP_GT, Currency(100)), selection);
+    try
+    {
+        masked_sum(column, selection, 0);
+        assert(0);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    // whole ranges of significands
+    const ColumnPredicate above(CMP_GT, Currency(1));
+    assert(above.test_range(-2, 101, 500) == 1);
+    assert(above.test_range(-2, -500, 100) == -1);
+    assert(above.test_range(-2, 100, 101) == 0);
+    assert(above.test_range(-40, 1, 2) == 0);
+    const ColumnPredicate other(CMP_NE, Currency(1));
+    assert(other.test_range(0, 2, 9) == 1 && other.test_range(0, 1, 1) == -1);
+    assert(other.test_range(0, 0, 2) == 0);
+
+    // all the operators against Currency::compare, with exact and inexact
+    // operands at every exponent
+    column = make_filter_column(48, 100000);
+    const Currency operands[] =
+    {
+        Currency(0), Currency("12.34"), Currency("-0.005"), Currency(99), Currency(1, 20),
+        Currency(-1, -20), Currency("0.12345")
+    };
+    const CompareOp ops[] = { CMP_EQ, CMP_NE, CMP_LT, CMP_LE, CMP_GT, CMP_GE };
+    for (int k = 0; k < 7; ++k)
+    {
+        const Currency& operand = operands[k];
+        for (int o = 0; o < 7; ++o)
+        {
+            const ColumnPredicate predicate =
+                (o == 6) ? ColumnPredicate::between(-operand, operand + Currency(1))
+                         : ColumnPredicate(ops[o], operand);
+            const size_t count = filter(column, predicate, selection);
+            size_t expected = 0;
+            __int128 sum = 0;
+            for (size_t i = 0; i < column.size(); ++i)
+            {
+                const Currency value = column[i];
+                bool hit = (o == 6) ? (-operand <= value && value <= operand + Currency(1))
+                                    : compare_result(ops[o], value.compare(operand));
+                assert(hit == predicate.test(value));
+                assert(hit == ((selection[i / 64] >> (i % 64)) & 1));
+                expected += hit;
+            }
+            assert(count == expected);
+
+            // the sum of the ordinary rows among the selected
+            for (size_t i = 0; i < column.size(); ++i)
+            {
+                const exp10_t e10 = column.exp10s()[i];
+                const significand_t sig = column.significands()[i];
+                if (e10 > 0 || e10 < -4 || sig == max_significand || sig == -max_significand)
+                    selection[i / 64] &= ~(uint64_t(1) << (i % 64));
+                else if ((selection[i / 64] >> (i % 64)) & 1)
+                    sum += __int128(sig) * int64_t(pow10_u64(e10 + 4));
+            }
+            assert(masked_sum_units(column, selection, -4) == sum);
+        }
+    }
+
+    puts("ColumnPredicate::unittest: OK.");
+}
+
+void CurrencyHistogram::unittest()
+{
+    const Currency edges[] = { Currency(-100), Currency(0), Currency("0.5"), Currency(100) };
+    CurrencyHistogram histogram(edges, 4);
+    assert(histogram.buckets() == 5);
+
+    CurrencyColumn column;
+    const char *values[] = { "-1000", "-100", "-0.01", "0", "0.49", "0.5", "99.99", "100" };
+    for (int i = 0; i < 8; ++i)
+        column.push_back(Currency(values[i]));
+    column.push_back(Currency(1, 30));
+    column.push_back(Currency("0.001"));
+    std::vector<size_t> invalid;
+    assert(histogram.add(column, invalid) == 1 && invalid[0] == 9);
+    const uint64_t counts[] = { 1, 2, 2, 2, 2 };
+    CurrencyHistogram hundreds(edges, 4, 2);
+    CurrencyColumn zeros;
+    zeros.push_back(Currency());
+    zeros.push_back(Currency(200));
+    assert(hundreds.add(zeros, invalid) == 0);
+    assert(hundreds.count(2) == 1 && hundreds.count(4) == 1 && hundreds.sum(4) == "200");
+    std::vector<uint64_t> all(1, 3);
+    assert(masked_sum(zeros, all, 2) == "200");
+    invalid.clear();
+    const Currency sums[] =
+    {
+        Currency(-1000), Currency("-100.01"), Currency("0.49"), Currency("100.49"), Currency(1, 30)
+    };
+    for (size_t b = 0; b < 5; ++b)
+        assert(histogram.count(b) == counts[b] && histogram.sum(b) == sums[b]);
+
+    const Currency unordered[] = { Currency(1), Currency(1) };
+    try
+    {
+        CurrencyHistogram bad(unordered, 2);
+        assert(0);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    // few and many edges against std::upper_bound, merged from two halves
+    column = make_filter_column(4848, 50000);
+    for (int many = 0; many < 2; ++many)
+    {
+        std::vector<Currency> e;
+        for (int k = 0; k < (many ? 40 : 7); ++k)
+            e.push_back(Currency(significand_t(k * 37 - 120), -1) + Currency("0.001"));
+        CurrencyHistogram whole(e.data(), e.size(), -6), half(e.data(), e.size(), -6);
+        invalid.clear();
+        whole.add(column, invalid);
+        std::vector<uint64_t> expected(e.size() + 1, 0);
+        size_t skipped = 0;
+        for (size_t i = 0; i < column.size(); ++i)
+        {
+            __int128 units;
+            if (!currency_to_wide_units(column[i], -6, units))
+            {
+                ++skipped;
+                continue;
+            }
+            ++expected[size_t(std::upper_bound(e.begin(), e.end(), column[i]) - e.begin())];
+        }
+        assert(invalid.size() == skipped);
+        for (size_t b = 0; b < expected.size(); ++b)
+            assert(whole.count(b) == expected[b]);
+
+        CurrencyColumn first, second;
+        for (size_t i = 0; i < column.size(); ++i)
+            (i % 2 ? first : second).push_back(column[i]);
+        CurrencyHistogram other(e.data(), e.size(), -6);
+        half.add(first, invalid);
+        other.add(second, invalid);
+        half.merge(other);
+        for (size_t b = 0; b < expected.size(); ++b)
+            assert(half.count(b) == expected[b] && half.sum_units(b) == whole.sum_units(b));
+    }
+
+    puts("CurrencyHistogram::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,445 @@
+// CurrencyFilter.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// thresholds in units of a column's exponents
+
+// the exponents with precomputed thresholds; rows with others are compared
+// as Currency
+static const exp10_t filter_min_exp10 = -32;
+static const exp10_t filter_exp10_count = 64;
+
+// floor(value / 10^e10), saturated to the int64_t range; true if exact.
+// since |significand| <= max_significand, a saturated floor still orders
+// every significand correctly against value.
+inline bool floor_units(const Currency& value, exp10_t e10, int64_t& units)
+{
+    const int64_t max = std::numeric_limits<int64_t>::max();
+    if (value.is_inf())
+    {
+        units = value.is_negative() ? -max - 1 : max;
+        return false;
+    }
+    const significand_t sig = value.significand();
+    const int64_t diff = int64_t(value.exp10()) - e10;
+    if (diff >= 0)
+    {
+        if (rescale_significand(sig, value.exp10(), e10, units))
+            return true;
+        units = (sig < 0) ? -max - 1 : max;
+        return false;
+    }
+    if (diff <= -19)
+    {
+        units = (sig < 0) ? -1 : 0;
+        return sig == 0;
+    }
+    const significand_t p = significand_t(pow10_u64(int(-diff)));
+    units = sig / p;
+    if (sig % p == 0)
+        return true;
+    if (sig < 0)
+        --units;
+    return false;
+}
+
+// the significands s with s * 10^e10 >= value are those with s > the
+// returned threshold
+inline int64_t ceil_units_minus_one(const Currency& value, exp10_t e10)
+{
+    int64_t units;
+    return floor_units(value, e10, units) ? units - 1 : units;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ColumnPredicate
+//
+// A comparison with a constant (value op operand) or a closed range, for
+// the rows of CurrencyColumn. The operands are converted once into integer
+// ranges of significands for each exponent, so a row costs one subtraction
+// and one unsigned compare; a block of 64 rows with one exponent, the usual
+// case for amounts of one currency, runs as a tight loop the compiler
+// vectorizes. Rows with other exponents fall back to Currency::compare.
+
+class ColumnPredicate
+{
+protected:
+    // (uint64_t)(s - lo) <= width, negated if invert; never true if none
+    struct Range
+    {
+        int64_t lo;
+        uint64_t width;
+        bool none;
+        bool invert;
+    };
+
+    Range m_ranges[filter_exp10_count];
+    CompareOp m_op;
+    Currency m_low;
+    Currency m_high;
+    bool m_between;
+
+    static Range make_range(int64_t lo, int64_t hi, bool invert)
+    {
+        Range ret;
+        ret.lo = lo;
+        ret.width = uint64_t(hi) - uint64_t(lo);
+        ret.none = lo > hi;
+        ret.invert = invert;
+        return ret;
+    }
+
+    void init();
+
+public:
+    ColumnPredicate(CompareOp op, const Currency& operand)
+        : m_op(op)
+        , m_low(operand)
+        , m_high(operand)
+        , m_between(false)
+    {
+        init();
+    }
+
+    // low <= value && value <= high
+    static ColumnPredicate between(const Currency& low, const Currency& high)
+    {
+        ColumnPredicate ret(CMP_GE, low);
+        ret.m_high = high;
+        ret.m_between = true;
+        ret.init();
+        return ret;
+    }
+
+    bool test(const Currency& value) const
+    {
+        if (m_between)
+            return value.compare(m_low) >= 0 && value.compare(m_high) <= 0;
+        return compare_result(m_op, value.compare(m_low));
+    }
+
+    bool test(significand_t significand, exp10_t e10) const
+    {
+        const uint32_t index = uint32_t(e10 - filter_min_exp10);
+        if (index >= uint32_t(filter_exp10_count))
+            return test(Currency(significand, e10));
+        const Range& r = m_ranges[index];
+        return ((uint64_t(significand) - uint64_t(r.lo) <= r.width) && !r.none) != r.invert;
+    }
+
+    // the bits (LSB first) of n <= 64 rows that share the exponent e10
+    uint64_t test_block(const significand_t *significands, exp10_t e10, size_t n) const;
+
+    // for rows of exponent e10 with significands in [min, max]: 1 if the
+    // predicate holds for all, -1 if for none, 0 if it may differ
+    int test_range(exp10_t e10, int64_t min, int64_t max) const
+    {
+        const uint32_t index = uint32_t(e10 - filter_min_exp10);
+        if (index >= uint32_t(filter_exp10_count))
+            return 0;
+        const Range& r = m_ranges[index];
+        int ret;
+        if (r.none || max < r.lo || (min >= r.lo && uint64_t(min) - uint64_t(r.lo) > r.width))
+            ret = -1;
+        else if (min >= r.lo && uint64_t(max) - uint64_t(r.lo) <= r.width)
+            ret = 1;
+        else
+            ret = 0;
+        return r.invert ? -ret : ret;
+    }
+
+    static void unittest();
+};
+
+inline uint64_t
+ColumnPredicate::test_block(const significand_t *significands, exp10_t e10, size_t n) const
+{
+    const uint64_t mask = (n == 64) ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+    const uint32_t index = uint32_t(e10 - filter_min_exp10);
+    uint64_t word = 0;
+    if (index >= uint32_t(filter_exp10_count))
+    {
+        for (size_t i = 0; i < n; ++i)
+            word |= uint64_t(test(Currency(significands[i], e10))) << i;
+        return word;
+    }
+
+    const Range& r = m_ranges[index];
+    if (!r.none)
+    {
+        const uint64_t lo = uint64_t(r.lo), width = r.width;
+        for (size_t i = 0; i < n; ++i)
+            word |= uint64_t(uint64_t(significands[i]) - lo <= width) << i;
+    }
+    return r.invert ? ~word & mask : word;
+}
+
+inline void ColumnPredicate::init()
+{
+    const int64_t max = std::numeric_limits<int64_t>::max();
+    for (exp10_t i = 0; i < filter_exp10_count; ++i)
+    {
+        const exp10_t e10 = exp10_t(filter_min_exp10 + i);
+        int64_t floor_high;
+        floor_units(m_high, e10, floor_high);
+        const int64_t low = ceil_units_minus_one(m_low, e10);
+        // the least significand above low, if any
+        int64_t first;
+        const bool none_above = __builtin_add_overflow(low, 1, &first);
+        Range& r = m_ranges[i];
+
+        if (m_between)
+        {
+            r = make_range(first, floor_high, false);
+            r.none |= none_above;
+            continue;
+        }
+        switch (m_op)
+        {
+        case CMP_EQ:
+        case CMP_NE:
+            r = make_range(first, floor_high, m_op == CMP_NE);
+            r.none |= none_above;
+            break;
+        case CMP_LT:
+            r = make_range(-max - 1, low, false);
+            break;
+        case CMP_LE:
+            r = make_range(-max - 1, floor_high, false);
+            break;
+        case CMP_GT:
+        {
+            int64_t above;
+            const bool none = __builtin_add_overflow(floor_high, 1, &above);
+            r = make_range(above, max, false);
+            r.none |= none;
+            break;
+        }
+        case CMP_GE:
+            r = make_range(first, max, false);
+            r.none = none_above;
+            break;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// selection bitmaps: bit i % 64 of word i / 64 selects row i
+
+// sets selection to the rows of column for which predicate holds; returns
+// their number
+inline size_t
+filter(const CurrencyColumn& column, const ColumnPredicate& predicate,
+       std::vector<uint64_t>& selection)
+{
+    const size_t size = column.size();
+    const significand_t *significands = column.significands();
+    const exp10_t *exp10s = column.exp10s();
+    selection.assign((size + 63) / 64, 0);
+
+    size_t count = 0;
+    for (size_t w = 0; w < selection.size(); ++w)
+    {
+        const size_t first = w * 64, n = std::min<size_t>(64, size - first);
+        const significand_t *s = significands + first;
+        const exp10_t *e = exp10s + first;
+
+        // one exponent for the whole block?
+        uint32_t differ = 0;
+        for (size_t i = 0; i < n; ++i)
+            differ |= uint32_t(e[i] ^ e[0]);
+
+        uint64_t word = 0;
+        if (differ == 0)
+        {
+            word = predicate.test_block(s, e[0], n);
+        }
+        else
+        {
+            for (size_t i = 0; i < n; ++i)
+                word |= uint64_t(predicate.test(s[i], e[i])) << i;
+        }
+        selection[w] = word;
+        count += size_t(__builtin_popcountll(word));
+    }
+    return count;
+}
+
+// the exact sum of the selected rows in units of 10^scale; std::runtime_error
+// if a selected row is finer than the scale or on overflow
+inline __int128
+masked_sum_units(const CurrencyColumn& column, const std::vector<uint64_t>& selection,
+                 exp10_t scale)
+{
+    assert(selection.size() >= (column.size() + 63) / 64);
+    const significand_t *significands = column.significands();
+    const exp10_t *exp10s = column.exp10s();
+    __int128 ret = 0;
+    for (size_t w = 0; w < (column.size() + 63) / 64; ++w)
+    {
+        for (uint64_t word = selection[w]; word; word &= word - 1)
+        {
+            const size_t i = w * 64 + size_t(__builtin_ctzll(word));
+            __int128 units = significands[i];
+            if (exp10s[i] != scale &&
+                !currency_to_wide_units(Currency(significands[i], exp10s[i]), scale, units))
+                throw std::runtime_error("masked_sum: out of scale");
+            if (__builtin_add_overflow(ret, units, &ret))
+                throw std::runtime_error("masked_sum: overflow");
+        }
+    }
+    return ret;
+}
+
+inline Currency
+masked_sum(const CurrencyColumn& column, const std::vector<uint64_t>& selection, exp10_t scale)
+{
+    return currency_from_wide(masked_sum_units(column, selection, scale), scale);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyHistogram
+//
+// Counts and sums the rows of columns by bucket. count strictly increasing
+// edges make count + 1 buckets: bucket 0 holds the values below edges[0],
+// bucket b those in [edges[b - 1], edges[b]), and the last one those from
+// edges[count - 1] up. Like ColumnPredicate, the edges are converted once
+// into integer thresholds for each exponent; a row is placed by counting
+// the thresholds below its significand, or by binary search if there are
+// many. The sums are exact in units of 10^scale; rows finer than the scale
+// are skipped and reported as invalid.
+
+class CurrencyHistogram
+{
+protected:
+    std::vector<Currency> m_edges;
+    std::vector<int64_t> m_thresholds;  // filter_exp10_count rows of edges
+    exp10_t m_scale;
+    std::vector<uint64_t> m_counts;
+    std::vector<__int128> m_sums;
+
+    size_t bucket(significand_t significand, exp10_t e10) const
+    {
+        const size_t n = m_edges.size();
+        const uint32_t index = uint32_t(e10 - filter_min_exp10);
+        if (index >= uint32_t(filter_exp10_count))
+        {
+            return size_t(std::upper_bound(m_edges.begin(), m_edges.end(),
+                                           Currency(significand, e10)) - m_edges.begin());
+        }
+        const int64_t *t = &m_thresholds[index * n];
+        if (n > 16)
+            return size_t(std::lower_bound(t, t + n, significand) - t);
+        size_t ret = 0;
+        for (size_t k = 0; k < n; ++k)
+            ret += (significand > t[k]);
+        return ret;
+    }
+
+public:
+    CurrencyHistogram(const Currency *edges, size_t count, exp10_t scale = -2);
+
+    size_t buckets() const
+    {
+        return m_counts.size();
+    }
+    uint64_t count(size_t bucket) const
+    {
+        return m_counts[bucket];
+    }
+    __int128 sum_units(size_t bucket) const
+    {
+        return m_sums[bucket];
+    }
+    Currency sum(size_t bucket) const
+    {
+        return currency_from_wide(m_sums[bucket], m_scale);
+    }
+
+    // returns the number of invalid rows, whose indices are appended to
+    // invalid; std::runtime_error if a sum overflows
+    size_t add(const CurrencyColumn& column, std::vector<size_t>& invalid);
+
+    // adds the counts and sums of another with the same edges and scale
+    void merge(const CurrencyHistogram& another);
+
+    void clear()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        std::fill(m_sums.begin(), m_sums.end(), 0);
+    }
+
+    static void unittest();
+};
+
+inline
+CurrencyHistogram::CurrencyHistogram(const Currency *edges, size_t count, exp10_t scale)
+    : m_edges(edges, edges + count)
+    , m_scale(scale)
+    , m_counts(count + 1, 0)
+    , m_sums(count + 1, 0)
+{
+    for (size_t k = 0; k < count; ++k)
+    {
+        if (edges[k].is_inf() || (k > 0 && !(edges[k - 1] < edges[k])))
+            throw std::runtime_error("CurrencyHistogram: invalid edges");
+    }
+    m_thresholds.resize(size_t(filter_exp10_count) * count);
+    for (exp10_t i = 0; i < filter_exp10_count; ++i)
+    {
+        for (size_t k = 0; k < count; ++k)
+        {
+            m_thresholds[size_t(i) * count + k] =
+                ceil_units_minus_one(edges[k], exp10_t(filter_min_exp10 + i));
+        }
+    }
+}
+
+inline size_t CurrencyHistogram::add(const CurrencyColumn& column, std::vector<size_t>& invalid)
+{
+    const significand_t *significands = column.significands();
+    const exp10_t *exp10s = column.exp10s();
+    const size_t invalid_count = invalid.size();
+    for (size_t i = 0; i < column.size(); ++i)
+    {
+        __int128 units = significands[i];
+        if (exp10s[i] != m_scale &&
+            !currency_to_wide_units(Currency(significands[i], exp10s[i]), m_scale, units))
+        {
+            invalid.push_back(i);
+            continue;
+        }
+        const size_t b = bucket(significands[i], exp10s[i]);
+        ++m_counts[b];
+        if (__builtin_add_overflow(m_sums[b], units, &m_sums[b]))
+            throw std::runtime_error("CurrencyHistogram: overflow");
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline void CurrencyHistogram::merge(const CurrencyHistogram& another)
+{
+    if (another.m_scale != m_scale || another.m_edges.size() != m_edges.size() ||
+        !std::equal(m_edges.begin(), m_edges.end(), another.m_edges.begin()))
+        throw std::runtime_error("CurrencyHistogram: merging different buckets");
+    for (size_t b = 0; b < m_counts.size(); ++b)
+    {
+        m_counts[b] += another.m_counts[b];
+        if (__builtin_add_overflow(m_sums[b], another.m_sums[b], &m_sums[b]))
+            throw std::runtime_error("CurrencyHistogram: overflow");
+    }
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
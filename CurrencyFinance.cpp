@@ -0,0 +1,83 @@
+// CurrencyFinance.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyFinance.hpp"
+
+namespace khmz
+{
+
+void finance_unittest()
+{
+    assert(pow(Currency("1.1"), 2) == "1.21");
+    assert(pow(Currency(2), -1) == "0.5");
+    assert(pow(Currency(-2), 3) == -8);
+    assert(pow(Currency(-2), 2) == 4);
+    assert(pow(Currency(7), 0) == 1);
+    assert(pow(Currency(3), -1) == "0.333333333333333333");
+    assert(pow(Currency(3), -1, -2, ROUND_UP) == "0.34");
+    assert(pow(Currency("1.0001"), 10000, -6) == "2.718146");
+    assert(pow(Currency(), -1).is_inf());
+    assert(pow(Currency(10), 30) == Currency(1, 30));
+    // too large for the units of the scale: inf, not an exception
+    assert(pow(Currency(10), 40, -2).is_inf() && !pow(Currency(10), 40, -2).is_negative());
+    assert(pow(Currency(-10), 41, -2).is_inf() && pow(Currency(-10), 41, -2).is_negative());
+    assert(pow(Currency(10), 16, -2) == Currency(1, 16));
+
+    // 100000 at 0.5% a month for 30 years
+    Loan loan = { Currency(100000), Currency("0.005"), 360 };
+    assert(amortization_payment(loan, -2) == "599.55");
+
+    AmortizationSchedule schedule;
+    amortize(loan, -2, schedule);
+    assert(schedule.payment.size() == 360);
+    assert(schedule.interest[0] == 500);
+    assert(schedule.principal[0] == "99.55");
+    assert(schedule.balance[0] == "99900.45");
+    assert(schedule.balance[359].is_zero());
+    Currency paid, interest;
+    for (size_t i = 0; i < 360; ++i)
+    {
+        assert(schedule.payment[i] == schedule.interest[i] + schedule.principal[i]);
+        paid += schedule.principal[i];
+        interest += schedule.interest[i];
+    }
+    assert(paid == 100000);
+    // the last payment absorbs the rounding of the others
+    assert(schedule.payment[359] == "600");
+
+    // no interest
+    Loan flat = { Currency(100), Currency(), 3 };
+    amortize(flat, -2, schedule);
+    assert(schedule.payment[0] == "33.33");
+    assert(schedule.payment[2] == "33.34");
+    assert(schedule.balance[2].is_zero());
+
+    // batch
+    Loan loans[5] = { loan, flat, loan, flat, loan };
+    AmortizationSchedule schedules[5];
+    amortize(loans, 5, -2, schedules, ROUND_HALF_EVEN, 3);
+    for (size_t i = 0; i < 5; ++i)
+    {
+        assert(schedules[i].payment.size() == size_t(loans[i].periods));
+        assert(schedules[i].balance[loans[i].periods - 1].is_zero());
+    }
+    assert(schedules[4].principal[0] == "99.55");
+
+    Loan bad = { Currency(100), Currency("0.01"), 0 };
+    bool thrown = false;
+    try
+    {
+        amortize(&bad, 1, -2, schedules);
+    }
+    catch (std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    puts("finance_unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,187 @@
+// CurrencyFinance.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "WideDecimal.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+void finance_unittest();
+
+//////////////////////////////////////////////////////////////////////////////
+// pow
+//
+// base^exponent by squaring on WideDecimal's (38 digits) with a single
+// rounding at the end, either to 18 significant digits or to 10^scale.
+
+inline WideDecimal wide_pow(const WideDecimal& base, int exponent)
+{
+    unsigned int n = (exponent < 0) ? 0U - unsigned(exponent) : unsigned(exponent);
+    WideDecimal ret(1), x(base);
+    while (n)
+    {
+        if (n & 1)
+            ret = ret * x;
+        n >>= 1;
+        if (n)
+            x = x * x;
+    }
+    if (exponent < 0)
+        ret = WideDecimal(1) / ret;
+    return ret;
+}
+
+inline Currency pow(const Currency& base, int exponent, exp10_t scale,
+                    RoundingMode mode = ROUND_HALF_EVEN)
+{
+    bool negative = base.is_negative() && (exponent & 1);
+    if (exponent == 0)
+        return Currency(1);
+    if (base.is_zero())
+    {
+        if (exponent > 0)
+            return Currency();
+        Currency inf;
+        inf.set_inf();
+        return inf;
+    }
+    if (base.is_inf())
+    {
+        if (exponent < 0)
+            return Currency();
+        Currency inf;
+        inf.set_inf(negative);
+        return inf;
+    }
+    return wide_pow(WideDecimal::from(base), exponent).to_currency(scale, mode, negative);
+}
+
+inline Currency pow(const Currency& base, int exponent,
+                    RoundingMode mode = ROUND_HALF_EVEN)
+{
+    bool negative = base.is_negative() && (exponent & 1);
+    if (exponent == 0 || base.is_zero() || base.is_inf())
+        return pow(base, exponent, 0, mode);
+    return wide_pow(WideDecimal::from(base), exponent).to_currency(mode, negative);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Amortization
+//
+// A fixed-payment (annuity) loan schedule. The payment is
+//     principal * rate * (1 + rate)^periods / ((1 + rate)^periods - 1)
+// rounded once to the scale. Each period's interest is balance * rate,
+// computed exactly and rounded once; the last period pays off the rest.
+
+struct Loan
+{
+    Currency principal;
+    Currency rate;      // per period
+    int periods;
+};
+
+struct AmortizationSchedule
+{
+    CurrencyColumn payment;
+    CurrencyColumn interest;
+    CurrencyColumn principal;
+    CurrencyColumn balance;     // after the payment
+};
+
+inline Currency
+amortization_payment(const Loan& loan, exp10_t scale, RoundingMode mode = ROUND_HALF_EVEN)
+{
+    if (loan.periods <= 0 || loan.principal.is_negative() || loan.rate.is_negative())
+        throw std::runtime_error("amortization_payment: invalid loan");
+
+    WideDecimal principal = WideDecimal::from(loan.principal);
+    if (loan.rate.is_zero())
+        return (principal / WideDecimal(uint64_t(loan.periods))).to_currency(scale, mode);
+
+    WideDecimal rate = WideDecimal::from(loan.rate);
+    WideDecimal factor = wide_pow(WideDecimal(1) + rate, loan.periods);
+    WideDecimal payment = principal * rate * factor / abs_diff(factor, WideDecimal(1));
+    return payment.to_currency(scale, mode);
+}
+
+inline void
+amortize(const Loan& loan, exp10_t scale, AmortizationSchedule& out,
+         RoundingMode mode = ROUND_HALF_EVEN)
+{
+    const Currency payment = amortization_payment(loan, scale, mode);
+    Currency principal = loan.principal;
+    principal.round(scale, mode);
+    int64_t payment_units, balance_units;
+    if (!currency_to_units(payment, scale, payment_units) ||
+        !currency_to_units(principal, scale, balance_units))
+    {
+        throw std::runtime_error("amortize: out of scale");
+    }
+
+    // interest = balance * rate_significand * 10^rate_exp10 in units, with
+    // the division by 10^-rate_exp10 done by an invariant reciprocal
+    const uint64_t rate_sig = uint64_t(loan.rate.base().significand());
+    const exp10_t rate_exp = loan.rate.is_zero() ? 0 : loan.rate.exp10();
+    const bool fast = -19 <= rate_exp && rate_exp <= 0;
+    const InvariantDivider divider(fast ? pow10_u64(-rate_exp) : 1);
+
+    const size_t periods = size_t(loan.periods);
+    out.payment.resize(periods);
+    out.interest.resize(periods);
+    out.principal.resize(periods);
+    out.balance.resize(periods);
+
+    for (size_t i = 0; i < periods; ++i)
+    {
+        unsigned __int128 n = (unsigned __int128)uint64_t(balance_units) * rate_sig;
+        unsigned __int128 q;
+        if (fast)
+        {
+            uint64_t r, d = divider.divisor();
+            q = divider.divide(n, r);
+            int half_cmp = half_compare(r, d);
+            if (round_increment(mode, q & 1, half_cmp, r != 0, false))
+                ++q;
+        }
+        else
+        {
+            q = WideDecimal(n, rate_exp).round_to(0, mode, false);
+        }
+        if (q > (unsigned __int128)(max_significand - balance_units))
+            throw std::runtime_error("amortize: overflow");
+        const int64_t interest = int64_t(q);
+
+        int64_t pay = payment_units;
+        int64_t principal_units = pay - interest;
+        if (i + 1 == periods || principal_units > balance_units)
+        {
+            principal_units = balance_units;
+            pay = principal_units + interest;
+        }
+        balance_units -= principal_units;
+
+        out.payment.set(i, Currency(significand_t(pay), scale));
+        out.interest.set(i, Currency(interest, scale));
+        out.principal.set(i, Currency(significand_t(principal_units), scale));
+        out.balance.set(i, Currency(significand_t(balance_units), scale));
+    }
+}
+
+// schedules many loans in parallel; out must have count elements
+inline void
+amortize(const Loan *loans, size_t count, exp10_t scale, AmortizationSchedule *out,
+         RoundingMode mode = ROUND_HALF_EVEN, unsigned int threads = 0)
+{
+    parallel_for(count, threads, [=](unsigned int, size_t i) {
+        amortize(loans[i], scale, out[i], mode);
+    });
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
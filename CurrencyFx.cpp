@@ -0,0 +1,81 @@
+// CurrencyFx.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyFx.hpp"
+
+namespace khmz
+{
+
+void FxTable::unittest()
+{
+    // InvariantDivider against the native division
+    uint64_t seed = 88172645463325252ULL;
+    for (int i = 0; i < 10000; ++i)
+    {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        uint64_t d = seed >> (i % 64);
+        if (d == 0)
+            d = 1;
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        unsigned __int128 n = ((unsigned __int128)seed << 64) | (seed * 31);
+        InvariantDivider divider(d);
+        uint64_t r;
+        assert(divider.divide(n, r) == n / d);
+        assert(r == uint64_t(n % d));
+        assert(divider.divide(seed, r) == seed / d);
+        assert(r == seed % d);
+    }
+
+    FxTable table("USD");
+    table.set_rate("EUR", Currency("1.0842"));
+    table.set_rate("JPY", Currency("0.006711"), 0);
+    table.set_rate("BTC", Currency("65000"), -8);
+
+    assert(table.convert(Currency("100"), "EUR", "USD") == "108.42");
+    assert(table.convert(Currency("-100"), "EUR", "USD") == "-108.42");
+    assert(table.convert(Currency("100"), "EUR", "JPY") == "16156");
+    assert(table.convert(Currency("100"), "USD", "EUR") == "92.23");
+    assert(table.convert(Currency("100"), "USD", "EUR", ROUND_UP) == "92.24");
+    assert(table.convert(Currency("1000000"), "JPY", "EUR") == "6189.82");
+    assert(table.convert(Currency("1"), "USD", "BTC") == "0.00001538");
+    assert(table.convert(Currency("0.000000000000001"), "USD", "USD") == "0");
+    assert(table.convert(Currency("0.005"), "USD", "USD") == "0");
+    assert(table.convert(Currency("0.015"), "USD", "USD") == "0.02");
+    assert(table.convert(Currency(1, 40), "USD", "EUR").is_inf());
+    assert(table.convert(Currency(5, -23), "USD", "USD") == "0");
+    assert(table.convert(Currency(5, -23), "USD", "USD", ROUND_UP) == "0.01");
+    assert(table.convert(Currency(significand_t(4999999999999999999), -21), "USD", "USD") == "0");
+    assert(table.convert(Currency(significand_t(5000000000000000001), -21), "USD", "USD") == "0.01");
+
+    // cached until the rates change; a held conversion stays valid
+    std::shared_ptr<const FxConversion> eur_usd = table.conversion("EUR", "USD");
+    assert(table.conversion("EUR", "USD") == eur_usd);
+    table.set_rate("EUR", Currency("1.1"));
+    assert(table.conversion("EUR", "USD") != eur_usd);
+    assert(eur_usd->convert(Currency(100)) == "108.42");
+    assert(table.convert(Currency(100), "EUR", "USD") == "110");
+    table.set_rate("EUR", Currency("1.0842"));
+
+    // batch
+    Currency amounts[3] = { Currency("1"), Currency("2.5"), Currency("-3") };
+    Currency out[3];
+    table.convert(amounts, 3, "EUR", "USD", out);
+    assert(out[0] == "1.08");
+    assert(out[1] == "2.71");
+    assert(out[2] == "-3.25");
+
+    bool catched = false;
+    try
+    {
+        table.convert(Currency("1"), "EUR", "GBP");
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+
+    puts("FxTable::unittest: OK.");
+}
+
+} // namespace khmz
@@ -0,0 +1,284 @@
+// CurrencyFx.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "InvariantDivider.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// FxConversion
+//
+// An exact conversion by the cross rate from_rate / to_rate, rounded to the
+// minor unit of the target currency. The divisors (the target significand
+// times 10^j) are precomputed as InvariantDivider's, so a conversion
+// costs a multiply and a division by invariant.
+
+class FxConversion
+{
+protected:
+    uint64_t m_numerator;                   // significand of from_rate
+    std::vector<InvariantDivider> m_dividers; // [j]: to_rate significand * 10^j
+    exp10_t m_exp10;                        // from_rate exp10 - to_rate exp10
+    exp10_t m_scale;                        // minor unit of the target
+
+public:
+    FxConversion()
+        : m_numerator(1)
+        , m_dividers(1, InvariantDivider(1))
+        , m_exp10(0)
+        , m_scale(-2)
+    {
+    }
+
+    FxConversion(const Currency& from_rate, const Currency& to_rate, exp10_t scale);
+
+    exp10_t scale() const
+    {
+        return m_scale;
+    }
+
+    Currency convert(const Currency& amount, RoundingMode mode = ROUND_HALF_EVEN) const;
+    void convert(const Currency *amounts, size_t count, Currency *out,
+                 RoundingMode mode = ROUND_HALF_EVEN) const;
+    void convert(const CurrencyColumn& amounts, CurrencyColumn& out,
+                 RoundingMode mode = ROUND_HALF_EVEN) const;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// FxTable
+//
+// Rates are given against a pivot currency: 1 unit of code = rate pivot.
+// Cross conversions are built once per pair and cached; a cached conversion
+// is shared, not copied, so lookups do not allocate.
+
+class FxTable
+{
+protected:
+    struct Entry
+    {
+        Currency rate;
+        exp10_t scale;
+    };
+
+    std::string m_pivot;
+    std::map<std::string, Entry> m_entries;
+    mutable std::map<std::pair<std::string, std::string>,
+                     std::shared_ptr<const FxConversion> > m_cache;
+    mutable std::mutex m_mutex;
+
+public:
+    explicit FxTable(const std::string& pivot = "USD", exp10_t pivot_scale = -2);
+
+    FxTable(const FxTable&) = delete;
+    FxTable& operator=(const FxTable&) = delete;
+
+    const std::string& pivot() const
+    {
+        return m_pivot;
+    }
+
+    // scale is the minor unit of code (e.g. -2 for cents, 0 for JPY)
+    void set_rate(const std::string& code, const Currency& rate, exp10_t scale = -2);
+    Currency rate(const std::string& code) const;
+
+    // stays valid after set_rate(), which only drops it from the cache
+    std::shared_ptr<const FxConversion>
+    conversion(const std::string& from, const std::string& to) const;
+
+    Currency convert(const Currency& amount,
+                     const std::string& from, const std::string& to,
+                     RoundingMode mode = ROUND_HALF_EVEN) const
+    {
+        return conversion(from, to)->convert(amount, mode);
+    }
+    void convert(const Currency *amounts, size_t count,
+                 const std::string& from, const std::string& to, Currency *out,
+                 RoundingMode mode = ROUND_HALF_EVEN) const
+    {
+        conversion(from, to)->convert(amounts, count, out, mode);
+    }
+
+    static void unittest();
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+inline FxConversion::FxConversion(const Currency& from_rate, const Currency& to_rate,
+                                  exp10_t scale)
+    : m_scale(scale)
+{
+    if (!from_rate.is_positive() || !to_rate.is_positive() ||
+        from_rate.is_inf() || to_rate.is_inf())
+    {
+        throw std::runtime_error("FxConversion: invalid rate");
+    }
+
+    m_numerator = uint64_t(from_rate.significand());
+    m_exp10 = from_rate.exp10() - to_rate.exp10();
+
+    uint64_t divisor = uint64_t(to_rate.significand());
+    for (;;)
+    {
+        m_dividers.push_back(InvariantDivider(divisor));
+        if (__builtin_mul_overflow(divisor, 10, &divisor))
+            break;
+    }
+}
+
+inline Currency FxConversion::convert(const Currency& amount, RoundingMode mode) const
+{
+    if (amount.is_zero() || amount.is_inf())
+        return amount;
+
+    const bool negative = amount.is_negative();
+    unsigned __int128 n = (unsigned __int128)amount.base().significand() * m_numerator;
+    int64_t k = int64_t(amount.exp10()) + m_exp10 - m_scale;
+
+    unsigned __int128 q;
+    int half_cmp;
+    bool inexact;
+    if (k >= 0 || size_t(-k) < m_dividers.size())
+    {
+        const InvariantDivider *divider = &m_dividers[0];
+        if (k > 0)
+        {
+            for (; k > 0; k -= std::min<int64_t>(k, 19))
+            {
+                if (__builtin_mul_overflow(n, pow10_u64(int(std::min<int64_t>(k, 19))), &n))
+                {
+                    Currency inf;
+                    inf.set_inf(negative);
+                    return inf;
+                }
+            }
+        }
+        else
+        {
+            divider = &m_dividers[size_t(-k)];
+        }
+
+        uint64_t r, d = divider->divisor();
+        q = divider->divide(n, r);
+        half_cmp = half_compare(r, d);
+        inexact = (r != 0);
+    }
+    else
+    {
+        // the divisor with 10^-k does not fit; divide by 10^-k afterwards
+        uint64_t r;
+        unsigned __int128 q1 = m_dividers[0].divide(n, r);
+        int64_t j = -k;
+        if (j > 38)
+        {
+            q = 0;
+            half_cmp = -1;
+            inexact = (q1 != 0 || r != 0);
+        }
+        else
+        {
+            unsigned __int128 p = 1;
+            for (int64_t i = j; i > 0; i -= std::min<int64_t>(i, 19))
+                p *= pow10_u64(int(std::min<int64_t>(i, 19)));
+            q = q1 / p;
+            unsigned __int128 rem = q1 % p;
+            if (2 * rem < p)
+                half_cmp = -1;
+            else if (2 * rem == p)
+                half_cmp = (r != 0);
+            else
+                half_cmp = 1;
+            inexact = (rem != 0 || r != 0);
+        }
+    }
+
+    if (round_increment(mode, q & 1, half_cmp, inexact, negative))
+        ++q;
+
+    if (q >> 127)
+    {
+        Currency inf;
+        inf.set_inf(negative);
+        return inf;
+    }
+    __int128 units = __int128(q);
+    return currency_from_wide(negative ? -units : units, m_scale);
+}
+
+inline void
+FxConversion::convert(const Currency *amounts, size_t count, Currency *out,
+                      RoundingMode mode) const
+{
+    for (size_t i = 0; i < count; ++i)
+        out[i] = convert(amounts[i], mode);
+}
+
+inline void
+FxConversion::convert(const CurrencyColumn& amounts, CurrencyColumn& out,
+                      RoundingMode mode) const
+{
+    out.resize(amounts.size());
+    for (size_t i = 0; i < amounts.size(); ++i)
+        out.set(i, convert(amounts[i], mode));
+}
+
+inline FxTable::FxTable(const std::string& pivot, exp10_t pivot_scale)
+    : m_pivot(pivot)
+{
+    Entry entry = { Currency(1), pivot_scale };
+    m_entries[pivot] = entry;
+}
+
+inline void FxTable::set_rate(const std::string& code, const Currency& rate, exp10_t scale)
+{
+    if (!rate.is_positive() || rate.is_inf())
+        throw std::runtime_error("FxTable: invalid rate");
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry entry = { rate, scale };
+    m_entries[code] = entry;
+    m_cache.clear();
+}
+
+inline Currency FxTable::rate(const std::string& code) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, Entry>::const_iterator it = m_entries.find(code);
+    if (it == m_entries.end())
+        throw std::runtime_error("FxTable: unknown currency");
+    return it->second.rate;
+}
+
+inline std::shared_ptr<const FxConversion>
+FxTable::conversion(const std::string& from, const std::string& to) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::pair<std::string, std::string> key(from, to);
+    std::map<std::pair<std::string, std::string>,
+             std::shared_ptr<const FxConversion> >::const_iterator it = m_cache.find(key);
+    if (it != m_cache.end())
+        return it->second;
+
+    std::map<std::string, Entry>::const_iterator
+        it_from = m_entries.find(from), it_to = m_entries.find(to);
+    if (it_from == m_entries.end() || it_to == m_entries.end())
+        throw std::runtime_error("FxTable: unknown currency");
+
+    std::shared_ptr<const FxConversion> conv = std::make_shared<const FxConversion>(
+        it_from->second.rate, it_to->second.rate, it_to->second.scale);
+    m_cache[key] = conv;
+    return conv;
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,109 @@
+// CurrencyJson.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyJson.hpp"
+
+namespace khmz
+{
+
+void JsonAmountScanner::unittest()
+{
+    std::vector<std::string> keys;
+    keys.push_back("amount");
+    keys.push_back("fee");
+    JsonAmountScanner scanner(keys);
+
+    const std::string text =
+        "{\"id\": 1, \"amount\": 1234.5678901234567, \"fee\": \"0.25\",\n"
+        " \"nested\": {\"amount\": -1.5e3, \"list\": [{\"fee\": 2E-2}, 3, \"amount\"]}}\n"
+        "{\"amount\": \"-0.10\", \"fee\": null, \"note\": \"a \\\"fee\\\": 9\"}\n"
+        "{\"amount\": 0, \"fee\": 12345678901234567890123, \"x\": [true, false, {}, []]}\n";
+    std::vector<CurrencyColumn> out;
+    std::vector<size_t> invalid;
+    assert(scanner.scan(text.data(), text.data() + text.size(), out, invalid) == 2);
+    assert(out.size() == 2);
+    assert(out[0].size() == 4 && out[1].size() == 2);
+    assert(out[0][0] == "1234.5678901234567");
+    assert(out[0][1] == "-1500");
+    assert(out[0][2] == "-0.1");
+    assert(out[0][3].is_zero());
+    assert(out[1][0] == "0.25");
+    assert(out[1][1] == "0.02");
+    assert(invalid.size() == 2 && text.compare(invalid[0], 4, "null") == 0 &&
+           text.compare(invalid[1], 3, "123") == 0);
+
+    // the values arrive in document order
+    std::string order;
+    invalid.clear();
+    scanner.scan(text.data(), text.data() + text.size(), [&](size_t key, const Currency& value) {
+        order += keys[key] + "=" + value.to_string() + ";";
+    }, invalid);
+    assert(order == "amount=1234.5678901234567;fee=0.25;amount=-1500;fee=0.02;"
+                    "amount=-0.1;amount=0;");
+
+    // malformed input
+    const char *const s_bad[] =
+    {
+        "{\"amount\": 1.}", "{\"amount\" 1}", "{\"amount\": 01}", "[1, 2",
+        "{\"a\": \"x}", "{\"a\": tru}", "{1: 2}", "[1 2]", "{\"a\": -}"
+    };
+    for (size_t i = 0; i < sizeof(s_bad) / sizeof(s_bad[0]); ++i)
+    {
+        bool thrown = false;
+        try
+        {
+            scanner.scan(s_bad[i], s_bad[i] + std::strlen(s_bad[i]), out, invalid);
+        }
+        catch (const std::runtime_error&)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    Currency value;
+    const char *num = "-12.5e-2";
+    assert(json_number_to_currency(num, num + std::strlen(num), value) && value == "-0.125");
+    num = "1e99999999999";
+    assert(!json_number_to_currency(num, num + std::strlen(num), value));
+    num = "0e99999999999";
+    assert(json_number_to_currency(num, num + std::strlen(num), value) && value.is_zero());
+
+    // output
+    char buf[64];
+    char *end = to_json_number(buf, buf + sizeof(buf), Currency("-12.34"));
+    assert(std::string(buf, end) == "-12.34");
+    end = to_json_number(buf, buf + sizeof(buf), Currency(15, 40));
+    assert(std::string(buf, end) == "15e40");
+    end = to_json_number(buf, buf + sizeof(buf), Currency(-3, -50));
+    assert(std::string(buf, end) == "-3e-50");
+    Currency inf;
+    inf.set_inf();
+    end = to_json_number(buf, buf + sizeof(buf), inf);
+    assert(std::string(buf, end) == "null");
+    assert(to_json_number(buf, buf + 3, Currency("12.34")) == NULL);
+
+    JsonWriter writer;
+    writer.begin_object()
+        .key("id").value("t\"1")
+        .key("amount").value(Currency("1234.56"))
+        .key("legs").begin_array()
+            .value(Currency(1)).value(Currency(15, 40)).null()
+        .end_array()
+        .key("empty").begin_object().end_object()
+    .end_object();
+    assert(writer.str() ==
+           "{\"id\":\"t\\\"1\",\"amount\":1234.56,\"legs\":[1,15e40,null],\"empty\":{}}");
+
+    // round trip
+    out.clear();
+    invalid.clear();
+    scanner.scan(writer.str().data(), writer.str().data() + writer.str().size(), out, invalid);
+    assert(out[0].size() == 1 && out[0][0] == "1234.56" && invalid.empty());
+
+    puts("JsonAmountScanner::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,526 @@
+// CurrencyJson.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <string>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// JsonAmountScanner
+//
+// Finds the members with configured keys in JSON text, at any depth, and
+// parses their values straight into Currency, never through double. A value
+// may be a number ("amount": 12.34, 1234e-2) or a string ("amount": "12.34").
+// The text may hold several documents, e.g. one per line. Keys are compared
+// as written, without decoding escapes. Nothing is allocated per value.
+//
+// Malformed JSON throws std::runtime_error with the byte offset. A matched
+// value that is not an amount (null, "abc", an object, ...) is skipped and
+// its offset is appended to invalid.
+
+class JsonAmountScanner
+{
+protected:
+    std::vector<std::string> m_keys;
+    size_t m_max_depth;
+
+    template <typename Fn>
+    class Parser;
+
+public:
+    explicit JsonAmountScanner(const std::vector<std::string>& keys)
+        : m_keys(keys)
+        , m_max_depth(256)
+    {
+    }
+
+    const std::vector<std::string>& keys() const
+    {
+        return m_keys;
+    }
+    void set_max_depth(size_t depth)
+    {
+        m_max_depth = depth;
+    }
+
+    // the index of [first, last) in keys(), or -1
+    int find_key(const char *first, const char *last) const
+    {
+        const size_t size = size_t(last - first);
+        for (size_t i = 0; i < m_keys.size(); ++i)
+        {
+            if (m_keys[i].size() == size && std::memcmp(m_keys[i].data(), first, size) == 0)
+                return int(i);
+        }
+        return -1;
+    }
+
+    // calls fn(key_index, value) for each matched amount, in order.
+    // returns the number of invalid values.
+    template <typename Fn>
+    size_t scan(const char *first, const char *last, Fn fn, std::vector<size_t>& invalid) const;
+
+    // out[i] receives the values of keys()[i]
+    size_t scan(const char *first, const char *last,
+                std::vector<CurrencyColumn>& out, std::vector<size_t>& invalid) const
+    {
+        out.resize(m_keys.size());
+        return scan(first, last, [&out](size_t key, const Currency& value) {
+            out[key].push_back(value);
+        }, invalid);
+    }
+
+    static void unittest();
+};
+
+// parses a JSON number token (already validated) into value. false if its
+// exponent is out of range. like Currency::try_parse, digits beyond the
+// precision of a fraction are truncated and a too large integer part is inf.
+inline bool json_number_to_currency(const char *first, const char *last, Currency& value)
+{
+    const char *e = first;
+    while (e != last && *e != 'e' && *e != 'E')
+        ++e;
+    if (!value.try_parse(first, e))
+        return false;
+    if (e == last)
+        return true;
+
+    ++e;
+    bool negative = (*e == '-');
+    if (*e == '-' || *e == '+')
+        ++e;
+    int64_t exponent = 0;
+    for (; e != last; ++e)
+    {
+        exponent = exponent * 10 + (*e - '0');
+        if (exponent > int64_t(max_exp10) * 2)
+            break;
+    }
+    if (value.is_zero())
+        return true;
+
+    exponent = int64_t(value.exp10()) + (negative ? -exponent : exponent);
+    if (exponent > max_exp10 || exponent < -int64_t(max_exp10))
+        return false;
+    value = Currency(value.significand(), exp10_t(exponent));
+    return true;
+}
+
+template <typename Fn>
+class JsonAmountScanner::Parser
+{
+protected:
+    const JsonAmountScanner& m_scanner;
+    const char *const m_begin;
+    const char *m_ptr;
+    const char *const m_last;
+    Fn& m_fn;
+    std::vector<size_t>& m_invalid;
+
+    void fail(const char *message) const
+    {
+        throw std::runtime_error(std::string("JsonAmountScanner: ") + message + " at offset " +
+                                 std::to_string(m_ptr - m_begin));
+    }
+
+    void skip_space()
+    {
+        while (m_ptr != m_last &&
+               (*m_ptr == ' ' || *m_ptr == '\n' || *m_ptr == '\r' || *m_ptr == '\t'))
+        {
+            ++m_ptr;
+        }
+    }
+
+    void expect(char ch)
+    {
+        skip_space();
+        if (m_ptr == m_last || *m_ptr != ch)
+            fail("unexpected character");
+        ++m_ptr;
+    }
+
+    // the contents of a string; sets escaped if it holds an escape
+    void string(const char *& first, const char *& last, bool& escaped)
+    {
+        first = ++m_ptr;    // after '"'
+        escaped = false;
+        for (;; ++m_ptr)
+        {
+            if (m_ptr == m_last)
+                fail("unterminated string");
+            const char ch = *m_ptr;
+            if (ch == '"')
+                break;
+            if ((unsigned char)ch < 0x20)
+                fail("control character in string");
+            if (ch == '\\')
+            {
+                escaped = true;
+                if (++m_ptr == m_last)
+                    fail("unterminated string");
+            }
+        }
+        last = m_ptr++;
+    }
+
+    // skips a number token
+    void number()
+    {
+        auto digits = [&]() {
+            const char *start = m_ptr;
+            while (m_ptr != m_last && '0' <= *m_ptr && *m_ptr <= '9')
+                ++m_ptr;
+            if (m_ptr == start)
+                fail("invalid number");
+        };
+        if (*m_ptr == '-')
+            ++m_ptr;
+        if (m_ptr != m_last && *m_ptr == '0')
+            ++m_ptr;
+        else
+            digits();
+        if (m_ptr != m_last && *m_ptr == '.')
+        {
+            ++m_ptr;
+            digits();
+        }
+        if (m_ptr != m_last && (*m_ptr == 'e' || *m_ptr == 'E'))
+        {
+            ++m_ptr;
+            if (m_ptr != m_last && (*m_ptr == '+' || *m_ptr == '-'))
+                ++m_ptr;
+            digits();
+        }
+    }
+
+    void literal(const char *word, size_t size)
+    {
+        if (size_t(m_last - m_ptr) < size || std::memcmp(m_ptr, word, size) != 0)
+            fail("invalid literal");
+        m_ptr += size;
+    }
+
+    // a value; key is the index of its member's key, or -1
+    void value(int key, size_t depth)
+    {
+        skip_space();
+        if (m_ptr == m_last)
+            fail("unexpected end");
+
+        const size_t offset = size_t(m_ptr - m_begin);
+        Currency amount;
+        bool valid = false;    // a matched amount
+        switch (*m_ptr)
+        {
+        case '{':
+            object(depth + 1);
+            break;
+        case '[':
+            array(depth + 1);
+            break;
+        case '"':
+            {
+                const char *first, *last;
+                bool escaped;
+                string(first, last, escaped);
+                valid = key >= 0 && !escaped && first != last &&
+                        amount.try_parse(first, last) && !amount.is_inf();
+            }
+            break;
+        case 't':
+            literal("true", 4);
+            break;
+        case 'f':
+            literal("false", 5);
+            break;
+        case 'n':
+            literal("null", 4);
+            break;
+        default:
+            if (*m_ptr != '-' && (*m_ptr < '0' || '9' < *m_ptr))
+                fail("unexpected character");
+            {
+                const char *first = m_ptr;
+                number();
+                valid = key >= 0 && json_number_to_currency(first, m_ptr, amount) &&
+                        !amount.is_inf();
+            }
+            break;
+        }
+
+        if (key < 0)
+            return;
+        if (valid)
+            m_fn(size_t(key), amount);
+        else
+            m_invalid.push_back(offset);
+    }
+
+    void object(size_t depth)
+    {
+        if (depth > m_scanner.m_max_depth)
+            fail("too deep");
+        ++m_ptr;    // '{'
+        skip_space();
+        if (m_ptr != m_last && *m_ptr == '}')
+        {
+            ++m_ptr;
+            return;
+        }
+        for (;;)
+        {
+            skip_space();
+            if (m_ptr == m_last || *m_ptr != '"')
+                fail("expected a key");
+            const char *first, *last;
+            bool escaped;
+            string(first, last, escaped);
+            int key = escaped ? -1 : m_scanner.find_key(first, last);
+            expect(':');
+            value(key, depth);
+
+            skip_space();
+            if (m_ptr == m_last)
+                fail("unexpected end");
+            if (*m_ptr == '}')
+            {
+                ++m_ptr;
+                return;
+            }
+            if (*m_ptr != ',')
+                fail("expected ',' or '}'");
+            ++m_ptr;
+        }
+    }
+
+    void array(size_t depth)
+    {
+        if (depth > m_scanner.m_max_depth)
+            fail("too deep");
+        ++m_ptr;    // '['
+        skip_space();
+        if (m_ptr != m_last && *m_ptr == ']')
+        {
+            ++m_ptr;
+            return;
+        }
+        for (;;)
+        {
+            value(-1, depth);
+            skip_space();
+            if (m_ptr == m_last)
+                fail("unexpected end");
+            if (*m_ptr == ']')
+            {
+                ++m_ptr;
+                return;
+            }
+            if (*m_ptr != ',')
+                fail("expected ',' or ']'");
+            ++m_ptr;
+        }
+    }
+
+public:
+    Parser(const JsonAmountScanner& scanner, const char *first, const char *last, Fn& fn,
+           std::vector<size_t>& invalid)
+        : m_scanner(scanner)
+        , m_begin(first)
+        , m_ptr(first)
+        , m_last(last)
+        , m_fn(fn)
+        , m_invalid(invalid)
+    {
+    }
+
+    void parse()
+    {
+        for (;;)
+        {
+            skip_space();
+            if (m_ptr == m_last)
+                return;
+            value(-1, 0);
+        }
+    }
+};
+
+template <typename Fn>
+inline size_t
+JsonAmountScanner::scan(const char *first, const char *last, Fn fn,
+                        std::vector<size_t>& invalid) const
+{
+    const size_t invalid_count = invalid.size();
+    Parser<Fn> parser(*this, first, last, fn, invalid);
+    parser.parse();
+    return invalid.size() - invalid_count;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// JSON output
+
+// writes value as an exact JSON number; returns NULL if it does not fit.
+// an infinity, which JSON cannot hold, is written as null. very large or
+// small exponents use the exponent form (e.g. 12e40), so that 64 chars
+// are always enough.
+inline char *to_json_number(char *first, char *last, const Currency& value)
+{
+    if (value.is_inf())
+    {
+        if (last - first < 4)
+            return NULL;
+        std::memcpy(first, "null", 4);
+        return first + 4;
+    }
+    if (-40 <= value.exp10() && value.exp10() <= 20)
+        return value.to_chars(first, last);
+
+    char *out = Currency(value.significand()).to_chars(first, last);
+    if (!out || last - out < 12)
+        return NULL;
+    *out++ = 'e';
+    return Currency(value.exp10()).to_chars(out, last);
+}
+
+// JsonWriter
+//
+// Appends JSON to a string, inserting the commas. Amounts are written as
+// exact numbers by to_json_number.
+
+class JsonWriter
+{
+protected:
+    std::string m_out;
+    std::vector<bool> m_first;  // per open container: no member written yet
+    bool m_after_key;
+
+    void separate()
+    {
+        if (m_after_key)
+        {
+            m_after_key = false;
+            return;
+        }
+        if (!m_first.empty())
+        {
+            if (!m_first.back())
+                m_out += ',';
+            m_first.back() = false;
+        }
+    }
+
+    void quoted(const char *str)
+    {
+        m_out += '"';
+        for (; *str; ++str)
+        {
+            const unsigned char ch = (unsigned char)*str;
+            if (ch == '"' || ch == '\\')
+            {
+                m_out += '\\';
+                m_out += char(ch);
+            }
+            else if (ch < 0x20)
+            {
+                static const char s_hex[] = "0123456789abcdef";
+                m_out += "\\u00";
+                m_out += s_hex[ch >> 4];
+                m_out += s_hex[ch & 15];
+            }
+            else
+            {
+                m_out += char(ch);
+            }
+        }
+        m_out += '"';
+    }
+
+public:
+    JsonWriter()
+        : m_after_key(false)
+    {
+    }
+
+    const std::string& str() const
+    {
+        return m_out;
+    }
+    void clear()
+    {
+        m_out.clear();
+        m_first.clear();
+        m_after_key = false;
+    }
+
+    JsonWriter& begin_object()
+    {
+        separate();
+        m_out += '{';
+        m_first.push_back(true);
+        return *this;
+    }
+    JsonWriter& end_object()
+    {
+        assert(!m_first.empty());
+        m_out += '}';
+        m_first.pop_back();
+        return *this;
+    }
+    JsonWriter& begin_array()
+    {
+        separate();
+        m_out += '[';
+        m_first.push_back(true);
+        return *this;
+    }
+    JsonWriter& end_array()
+    {
+        assert(!m_first.empty());
+        m_out += ']';
+        m_first.pop_back();
+        return *this;
+    }
+
+    JsonWriter& key(const char *name)
+    {
+        separate();
+        quoted(name);
+        m_out += ':';
+        m_after_key = true;
+        return *this;
+    }
+
+    JsonWriter& value(const Currency& amount)
+    {
+        separate();
+        char buf[64];
+        char *end = to_json_number(buf, buf + sizeof(buf), amount);
+        assert(end);
+        m_out.append(buf, end);
+        return *this;
+    }
+    JsonWriter& value(const char *str)
+    {
+        separate();
+        quoted(str);
+        return *this;
+    }
+    JsonWriter& null()
+    {
+        separate();
+        m_out += "null";
+        return *this;
+    }
+};
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
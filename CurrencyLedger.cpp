@@ -0,0 +1,271 @@
+// CurrencyLedger.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyLedger.hpp"
+#include <cstdio>
+#include <random>
+
+namespace khmz
+{
+
+void LedgerFile::unittest()
+{
+    const char *path = "LedgerFile_unittest.ledger";
+    std::remove(path);
+
+    // amounts in runs around a drifting level, committed in batches
+    std::mt19937_64 rng(50);
+    std::vector<int64_t> expected;
+    {
+        LedgerWriter writer(path, -2, 100);
+        writer.append(Currency("1.5"));
+        writer.append(Currency(2));
+        expected.push_back(150);
+        expected.push_back(200);
+        int64_t level = 0;
+        for (int batch = 0; batch < 20; ++batch)
+        {
+            const size_t n = size_t(rng() % 300);
+            for (size_t i = 0; i < n; ++i)
+            {
+                if (i % 50 == 0)
+                    level += int64_t(rng() % 20001) - 10000;
+                const int64_t units = level + int64_t(rng() % 1001) - 500;
+                writer.append_units(units);
+                expected.push_back(units);
+            }
+            writer.commit();
+            assert(writer.pending() == 0 && writer.size() == expected.size());
+        }
+    }
+
+    LedgerFile file(path);
+    assert(file.scale() == -2 && file.block_values() == 100);
+    assert(file.size() == expected.size());
+    assert(file.blocks() == (expected.size() + 99) / 100);
+    assert(file[0] == "1.5" && file[1] == "2");
+    for (size_t i = 0; i < expected.size(); ++i)
+        assert(file.units(i) == expected[i]);
+
+    for (int t = 0; t < 200; ++t)
+    {
+        size_t first = size_t(rng() % (expected.size() + 1));
+        size_t last = size_t(rng() % (expected.size() + 1));
+        if (first > last)
+            std::swap(first, last);
+        __int128 sum = 0;
+        for (size_t i = first; i < last; ++i)
+            sum += expected[i];
+        assert(file.sum_units(first, last) == sum);
+    }
+    __int128 total = 0;
+    for (size_t i = 0; i < expected.size(); ++i)
+        total += expected[i];
+    assert(file.sum() == currency_from_wide(total, -2));
+
+    // filters against brute force; blocks outside the range are skipped
+    const ColumnPredicate predicates[] =
+    {
+        ColumnPredicate(CMP_GT, Currency(100)),
+        ColumnPredicate(CMP_LE, Currency("-0.005")),
+        ColumnPredicate(CMP_NE, Currency("1.5")),
+        ColumnPredicate::between(Currency(-50), Currency(50)),
+        ColumnPredicate(CMP_EQ, Currency(1, -40)),
+    };
+    for (int k = 0; k < 5; ++k)
+    {
+        const ColumnPredicate& predicate = predicates[k];
+        std::vector<size_t> indices(1, 0);
+        assert(file.filter(predicate, indices) == indices.size() - 1);
+        uint64_t count;
+        __int128 sum;
+        const size_t scanned = file.count_sum(predicate, count, sum);
+        assert(scanned <= file.blocks());
+        size_t next = 1;
+        uint64_t expected_count = 0;
+        __int128 expected_sum = 0;
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            if (!predicate.test(Currency(expected[i], -2)))
+                continue;
+            assert(indices[next++] == i);
+            ++expected_count;
+            expected_sum += expected[i];
+        }
+        assert(next == indices.size());
+        assert(count == expected_count && sum == expected_sum);
+    }
+    uint64_t count;
+    __int128 sum;
+    assert(file.count_sum(ColumnPredicate(CMP_GT, Currency(1, 30)), count, sum) == 0);
+    assert(count == 0 && sum == 0);
+    assert(file.count_sum(ColumnPredicate(CMP_LT, Currency(1, 30)), count, sum) == 0);
+    assert(count == expected.size() && sum == total);
+    file.close();
+
+    FILE *fp = std::fopen(path, "wb");
+    std::fputs("not a ledger", fp);
+    std::fclose(fp);
+    try
+    {
+        file.open(path);
+        assert(0);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+    std::remove(path);
+
+    puts("LedgerFile::unittest: OK.");
+}
+
+void LedgerWriter::unittest()
+{
+    const char *path = "LedgerWriter_unittest.ledger";
+    std::remove(path);
+
+    {
+        LedgerWriter writer(path, -3, 4);
+        assert(writer.size() == 0);
+        const Currency values[] = { Currency("0.001"), Currency(-7), Currency("12.34") };
+        writer.append(values, 3);
+        try
+        {
+            writer.append(Currency("0.0001"));
+            assert(0);
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+        assert(writer.size() == 3);
+
+        // one writer at a time
+        try
+        {
+            LedgerWriter other(path, -3, 4);
+            assert(0);
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+    }
+    {
+        LedgerFile file(path);
+        assert(file.size() == 3 && file.commit().generation == 1);
+    }
+
+    // reopened, the partial block is completed by later commits
+    {
+        LedgerWriter writer(path, -3, 4);
+        assert(writer.size() == 3);
+        CurrencyColumn column;
+        for (int i = 0; i < 6; ++i)
+            column.push_back(Currency(i));
+        writer.append(column);
+        writer.commit();
+        writer.commit();
+    }
+    LedgerFile file(path);
+    assert(file.size() == 9 && file.blocks() == 3 && file.commit().generation == 2);
+    assert(file[0] == "0.001" && file[2] == "12.34" && file[8] == "5");
+    assert(file.block(0).min == -7000 && file.block(0).max == 12340);
+    assert(file.block(1).sum() == 10000 && file.block(2).count == 1);
+    const Currency committed = file.sum();
+    assert(committed == "20.341");
+    file.close();
+
+    try
+    {
+        LedgerWriter writer(path, -2, 4);
+        assert(0);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    // a torn commit: garbage past the end and a half-written slot leave the
+    // previous commit
+    {
+        LedgerFile before(path);
+        LedgerSlot slot = before.commit();
+        before.close();
+        FILE *fp = std::fopen(path, "r+b");
+        std::fseek(fp, 0, SEEK_END);
+        const char garbage[100] = { 1, 2, 3 };
+        std::fwrite(garbage, 1, sizeof(garbage), fp);
+        slot.generation += 1;
+        slot.value_count += 100;
+        std::fseek(fp, long(ledger_slot_offsets[slot.generation % 2]), SEEK_SET);
+        std::fwrite(&slot, 1, 24, fp);
+        std::fclose(fp);
+    }
+    file.open(path);
+    assert(file.size() == 9 && file.sum() == committed);
+    file.close();
+    {
+        LedgerWriter writer(path, -3, 4);
+        assert(writer.size() == 9);
+        writer.append(Currency(1));
+    }
+    file.open(path);
+    assert(file.size() == 10 && file.commit().generation == 3);
+    assert(file.sum() == "21.341");
+    file.close();
+    std::remove(path);
+
+    // many small commits: each writes its blocks and their index entries
+    // only, so the file grows with the data
+    {
+        LedgerWriter writer(path, -2, 4);
+        for (int c = 0; c < 500; ++c)
+        {
+            for (int i = 0; i < 4; ++i)
+                writer.append_units(c * 4 + i);
+            writer.commit();
+        }
+    }
+    file.open(path);
+    assert(file.size() == 2000 && file.blocks() == 500);
+    assert(file.commit_end() ==
+           ledger_header_size + 500 * (4 * 8 + sizeof(LedgerSegment) + sizeof(LedgerBlockInfo)));
+    for (size_t i = 0; i < 2000; ++i)
+        assert(file.units(i) == int64_t(i));
+    assert(file.sum_units(0, 2000) == 1999 * 1000);
+    file.close();
+    std::remove(path);
+
+    // commits into one partial block replace its segment in the chain and
+    // fill it in place: each adds one index segment to the file
+    for (int c = 0; c < 300; ++c)
+    {
+        LedgerWriter writer(path, -2, 256);
+        writer.append_units(c);
+    }
+    file.open(path);
+    assert(file.size() == 300 && file.blocks() == 2 && file.units(299) == 299);
+    assert(file.block(0).offset == ledger_header_size && file.block(1).count == 44);
+    assert(file.commit_end() ==
+           ledger_header_size + 2 * 256 * 8 + 300 * (sizeof(LedgerSegment) + sizeof(LedgerBlockInfo)));
+    assert(file.sum_units(0, 300) == 299 * 150);
+    for (size_t i = 0; i < 300; ++i)
+        assert(file.units(i) == int64_t(i));
+    file.close();
+    std::remove(path);
+
+    // zero at a positive scale
+    {
+        LedgerWriter writer(path, 2, 4);
+        writer.append(Currency());
+        writer.append(Currency(700));
+    }
+    file.open(path);
+    assert(file.size() == 2 && file[0].is_zero() && file.sum() == "700");
+    file.close();
+    std::remove(path);
+
+    puts("LedgerWriter::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,815 @@
+// CurrencyLedger.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "CurrencyFilter.hpp"
+#include "MappedFile.hpp"
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/file.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+#endif
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// ledger file format
+//
+// An append-only file of amounts at one scale, stored as int64_t units of
+// 10^scale in host byte order (little-endian hosts only, like
+// ArrowDecimal128View), so that a mapping of the file is read in place.
+//
+//   header      128 bytes: "KLDG", version, scale, block_values and two
+//               commit slots at ledger_slot_offsets
+//   blocks      space for block_values units each, 8-byte aligned; the
+//               last one may be partly filled
+//   segment     a LedgerSegment and the LedgerBlockInfo's of the blocks
+//               written by one commit
+//
+// A commit never rewrites committed values. It fills the space left in
+// the last block, writes new blocks past the end of the last commit, then
+// an index segment for the blocks it changed, linked to the previous one,
+// then, after a sync, the slot not holding the last commit. The valid slot
+// with the higher generation is the committed state, so a torn commit
+// leaves the previous one. The index is read by following the segments
+// back from the slot; each replaces the entries of the previous ones from
+// its first block on. A small commit thus costs its values and one index
+// segment.
+
+static const uint32_t ledger_version = 1;
+static const size_t ledger_header_size = 128;
+static const size_t ledger_slot_offsets[2] = { 16, 64 };
+
+// the summary of one block; the index entry in the file
+struct LedgerBlockInfo
+{
+    uint64_t offset;    // of the first value in the file
+    uint64_t count;
+    int64_t min;
+    int64_t max;
+    uint64_t sum_lo;    // the sum as a 128-bit two's complement integer
+    int64_t sum_hi;
+
+    __int128 sum() const
+    {
+        return __int128(((unsigned __int128)uint64_t(sum_hi) << 64) | sum_lo);
+    }
+    void set_sum(__int128 sum)
+    {
+        sum_lo = uint64_t(sum);
+        sum_hi = int64_t(sum >> 64);
+    }
+};
+
+// the header of an index segment
+struct LedgerSegment
+{
+    uint64_t previous;          // the offset of the previous segment
+    uint64_t previous_checksum; // of the previous segment header
+    uint64_t first_block;
+    uint64_t count;
+    uint64_t entries_checksum;
+};
+
+// a commit slot in the header
+struct LedgerSlot
+{
+    uint64_t generation;
+    uint64_t value_count;
+    uint64_t block_count;
+    uint64_t index_offset;      // of the last segment
+    uint64_t index_checksum;    // of the last segment header
+    uint64_t checksum;          // of the fields above
+};
+
+// a 64-bit checksum of size / 8 words, continued from h
+inline uint64_t ledger_checksum(const void *data, size_t size, uint64_t h = 0x9E3779B97F4A7C15ULL)
+{
+    const char *p = (const char *)data;
+    for (size_t i = 0; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        h = (h ^ word) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+inline uint64_t ledger_slot_checksum(const LedgerSlot& slot)
+{
+    return ledger_checksum(&slot, offsetof(LedgerSlot, checksum));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// LedgerFile --- a read-only snapshot of the last commit of a ledger file
+//
+// Values are read in place from a mapping of the file; the block index is
+// gathered from its segments at open. Range sums and filters use the block
+// summaries to take whole blocks or skip them.
+
+class LedgerFile
+{
+protected:
+    MappedFile m_file;
+    exp10_t m_scale;
+    size_t m_block_values;
+    LedgerSlot m_slot;
+    std::vector<LedgerBlockInfo> m_index;
+    uint64_t m_end;     // of the commit
+
+    // reads the index of a commit; false if the commit is corrupt
+    bool load_commit(const LedgerSlot& slot);
+
+    // calls fn(b) for the blocks whose rows may differ for predicate and
+    // hit(b) for those whose rows all match
+    template <typename Fn, typename Hit>
+    void scan(const ColumnPredicate& predicate, Fn fn, Hit hit) const;
+
+public:
+    LedgerFile()
+        : m_scale(0)
+        , m_block_values(0)
+        , m_end(0)
+    {
+        std::memset(&m_slot, 0, sizeof(m_slot));
+    }
+
+    explicit LedgerFile(const char *path)
+        : LedgerFile()
+    {
+        open(path);
+    }
+
+    LedgerFile(const LedgerFile&) = delete;
+    LedgerFile& operator=(const LedgerFile&) = delete;
+
+    // throws std::runtime_error if the file cannot be read or is corrupt
+    void open(const char *path);
+    void close()
+    {
+        m_file.close();
+        std::memset(&m_slot, 0, sizeof(m_slot));
+        m_index.clear();
+        m_end = 0;
+    }
+
+    exp10_t scale() const
+    {
+        return m_scale;
+    }
+    size_t block_values() const
+    {
+        return m_block_values;
+    }
+    size_t size() const
+    {
+        return size_t(m_slot.value_count);
+    }
+    size_t blocks() const
+    {
+        return size_t(m_slot.block_count);
+    }
+    const LedgerSlot& commit() const
+    {
+        return m_slot;
+    }
+    // the end of the commit in the file; later bytes are not part of it
+    uint64_t commit_end() const
+    {
+        return m_end;
+    }
+
+    const LedgerBlockInfo& block(size_t b) const
+    {
+        return m_index[b];
+    }
+    // the units of a block, in the mapping
+    const int64_t *block_units(size_t b) const
+    {
+        return (const int64_t *)(m_file.data() + m_index[b].offset);
+    }
+
+    int64_t units(size_t index) const
+    {
+        return block_units(index / m_block_values)[index % m_block_values];
+    }
+    Currency operator[](size_t index) const
+    {
+        return Currency(units(index), m_scale);
+    }
+
+    // the sum of the rows [first, last)
+    __int128 sum_units(size_t first, size_t last) const;
+    Currency sum(size_t first, size_t last) const
+    {
+        return currency_from_wide(sum_units(first, last), m_scale);
+    }
+    Currency sum() const
+    {
+        return sum(0, size());
+    }
+
+    // appends the indices of the rows for which predicate holds; returns
+    // their count
+    size_t filter(const ColumnPredicate& predicate, std::vector<size_t>& indices) const;
+
+    // the count and the sum of the rows for which predicate holds; returns
+    // the number of blocks whose rows were read
+    size_t count_sum(const ColumnPredicate& predicate, uint64_t& count, __int128& sum) const;
+
+    static void unittest();
+};
+
+inline bool LedgerFile::load_commit(const LedgerSlot& slot)
+{
+    if (slot.checksum != ledger_slot_checksum(slot))
+        return false;
+    if (slot.block_count != (slot.value_count + m_block_values - 1) / m_block_values)
+        return false;
+
+    // the segments back from the last, each filling the blocks before the
+    // ones already read
+    const uint64_t size = m_file.size();
+    const uint64_t entry = sizeof(LedgerBlockInfo);
+    m_index.resize(size_t(slot.block_count));
+    m_end = ledger_header_size;
+    uint64_t filled = slot.block_count, offset = slot.index_offset;
+    uint64_t checksum = slot.index_checksum;
+    while (filled > 0)
+    {
+        if (offset < ledger_header_size || offset % 8 != 0 || offset > size ||
+            size - offset < sizeof(LedgerSegment))
+            return false;
+        LedgerSegment segment;
+        std::memcpy(&segment, m_file.data() + offset, sizeof(segment));
+        const uint64_t entries = offset + sizeof(segment);
+        if (ledger_checksum(&segment, sizeof(segment)) != checksum ||
+            segment.first_block >= filled || segment.count > (size - entries) / entry ||
+            segment.first_block + segment.count < filled)
+            return false;
+        const char *data = m_file.data() + entries;
+        if (ledger_checksum(data, size_t(segment.count * entry)) != segment.entries_checksum)
+            return false;
+        if (filled == slot.block_count)
+            m_end = entries + segment.count * entry;
+
+        std::memcpy(&m_index[size_t(segment.first_block)], data,
+                    size_t((filled - segment.first_block) * entry));
+        filled = segment.first_block;
+        if (filled > 0 && segment.previous >= offset)
+            return false;
+        offset = segment.previous;
+        checksum = segment.previous_checksum;
+    }
+
+    // every block but the last is full and within the file
+    for (uint64_t b = 0; b < slot.block_count; ++b)
+    {
+        const LedgerBlockInfo& info = m_index[size_t(b)];
+        const uint64_t count = (b + 1 < slot.block_count)
+                             ? m_block_values
+                             : slot.value_count - b * m_block_values;
+        if (info.count != count || info.offset < ledger_header_size || info.offset % 8 != 0 ||
+            info.offset > size || count > (size - info.offset) / 8)
+            return false;
+    }
+    return true;
+}
+
+inline void LedgerFile::open(const char *path)
+{
+    close();
+    if (!m_file.open(path))
+        throw std::runtime_error("LedgerFile: cannot open file");
+
+    const char *data = m_file.data();
+    uint32_t version, block_values;
+    int32_t scale;
+    if (m_file.size() < ledger_header_size || std::memcmp(data, "KLDG", 4) != 0)
+    {
+        close();
+        throw std::runtime_error("LedgerFile: not a ledger file");
+    }
+    std::memcpy(&version, data + 4, 4);
+    std::memcpy(&scale, data + 8, 4);
+    std::memcpy(&block_values, data + 12, 4);
+    if (version != ledger_version || block_values == 0)
+    {
+        close();
+        throw std::runtime_error("LedgerFile: unsupported version");
+    }
+    m_scale = scale;
+    m_block_values = block_values;
+
+    LedgerSlot slots[2];
+    std::memcpy(&slots[0], data + ledger_slot_offsets[0], sizeof(LedgerSlot));
+    std::memcpy(&slots[1], data + ledger_slot_offsets[1], sizeof(LedgerSlot));
+    const int newer = (slots[1].generation > slots[0].generation) ? 1 : 0;
+    for (int k = 0; k < 2; ++k)
+    {
+        const LedgerSlot& slot = slots[k ? 1 - newer : newer];
+        if (load_commit(slot))
+        {
+            m_slot = slot;
+            return;
+        }
+    }
+    close();
+    throw std::runtime_error("LedgerFile: corrupt file");
+}
+
+inline __int128 LedgerFile::sum_units(size_t first, size_t last) const
+{
+    last = std::min(last, size());
+    __int128 ret = 0;
+    while (first < last)
+    {
+        const size_t b = first / m_block_values;
+        const size_t begin = first % m_block_values;
+        const size_t end = std::min(size_t(m_index[b].count), begin + (last - first));
+        if (begin == 0 && end == m_index[b].count)
+        {
+            ret += m_index[b].sum();
+        }
+        else
+        {
+            const int64_t *units = block_units(b);
+            for (size_t i = begin; i < end; ++i)
+                ret += units[i];
+        }
+        first += end - begin;
+    }
+    return ret;
+}
+
+template <typename Fn, typename Hit>
+inline void LedgerFile::scan(const ColumnPredicate& predicate, Fn fn, Hit hit) const
+{
+    for (size_t b = 0; b < blocks(); ++b)
+    {
+        const LedgerBlockInfo& info = m_index[b];
+        const int whole = predicate.test_range(m_scale, info.min, info.max);
+        if (whole > 0)
+            hit(b);
+        else if (whole == 0)
+            fn(b);
+    }
+}
+
+inline size_t
+LedgerFile::filter(const ColumnPredicate& predicate, std::vector<size_t>& indices) const
+{
+    const size_t start = indices.size();
+    scan(predicate,
+         [&](size_t b)
+         {
+             const int64_t *units = block_units(b);
+             const size_t count = size_t(m_index[b].count);
+             const size_t base = b * m_block_values;
+             for (size_t i = 0; i < count; i += 64)
+             {
+                 const size_t n = std::min<size_t>(64, count - i);
+                 for (uint64_t word = predicate.test_block(units + i, m_scale, n); word;
+                      word &= word - 1)
+                 {
+                     indices.push_back(base + i + size_t(__builtin_ctzll(word)));
+                 }
+             }
+         },
+         [&](size_t b)
+         {
+             const size_t base = b * m_block_values;
+             for (size_t i = 0; i < m_index[b].count; ++i)
+                 indices.push_back(base + i);
+         });
+    return indices.size() - start;
+}
+
+inline size_t
+LedgerFile::count_sum(const ColumnPredicate& predicate, uint64_t& count, __int128& sum) const
+{
+    size_t scanned = 0;
+    count = 0;
+    sum = 0;
+    scan(predicate,
+         [&](size_t b)
+         {
+             const int64_t *units = block_units(b);
+             const size_t n_rows = size_t(m_index[b].count);
+             for (size_t i = 0; i < n_rows; i += 64)
+             {
+                 const size_t n = std::min<size_t>(64, n_rows - i);
+                 uint64_t word = predicate.test_block(units + i, m_scale, n);
+                 count += uint64_t(__builtin_popcountll(word));
+                 for (; word; word &= word - 1)
+                     sum += units[i + size_t(__builtin_ctzll(word))];
+             }
+             ++scanned;
+         },
+         [&](size_t b)
+         {
+             count += m_index[b].count;
+             sum += m_index[b].sum();
+         });
+    return scanned;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// LedgerWriter --- the single writer of a ledger file
+//
+// Opens or creates the file and takes an exclusive lock on it; appended
+// values are kept in memory until commit(). The destructor commits, but
+// errors are only reported by an explicit commit().
+
+class LedgerWriter
+{
+protected:
+#ifdef _WIN32
+    HANDLE m_file;
+#else
+    int m_fd;
+#endif
+    exp10_t m_scale;
+    size_t m_block_values;
+    LedgerSlot m_slot;
+    LedgerBlockInfo m_last;     // the last committed block, if any
+    LedgerSegment m_head;       // the last segment, if any
+    std::vector<int64_t> m_pending;
+    uint64_t m_end;             // of the last commit
+
+    void write_at(uint64_t offset, const void *data, size_t size);
+    void read_at(uint64_t offset, void *data, size_t size);
+    void sync();
+    void create();
+
+public:
+    // throws std::runtime_error if the file cannot be opened or locked, is
+    // corrupt, or has another scale or block size
+    LedgerWriter(const char *path, exp10_t scale = -2, size_t block_values = 4096);
+    ~LedgerWriter();
+
+    LedgerWriter(const LedgerWriter&) = delete;
+    LedgerWriter& operator=(const LedgerWriter&) = delete;
+
+    exp10_t scale() const
+    {
+        return m_scale;
+    }
+    // the committed and the pending values
+    size_t size() const
+    {
+        return size_t(m_slot.value_count) + m_pending.size();
+    }
+    size_t pending() const
+    {
+        return m_pending.size();
+    }
+
+    void append_units(int64_t units)
+    {
+        m_pending.push_back(units);
+    }
+    // throws std::runtime_error if value is finer than the scale, infinite
+    // or too large; nothing is appended then
+    void append(const Currency& value)
+    {
+        int64_t units;
+        if (!currency_to_units(value, m_scale, units))
+            throw std::runtime_error("LedgerWriter: value does not fit the scale");
+        m_pending.push_back(units);
+    }
+    void append(const Currency *values, size_t count);
+    void append(const CurrencyColumn& column);
+
+    // writes the pending values and makes them visible to new readers
+    void commit();
+
+    static void unittest();
+};
+
+inline LedgerWriter::LedgerWriter(const char *path, exp10_t scale, size_t block_values)
+    : m_scale(scale)
+    , m_block_values(block_values)
+    , m_end(ledger_header_size)
+{
+    std::memset(&m_slot, 0, sizeof(m_slot));
+    std::memset(&m_last, 0, sizeof(m_last));
+    std::memset(&m_head, 0, sizeof(m_head));
+    if (block_values == 0 || block_values > 0xFFFFFFFF)
+        throw std::runtime_error("LedgerWriter: invalid block size");
+
+#ifdef _WIN32
+    // no write sharing: one writer at a time
+    m_file = ::CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("LedgerWriter: cannot open file");
+    LARGE_INTEGER size;
+    const bool empty = ::GetFileSizeEx(m_file, &size) && size.QuadPart == 0;
+#else
+    m_fd = ::open(path, O_RDWR | O_CREAT, 0644);
+    if (m_fd == -1)
+        throw std::runtime_error("LedgerWriter: cannot open file");
+    if (::flock(m_fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        ::close(m_fd);
+        throw std::runtime_error("LedgerWriter: file is locked by another writer");
+    }
+    struct stat st;
+    const bool empty = ::fstat(m_fd, &st) == 0 && st.st_size == 0;
+#endif
+
+    try
+    {
+        if (empty)
+        {
+            create();
+            return;
+        }
+        LedgerFile file(path);
+        if (file.scale() != scale || file.block_values() != block_values)
+            throw std::runtime_error("LedgerWriter: scale or block size mismatch");
+        m_slot = file.commit();
+        m_end = file.commit_end();
+        if (file.blocks() > 0)
+        {
+            m_last = file.block(file.blocks() - 1);
+            read_at(m_slot.index_offset, &m_head, sizeof(m_head));
+        }
+    }
+    catch (...)
+    {
+#ifdef _WIN32
+        ::CloseHandle(m_file);
+#else
+        ::close(m_fd);
+#endif
+        throw;
+    }
+}
+
+inline LedgerWriter::~LedgerWriter()
+{
+    try
+    {
+        commit();
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+#ifdef _WIN32
+    ::CloseHandle(m_file);
+#else
+    ::close(m_fd);
+#endif
+}
+
+inline void LedgerWriter::write_at(uint64_t offset, const void *data, size_t size)
+{
+    const char *p = (const char *)data;
+#ifdef _WIN32
+    while (size > 0)
+    {
+        OVERLAPPED ov = {};
+        ov.Offset = DWORD(offset);
+        ov.OffsetHigh = DWORD(offset >> 32);
+        DWORD written;
+        const DWORD chunk = DWORD(std::min<size_t>(size, 1 << 30));
+        if (!::WriteFile(m_file, p, chunk, &written, &ov) || written == 0)
+            throw std::runtime_error("LedgerWriter: write failed");
+        p += written;
+        offset += written;
+        size -= written;
+    }
+#else
+    while (size > 0)
+    {
+        const ssize_t written = ::pwrite(m_fd, p, size, off_t(offset));
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            throw std::runtime_error("LedgerWriter: write failed");
+        p += written;
+        offset += uint64_t(written);
+        size -= size_t(written);
+    }
+#endif
+}
+
+inline void LedgerWriter::read_at(uint64_t offset, void *data, size_t size)
+{
+    char *p = (char *)data;
+#ifdef _WIN32
+    while (size > 0)
+    {
+        OVERLAPPED ov = {};
+        ov.Offset = DWORD(offset);
+        ov.OffsetHigh = DWORD(offset >> 32);
+        DWORD read;
+        const DWORD chunk = DWORD(std::min<size_t>(size, 1 << 30));
+        if (!::ReadFile(m_file, p, chunk, &read, &ov) || read == 0)
+            throw std::runtime_error("LedgerWriter: read failed");
+        p += read;
+        offset += read;
+        size -= read;
+    }
+#else
+    while (size > 0)
+    {
+        const ssize_t read = ::pread(m_fd, p, size, off_t(offset));
+        if (read < 0 && errno == EINTR)
+            continue;
+        if (read <= 0)
+            throw std::runtime_error("LedgerWriter: read failed");
+        p += read;
+        offset += uint64_t(read);
+        size -= size_t(read);
+    }
+#endif
+}
+
+inline void LedgerWriter::sync()
+{
+#ifdef _WIN32
+    if (!::FlushFileBuffers(m_file))
+        throw std::runtime_error("LedgerWriter: sync failed");
+#else
+    if (::fsync(m_fd) != 0)
+        throw std::runtime_error("LedgerWriter: sync failed");
+#endif
+}
+
+inline void LedgerWriter::create()
+{
+    char header[ledger_header_size] = {};
+    const int32_t scale = m_scale;
+    const uint32_t block_values = uint32_t(m_block_values);
+    std::memcpy(header, "KLDG", 4);
+    std::memcpy(header + 4, &ledger_version, 4);
+    std::memcpy(header + 8, &scale, 4);
+    std::memcpy(header + 12, &block_values, 4);
+
+    // an empty commit of generation 0, with no segment
+    m_slot.checksum = ledger_slot_checksum(m_slot);
+    std::memcpy(header + ledger_slot_offsets[0], &m_slot, sizeof(m_slot));
+    write_at(0, header, sizeof(header));
+    sync();
+}
+
+inline void LedgerWriter::append(const Currency *values, size_t count)
+{
+    const size_t start = m_pending.size();
+    m_pending.resize(start + count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!currency_to_units(values[i], m_scale, m_pending[start + i]))
+        {
+            m_pending.resize(start);
+            throw std::runtime_error("LedgerWriter: value does not fit the scale");
+        }
+    }
+}
+
+inline void LedgerWriter::append(const CurrencyColumn& column)
+{
+    const size_t start = m_pending.size();
+    m_pending.resize(start + column.size());
+    const significand_t *significands = column.significands();
+    const exp10_t *exp10s = column.exp10s();
+    for (size_t i = 0; i < column.size(); ++i)
+    {
+        if (exp10s[i] == m_scale)
+        {
+            m_pending[start + i] = significands[i];
+        }
+        else if (!currency_to_units(column[i], m_scale, m_pending[start + i]))
+        {
+            m_pending.resize(start);
+            throw std::runtime_error("LedgerWriter: value does not fit the scale");
+        }
+    }
+}
+
+inline void LedgerWriter::commit()
+{
+    if (m_pending.empty())
+        return;
+
+    // adds n values to the summary of a block
+    auto summarize = [](LedgerBlockInfo& info, const int64_t *values, size_t n) {
+        if (info.count == 0)
+            info.min = info.max = values[0];
+        __int128 sum = info.sum();
+        for (size_t j = 0; j < n; ++j)
+        {
+            info.min = std::min(info.min, values[j]);
+            info.max = std::max(info.max, values[j]);
+            sum += values[j];
+        }
+        info.set_sum(sum);
+        info.count += n;
+    };
+
+    // the last partial block takes the first values in its free space. in
+    // a file whose last segment follows the values of that block directly,
+    // the block is copied into a new one instead.
+    const uint64_t reserved = uint64_t(m_block_values) * 8;
+    uint64_t keep = m_slot.block_count;
+    const int64_t *values = m_pending.data();
+    size_t count = m_pending.size();
+    std::vector<int64_t> copy;
+    std::vector<LedgerBlockInfo> tail;
+    if (keep > 0 && m_last.count < m_block_values)
+    {
+        --keep;
+        if (m_last.offset + reserved <= m_slot.index_offset)
+        {
+            const size_t n = std::min(size_t(m_block_values - m_last.count), count);
+            LedgerBlockInfo info = m_last;
+            write_at(info.offset + info.count * 8, values, n * 8);
+            summarize(info, values, n);
+            tail.push_back(info);
+            values += n;
+            count -= n;
+        }
+        else
+        {
+            copy.resize(size_t(m_last.count));
+            read_at(m_last.offset, copy.data(), copy.size() * 8);
+            copy.insert(copy.end(), m_pending.begin(), m_pending.end());
+            values = copy.data();
+            count = copy.size();
+        }
+    }
+
+    // the new blocks, each with the space of a full one
+    uint64_t pos = m_end;
+    for (size_t i = 0; i < count; i += m_block_values)
+    {
+        const size_t n = std::min(m_block_values, count - i);
+        LedgerBlockInfo info;
+        std::memset(&info, 0, sizeof(info));
+        info.offset = pos;
+        summarize(info, values + i, n);
+        tail.push_back(info);
+        write_at(pos, values + i, n * 8);
+        pos += reserved;
+    }
+
+    // the index segment of the changed blocks only. it links past the last
+    // segment if it replaces all of its blocks, so that every segment in
+    // the chain adds blocks and a reader follows at most one per block.
+    const size_t entries = tail.size() * sizeof(LedgerBlockInfo);
+    LedgerSegment segment;
+    segment.previous = m_slot.index_offset;
+    segment.previous_checksum = m_slot.index_checksum;
+    if (m_slot.block_count > 0 && m_head.first_block == keep)
+    {
+        segment.previous = m_head.previous;
+        segment.previous_checksum = m_head.previous_checksum;
+    }
+    segment.first_block = keep;
+    segment.count = tail.size();
+    segment.entries_checksum = ledger_checksum(tail.data(), entries);
+    write_at(pos, &segment, sizeof(segment));
+    write_at(pos + sizeof(segment), tail.data(), entries);
+
+    LedgerSlot slot;
+    slot.generation = m_slot.generation + 1;
+    slot.value_count = m_slot.value_count + m_pending.size();
+    slot.block_count = keep + tail.size();
+    slot.index_offset = pos;
+    slot.index_checksum = ledger_checksum(&segment, sizeof(segment));
+    slot.checksum = ledger_slot_checksum(slot);
+    sync();
+
+    write_at(ledger_slot_offsets[slot.generation % 2], &slot, sizeof(slot));
+    sync();
+
+    m_slot = slot;
+    m_last = tail.back();
+    m_head = segment;
+    m_end = pos + sizeof(segment) + entries;
+    m_pending.clear();
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,168 @@
+// CurrencyLocale.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyLocale.hpp"
+
+namespace khmz
+{
+
+void locale_unittest()
+{
+    const AmountFormat us = AmountFormat::us();
+    const AmountFormat eu = AmountFormat::european();
+    const AmountFormat jpy('.', ',', false, "JPY", SYMBOL_PREFIX);
+    Currency value;
+
+    assert(parse_amount("$1,234,567.89", us, value) && value == "1234567.89");
+    assert(parse_amount("1.234.567,89 \xE2\x82\xAC", eu, value) && value == "1234567.89");
+    assert(parse_amount("(1,234.00)", us, value) && value == "-1234");
+    assert(parse_amount("JPY 120000", jpy, value) && value == "120000");
+    assert(parse_amount("  -$ 12.5 ", us, value) && value == "-12.5");
+    assert(parse_amount("$-0.01", us, value) && value == "-0.01");
+    assert(parse_amount("($5)", us, value) && value == "-5");
+    assert(parse_amount("12 $", us, value) && value == "12");
+    assert(parse_amount("999", us, value) && value == "999");
+    assert(parse_amount(".5", us, value) && value == "0.5");
+    assert(parse_amount("-0", us, value) && value.is_zero());
+
+    // long digit runs go through the eight-digit path
+    assert(parse_amount("1234567890123456.78", us, value) && value == "1234567890123456.78");
+    assert(parse_amount("0.123456789012345678901234", us, value) &&
+           value == "0.1234567890123456789");
+    assert(parse_amount("123456789012345678901234", us, value) && value.is_inf());
+    // at the bound of the eight-digit path: the last digits are truncated
+    assert(parse_amount("92233720368.99999999", us, value) && value == "92233720368.9999999");
+    assert(parse_amount("92,233,720,368.99999999", us, value) &&
+           value == "92233720368.9999999");
+    assert(parse_amount("92233720367.99999999", us, value) && value == "92233720367.99999999");
+    assert(parse_amount("922337203685477580.7", us, value) &&
+           value == Currency(max_significand, -1));
+    assert(parse_amount("-92233720368.54775808", us, value) && value == "-92233720368.5477580");
+
+    // errors and their positions
+    ParseResult r = parse_amount("", us, value);
+    assert(!r && r.status == PARSE_EMPTY);
+    r = parse_amount("$1,23,456.00", us, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 2);
+    r = parse_amount("1,234,56", us, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 5);
+    r = parse_amount("1,234567890", us, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 1);
+    r = parse_amount("12345,678.00", us, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 5);
+    r = parse_amount("123456789,123", us, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 9);
+    r = parse_amount(",123", us, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 0);
+    r = parse_amount("1.234,5", us, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 5);
+    r = parse_amount("1.2.3", us, value);
+    assert(!r && r.status == PARSE_MULTIPLE_DECIMALS && r.position == 3);
+    r = parse_amount("(1.00", us, value);
+    assert(!r && r.status == PARSE_UNBALANCED_PARENTHESES && r.position == 5);
+    r = parse_amount("12x4", us, value);
+    assert(!r && r.status == PARSE_INVALID_CHARACTER && r.position == 2);
+    assert(std::strcmp(r.message(), "invalid character") == 0);
+    r = parse_amount("$", us, value);
+    assert(!r && r.status == PARSE_MISSING_DIGITS);
+    r = parse_amount("EUR 5", us, value);
+    assert(!r && r.status == PARSE_INVALID_CHARACTER && r.position == 0);
+    r = parse_amount("(1,234.00)", jpy, value);
+    assert(!r && r.status == PARSE_INVALID_CHARACTER && r.position == 0);
+
+    // spaces as group separators, between digits only
+    const AmountFormat spaced(',', ' ', true, "EUR");
+    assert(parse_amount("1 234,56 EUR", spaced, value) && value == "1234.56");
+    assert(parse_amount(" -1 234 567 ", spaced, value) && value == "-1234567");
+    r = parse_amount("1 2345", spaced, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 1);
+    r = parse_amount("1 ,5", spaced, value);
+    assert(!r && r.status == PARSE_MISPLACED_GROUP && r.position == 1);
+
+    // loose grouping, e.g. Indian lakhs
+    const AmountFormat loose('.', ',', true, "", SYMBOL_NONE, false);
+    assert(parse_amount("12,34,567.5", loose, value) && value == "1234567.5");
+
+    bool thrown = false;
+    try
+    {
+        AmountFormat bad('.', '.');
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // formatting
+    auto format = [](const Currency& v, const FormatSpec& spec) {
+        char buf[128];
+        char *end = format_to(buf, v, spec);
+        assert(size_t(end - buf) == formatted_size(v, spec));
+        return std::string(buf, end);
+    };
+    FormatSpec spec;
+    assert(format(Currency("1234567.891"), spec) == "1,234,567.89");
+    assert(format(Currency("-1234567.895"), spec) == "-1,234,567.90");
+    assert(format(Currency("0.125"), spec) == "0.12");
+    assert(format(Currency("-0.001"), spec) == "0.00");
+    assert(format(Currency(12), spec) == "12.00");
+    assert(format(Currency(100), spec) == "100.00");
+    assert(format(Currency(1000), spec) == "1,000.00");
+    assert(format(Currency(0), spec) == "0.00");
+    assert(format(Currency(1, 20), spec) == "100,000,000,000,000,000,000.00");
+    assert(format(Currency(1, 70), spec) ==
+           "10,000,000,000,000,000,000,000,000,000,000,000,000,000,000,000,000,000,000,000,000,"
+           "000,000,000.00");
+    assert(format(Currency(5, -30), spec) == "0.00");
+
+    spec.rounding = ROUND_HALF_UP;
+    assert(format(Currency("0.125"), spec) == "0.13");
+    spec.rounding = ROUND_UP;
+    assert(format(Currency(5, -30), spec) == "0.01");
+
+    FormatSpec accounting(2, '.', ',', 12, NEGATIVE_PARENTHESES);
+    assert(format(Currency("-1234"), accounting) == "  (1,234.00)");
+    assert(format(Currency("1234"), accounting) == "   1,234.00 ");
+    accounting.prefix = "$";
+    assert(format(Currency("-5"), accounting) == "     $(5.00)");
+
+    FormatSpec european(2, ',', '.');
+    european.suffix = " \xE2\x82\xAC";
+    assert(format(Currency("1234567.89"), european) == "1.234.567,89 \xE2\x82\xAC");
+    assert(parse_amount(format(Currency("-1234567.89"), european).c_str(), eu, value) &&
+           value == "-1234567.89");
+
+    FormatSpec plain(-1, '.', 0);
+    assert(format(Currency("1234.5678"), plain) == "1234.5678");
+    assert(format(Currency(-3, 2), plain) == "-300");
+    FormatSpec whole(0);
+    assert(format(Currency("2.5"), whole) == "2");
+    assert(format(Currency("-1234.5"), whole) == "-1,234");
+    Currency inf;
+    inf.set_inf(true);
+    assert(format(inf, spec) == "-inf");
+
+    char small[8];
+    assert(format_to(small, small + sizeof(small), Currency(1000000), FormatSpec()) == NULL);
+    char *end = format_to(small, small + sizeof(small), Currency(1000), FormatSpec());
+    assert(end && std::string(small, end) == "1,000.00");
+
+    CurrencyColumn column;
+    column.push_back(Currency("1.5"));
+    column.push_back(Currency("-20"));
+    column.push_back(Currency("12345.678"));
+    std::vector<char> out;
+    assert(format_column(column, FormatSpec(2, '.', ',', 10), '\n', out) == 33);
+    assert(std::string(out.begin(), out.end()) == "      1.50\n    -20.00\n 12,345.68\n");
+    const Currency values[] = { Currency(1), Currency(2) };
+    out.clear();
+    format_column(values, 2, FormatSpec(0), ';', out);
+    assert(std::string(out.begin(), out.end()) == "1;2;");
+
+    puts("locale_unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,635 @@
+// CurrencyLocale.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyBcd.hpp"
+#include "CurrencyColumn.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+void locale_unittest();
+
+//////////////////////////////////////////////////////////////////////////////
+// AmountFormat
+//
+// Describes how amounts are written: the decimal and group separators,
+// whether "(1.00)" means -1.00, and a currency symbol (e.g. "$", "€" in
+// UTF-8, "JPY") that may precede or follow the number, with or without
+// spaces. A leading '-' or '+' is accepted before or after a prefix symbol.
+// The characters are classified once into a table at construction.
+
+enum SymbolPosition
+{
+    SYMBOL_NONE,
+    SYMBOL_PREFIX,
+    SYMBOL_SUFFIX,
+    SYMBOL_EITHER
+};
+
+class AmountFormat
+{
+public:
+    enum CharClass
+    {
+        CHAR_OTHER,
+        CHAR_DIGIT,
+        CHAR_DECIMAL,
+        CHAR_GROUP,
+        CHAR_SPACE
+    };
+
+protected:
+    unsigned char m_classes[256];
+    char m_decimal;
+    char m_group;
+    bool m_parentheses;
+    bool m_strict_grouping;
+    SymbolPosition m_symbol_position;
+    char m_symbol[16];
+    size_t m_symbol_size;
+
+public:
+    // group may be 0 for none, or a space that separates groups only
+    // between digits. with strict_grouping, the first group has one to
+    // three digits and the groups after it exactly three.
+    explicit AmountFormat(char decimal = '.', char group = ',', bool parentheses = true,
+                          const char *symbol = "", SymbolPosition position = SYMBOL_EITHER,
+                          bool strict_grouping = true)
+        : m_decimal(decimal)
+        , m_group(group)
+        , m_parentheses(parentheses)
+        , m_strict_grouping(strict_grouping)
+        , m_symbol_position(*symbol ? position : SYMBOL_NONE)
+        , m_symbol_size(std::strlen(symbol))
+    {
+        if (decimal == group || m_symbol_size >= sizeof(m_symbol))
+            throw std::runtime_error("AmountFormat: invalid format");
+        std::memcpy(m_symbol, symbol, m_symbol_size + 1);
+
+        std::memset(m_classes, CHAR_OTHER, sizeof(m_classes));
+        for (int c = '0'; c <= '9'; ++c)
+            m_classes[c] = CHAR_DIGIT;
+        m_classes[(unsigned char)' '] = CHAR_SPACE;
+        m_classes[(unsigned char)'\t'] = CHAR_SPACE;
+        if (group && m_classes[(unsigned char)group] != CHAR_SPACE)
+            m_classes[(unsigned char)group] = CHAR_GROUP;
+        m_classes[(unsigned char)decimal] = CHAR_DECIMAL;
+    }
+
+    // "$1,234.56"
+    static AmountFormat us(const char *symbol = "$")
+    {
+        return AmountFormat('.', ',', true, symbol, SYMBOL_EITHER);
+    }
+    // "1.234,56 €"
+    static AmountFormat european(const char *symbol = "\xE2\x82\xAC")
+    {
+        return AmountFormat(',', '.', true, symbol, SYMBOL_EITHER);
+    }
+
+    CharClass char_class(char ch) const
+    {
+        return CharClass(m_classes[(unsigned char)ch]);
+    }
+    char decimal() const
+    {
+        return m_decimal;
+    }
+    char group() const
+    {
+        return m_group;
+    }
+    bool parentheses() const
+    {
+        return m_parentheses;
+    }
+    bool strict_grouping() const
+    {
+        return m_strict_grouping;
+    }
+    SymbolPosition symbol_position() const
+    {
+        return m_symbol_position;
+    }
+    const char *symbol() const
+    {
+        return m_symbol;
+    }
+    size_t symbol_size() const
+    {
+        return m_symbol_size;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// parse_amount
+//
+// Parses [first, last) in one pass without allocating. Runs of eight digits
+// are validated and converted at once (SWAR); separators are handled by the
+// class table. Digits beyond the precision of the fraction are truncated;
+// an integer part that overflows yields inf, like UnsignedCurrency::parse.
+
+enum ParseStatus
+{
+    PARSE_OK,
+    PARSE_EMPTY,
+    PARSE_INVALID_CHARACTER,
+    PARSE_MISPLACED_GROUP,
+    PARSE_MULTIPLE_DECIMALS,
+    PARSE_UNBALANCED_PARENTHESES,
+    PARSE_MISSING_DIGITS
+};
+
+inline const char *parse_status_message(ParseStatus status)
+{
+    switch (status)
+    {
+    case PARSE_OK:                      return "ok";
+    case PARSE_EMPTY:                   return "empty input";
+    case PARSE_INVALID_CHARACTER:       return "invalid character";
+    case PARSE_MISPLACED_GROUP:         return "misplaced group separator";
+    case PARSE_MULTIPLE_DECIMALS:       return "more than one decimal separator";
+    case PARSE_UNBALANCED_PARENTHESES:  return "unbalanced parentheses";
+    case PARSE_MISSING_DIGITS:          return "no digits";
+    }
+    return "unknown";
+}
+
+struct ParseResult
+{
+    ParseStatus status;
+    size_t position;    // of the offending character, from first
+
+    ParseResult(ParseStatus status_ = PARSE_OK, size_t position_ = 0)
+        : status(status_)
+        , position(position_)
+    {
+    }
+
+    operator bool() const
+    {
+        return status == PARSE_OK;
+    }
+    const char *message() const
+    {
+        return parse_status_message(status);
+    }
+};
+
+inline ParseResult
+parse_amount(const char *first, const char *last, const AmountFormat& format, Currency& out)
+{
+    const char *const begin = first;
+    bool negative = false, has_sign = false;
+
+    // trims the spaces of both ends
+    auto trim = [&]() {
+        while (first != last && format.char_class(*first) == AmountFormat::CHAR_SPACE)
+            ++first;
+        while (first != last && format.char_class(last[-1]) == AmountFormat::CHAR_SPACE)
+            --last;
+    };
+    auto take_sign = [&]() {
+        if (!has_sign && first != last && (*first == '-' || *first == '+'))
+        {
+            negative = (*first == '-');
+            has_sign = true;
+            ++first;
+            trim();
+        }
+    };
+
+    trim();
+    if (first == last)
+        return ParseResult(PARSE_EMPTY, size_t(first - begin));
+
+    if (format.parentheses() && (*first == '(' || last[-1] == ')'))
+    {
+        if (*first != '(' || last[-1] != ')' || last - first < 2)
+        {
+            size_t position = (*first == '(') ? size_t(last - begin) : size_t(first - begin);
+            return ParseResult(PARSE_UNBALANCED_PARENTHESES, position);
+        }
+        negative = has_sign = true;
+        ++first;
+        --last;
+        trim();
+    }
+
+    const size_t symbol_size = format.symbol_size();
+    const SymbolPosition position = format.symbol_position();
+    take_sign();
+    if ((position == SYMBOL_PREFIX || position == SYMBOL_EITHER) &&
+        size_t(last - first) >= symbol_size &&
+        std::memcmp(first, format.symbol(), symbol_size) == 0)
+    {
+        first += symbol_size;
+        trim();
+        take_sign();
+    }
+    else if ((position == SYMBOL_SUFFIX || position == SYMBOL_EITHER) &&
+             size_t(last - first) >= symbol_size &&
+             std::memcmp(last - symbol_size, format.symbol(), symbol_size) == 0)
+    {
+        last -= symbol_size;
+        trim();
+    }
+
+    uint64_t sig = 0;
+    int64_t frac_digits = 0;
+    bool found_digit = false, found_decimal = false, truncated = false, overflow = false;
+    size_t group_digits = 0;        // integer digits since the last group separator
+    const char *group_at = nullptr; // the last group separator
+    const char *ptr = first;
+    while (ptr != last)
+    {
+        // eight digits at once while they fit, whatever the digits are
+        if (last - ptr >= 8 && !truncated && !overflow &&
+            sig <= uint64_t(max_significand - 99999999) / 100000000)
+        {
+            uint64_t x = bcd_load_be64((const unsigned char *)ptr);
+            uint64_t d = x & 0x0F0F0F0F0F0F0F0FULL;
+            if ((x & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL &&
+                ((d + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == 0)
+            {
+                sig = sig * 100000000 + digits_to_binary8(d);
+                if (found_decimal)
+                    frac_digits += 8;
+                else
+                    group_digits += 8;
+                found_digit = true;
+                ptr += 8;
+                continue;
+            }
+        }
+
+        const char ch = *ptr;
+        switch (format.char_class(ch))
+        {
+        case AmountFormat::CHAR_DIGIT:
+            found_digit = true;
+            if (!found_decimal)
+                ++group_digits;
+            if (overflow || truncated)
+                break;
+            {
+                uint64_t next;
+                if (__builtin_mul_overflow(sig, 10, &next) ||
+                    __builtin_add_overflow(next, uint64_t(ch - '0'), &next) ||
+                    next > uint64_t(max_significand))
+                {
+                    if (found_decimal)
+                        truncated = true;
+                    else
+                        overflow = true;
+                    break;
+                }
+                sig = next;
+                if (found_decimal)
+                    ++frac_digits;
+            }
+            break;
+
+        case AmountFormat::CHAR_SPACE:
+            if (ch != format.group())
+                return ParseResult(PARSE_INVALID_CHARACTER, size_t(ptr - begin));
+            // fall through
+        case AmountFormat::CHAR_GROUP:
+            if (found_decimal || !found_digit ||
+                ptr + 1 == last ||
+                format.char_class(ptr[1]) != AmountFormat::CHAR_DIGIT)
+            {
+                return ParseResult(PARSE_MISPLACED_GROUP, size_t(ptr - begin));
+            }
+            // a bad group is reported at the separator before it, the
+            // leading one at the separator after it
+            if (format.strict_grouping() && (group_at ? group_digits != 3 : group_digits > 3))
+                return ParseResult(PARSE_MISPLACED_GROUP, size_t((group_at ? group_at : ptr) - begin));
+            group_at = ptr;
+            group_digits = 0;
+            break;
+
+        case AmountFormat::CHAR_DECIMAL:
+            if (found_decimal)
+                return ParseResult(PARSE_MULTIPLE_DECIMALS, size_t(ptr - begin));
+            if (format.strict_grouping() && group_at && group_digits != 3)
+                return ParseResult(PARSE_MISPLACED_GROUP, size_t(group_at - begin));
+            found_decimal = true;
+            break;
+
+        default:
+            return ParseResult(PARSE_INVALID_CHARACTER, size_t(ptr - begin));
+        }
+        ++ptr;
+    }
+
+    if (!found_digit)
+        return ParseResult(PARSE_MISSING_DIGITS, size_t(ptr - begin));
+    if (format.strict_grouping() && !found_decimal && group_at && group_digits != 3)
+        return ParseResult(PARSE_MISPLACED_GROUP, size_t(group_at - begin));
+
+    if (overflow)
+    {
+        out.set_inf(negative);
+        return ParseResult();
+    }
+    significand_t value = significand_t(sig);
+    out = Currency(negative ? -value : value, exp10_t(-frac_digits));
+    return ParseResult();
+}
+
+inline ParseResult
+parse_amount(const char *str, const AmountFormat& format, Currency& out)
+{
+    return parse_amount(str, str + std::strlen(str), format, out);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// FormatSpec
+//
+// How format_to writes an amount: a fixed number of decimals (rounded with
+// rounding; a negative count keeps the digits of the value), the separators,
+// a right-aligned field width, and minus or accounting negatives. In the
+// accounting style "(1,234.00)" is negative and a positive amount gets a
+// trailing space so that the digits of a column line up. prefix and suffix
+// (e.g. "$") are not copied and must outlive the spec.
+
+enum NegativeStyle
+{
+    NEGATIVE_MINUS,         // -1,234.00
+    NEGATIVE_PARENTHESES    // (1,234.00)
+};
+
+struct FormatSpec
+{
+    int decimals;
+    char decimal;
+    char group;             // 0 for none
+    size_t width;
+    char fill;
+    NegativeStyle negative;
+    RoundingMode rounding;
+    const char *prefix;
+    const char *suffix;
+
+    explicit FormatSpec(int decimals_ = 2, char decimal_ = '.', char group_ = ',',
+                        size_t width_ = 0, NegativeStyle negative_ = NEGATIVE_MINUS)
+        : decimals(decimals_)
+        , decimal(decimal_)
+        , group(group_)
+        , width(width_)
+        , fill(' ')
+        , negative(negative_)
+        , rounding(ROUND_HALF_EVEN)
+        , prefix("")
+        , suffix("")
+    {
+    }
+};
+
+// "00" to "99"
+inline const char *digit_pairs()
+{
+    static const char s_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    return s_pairs;
+}
+
+// the rounded digits of an amount: the decimal digits of units followed by
+// zeros zeros, with decimals of them after the decimal separator
+struct FormattedAmount
+{
+    uint64_t units;
+    uint64_t zeros;
+    size_t unit_digits;
+    size_t int_digits;      // at least one
+    size_t decimals;
+    bool negative;
+    bool inf;
+    size_t size;            // in chars, before padding
+
+    FormattedAmount(const Currency& value, const FormatSpec& spec);
+};
+
+inline FormattedAmount::FormattedAmount(const Currency& value, const FormatSpec& spec)
+    : units(0)
+    , zeros(0)
+    , unit_digits(1)
+    , int_digits(1)
+    , decimals(0)
+    , negative(value.is_negative())
+    , inf(value.is_inf())
+{
+    size = std::strlen(spec.prefix) + std::strlen(spec.suffix);
+    if (inf)
+    {
+        size += 3 + size_t(negative) + (spec.negative == NEGATIVE_PARENTHESES);
+        return;
+    }
+
+    const int64_t e10 = value.exp10();
+    decimals = (spec.decimals >= 0) ? size_t(spec.decimals)
+                                    : size_t(std::max<int64_t>(0, -e10));
+
+    // units * 10^zeros = value * 10^decimals, rounded
+    const uint64_t sig = uint64_t(value.base().significand());
+    const int64_t shift = e10 + int64_t(decimals);
+    if (shift >= 0)
+    {
+        units = sig;
+        zeros = sig ? uint64_t(shift) : 0;
+    }
+    else
+    {
+        uint64_t r = sig;
+        int half_cmp = -1;
+        if (shift >= -19)
+        {
+            const uint64_t p = pow10_u64(int(-shift));
+            units = sig / p;
+            r = sig % p;
+            half_cmp = half_compare(r, p);
+        }
+        if (round_increment(spec.rounding, units & 1, half_cmp, r != 0, negative))
+            ++units;
+    }
+    if (units == 0)
+        negative = false;   // no "-0.00"
+
+    // log10 from the bit width, off by at most one
+    const int bits = 64 - __builtin_clzll(units | 1);
+    unit_digits = size_t((bits * 1233) >> 12);
+    if (unit_digits < 20 && units >= pow10_u64(int(unit_digits)))
+        ++unit_digits;
+    const uint64_t digits = std::max<uint64_t>(unit_digits + zeros, decimals + 1);
+    int_digits = size_t(digits - decimals);
+
+    size += size_t(digits) + (decimals ? 1 : 0) + size_t(negative);
+    if (spec.negative == NEGATIVE_PARENTHESES)
+        ++size;
+    if (spec.group)
+        size += (int_digits - 1) / 3;
+}
+
+// the number of chars format_to writes for value
+inline size_t formatted_size(const Currency& value, const FormatSpec& spec)
+{
+    FormattedAmount amount(value, spec);
+    return std::max(amount.size, spec.width);
+}
+
+// writes value at out, which must have room for formatted_size(value, spec)
+// chars, and returns the end. nothing is allocated.
+inline char *format_to(char *out, const FormattedAmount& amount, const FormatSpec& spec)
+{
+    if (amount.size < spec.width)
+        out = std::fill_n(out, spec.width - amount.size, spec.fill);
+    for (const char *p = spec.prefix; *p; ++p)
+        *out++ = *p;
+    if (amount.negative)
+        *out++ = (spec.negative == NEGATIVE_PARENTHESES) ? '(' : '-';
+
+    if (amount.inf)
+    {
+        std::memcpy(out, "inf", 3);
+        out += 3;
+    }
+    else
+    {
+        // the digits, left-padded with zeros to int_digits + decimals
+        const size_t count = amount.int_digits + amount.decimals;
+        // a huge exponent leaves digits NULL: at most 20 significant digits
+        // and then zeros, produced one by one
+        char buf[64];
+        char *digits = (count <= sizeof(buf)) ? buf : NULL;
+        if (digits)
+        {
+            const size_t tail = size_t(std::min<uint64_t>(amount.zeros, count));
+            std::memset(buf, '0', count);
+            char *ptr = buf + count - tail;
+            uint64_t units = amount.units;
+            const char *pairs = digit_pairs();
+            while (units >= 100)
+            {
+                ptr -= 2;
+                std::memcpy(ptr, pairs + (units % 100) * 2, 2);
+                units /= 100;
+            }
+            if (units >= 10)
+            {
+                ptr -= 2;
+                std::memcpy(ptr, pairs + units * 2, 2);
+            }
+            else
+            {
+                *--ptr = char('0' + units);
+            }
+        }
+
+        // digit i of the padded sequence
+        const uint64_t lead = count - amount.unit_digits - amount.zeros;
+        auto digit_at = [&](size_t i) -> char {
+            if (i < lead || i >= lead + amount.unit_digits)
+                return '0';
+            uint64_t d = amount.units / pow10_u64(int(lead + amount.unit_digits - 1 - i));
+            return char('0' + d % 10);
+        };
+        auto copy = [&](size_t from, size_t n) {
+            if (digits)
+            {
+                std::memcpy(out, digits + from, n);
+                out += n;
+            }
+            else
+            {
+                for (size_t i = 0; i < n; ++i)
+                    *out++ = digit_at(from + i);
+            }
+        };
+
+        // the integer part in groups of three
+        size_t first = amount.int_digits;
+        if (spec.group)
+            first = (amount.int_digits - 1) % 3 + 1;
+        copy(0, first);
+        for (size_t i = first; i < amount.int_digits; i += 3)
+        {
+            *out++ = spec.group;
+            copy(i, 3);
+        }
+        if (amount.decimals)
+        {
+            *out++ = spec.decimal;
+            copy(amount.int_digits, amount.decimals);
+        }
+    }
+
+    if (spec.negative == NEGATIVE_PARENTHESES)
+        *out++ = amount.negative ? ')' : ' ';
+    for (const char *p = spec.suffix; *p; ++p)
+        *out++ = *p;
+    return out;
+}
+
+inline char *format_to(char *out, const Currency& value, const FormatSpec& spec)
+{
+    return format_to(out, FormattedAmount(value, spec), spec);
+}
+
+// bounded variant; returns NULL if the output does not fit into [first, last)
+inline char *format_to(char *first, char *last, const Currency& value, const FormatSpec& spec)
+{
+    FormattedAmount amount(value, spec);
+    if (size_t(last - first) < std::max(amount.size, spec.width))
+        return NULL;
+    return format_to(first, amount, spec);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// format_column
+//
+// Appends values[0] to values[count - 1] (a Currency array, or anything
+// indexed like one) to out, a std::vector<char> or std::string, each
+// followed by delimiter (e.g. '\n'). They are written straight into the
+// buffer, which grows geometrically. Returns the number of chars appended.
+
+template <typename Values, typename Buffer>
+inline size_t
+format_column(const Values& values, size_t count, const FormatSpec& spec, char delimiter,
+              Buffer& out)
+{
+    const size_t start = out.size();
+    size_t used = start;
+    out.resize(start + count * (std::max<size_t>(spec.width, 16) + 1));
+    for (size_t i = 0; i < count; ++i)
+    {
+        FormattedAmount amount(values[i], spec);
+        const size_t size = std::max(amount.size, spec.width) + 1;
+        if (out.size() - used < size)
+            out.resize(std::max(out.size() * 2, used + size));
+        char *end = format_to(&out[used], amount, spec);
+        *end++ = delimiter;
+        used = size_t(end - &out[0]);
+    }
+    out.resize(used);
+    return used - start;
+}
+
+template <typename Buffer>
+inline size_t
+format_column(const CurrencyColumn& column, const FormatSpec& spec, char delimiter,
+              Buffer& out)
+{
+    return format_column(column, column.size(), spec, delimiter, out);
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
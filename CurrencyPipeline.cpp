@@ -0,0 +1,105 @@
+// CurrencyPipeline.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyPipeline.hpp"
+
+namespace khmz
+{
+
+void CurrencyPipeline::unittest()
+{
+    BoundedQueue<int> queue(3, 2);
+    int value;
+    assert(queue.try_push(1) && queue.try_push(2) && queue.try_push(3) && queue.try_push(4));
+    assert(!queue.try_push(5));
+    assert(queue.try_pop(value) && value == 1);
+    assert(queue.try_push(5));
+    queue.producer_done();
+    queue.producer_done();
+    for (int i = 2; i <= 5; ++i)
+        assert(queue.pop(value) && value == i);
+    assert(!queue.try_pop(value) && !queue.pop(value));
+
+    // many producers and consumers
+    {
+        BoundedQueue<int> mpmc(16, 4);
+        std::atomic<long> sum(0);
+        std::vector<std::thread> threads;
+        for (int p = 0; p < 4; ++p)
+        {
+            threads.emplace_back([&mpmc, p]() {
+                for (int i = 1; i <= 10000; ++i)
+                    mpmc.push(p * 10000 + i);
+                mpmc.producer_done();
+            });
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            threads.emplace_back([&]() {
+                int v;
+                while (mpmc.pop(v))
+                    sum += v;
+            });
+        }
+        for (size_t i = 0; i < threads.size(); ++i)
+            threads[i].join();
+        assert(sum == 40000L * 40001 / 2);
+    }
+
+    // parse -> convert -> round -> format, in order
+    std::string input;
+    for (int i = 0; i < 20000; ++i)
+        input += (i % 1000 == 7) ? "bad\n" : "$" + std::to_string(i) + ".25\n";
+
+    const FxConversion conversion(Currency("1.5"), Currency(1), -2);
+    CurrencyPipeline pipeline(8);
+    pipeline.add_stage(parse_stage(AmountFormat::us()), 2)
+            .add_stage(convert_stage(conversion), 3)
+            .add_stage(round_stage(0, ROUND_HALF_UP), 1)
+            .add_stage(format_stage(FormatSpec(0, '.', 0)), 2);
+
+    std::string output;
+    size_t invalid = 0, last_sequence = 0;
+    pipeline.run(text_source(input.data(), input.data() + input.size(), 100),
+                 [&](const PipelineBatch& batch) {
+        assert(batch.sequence == 0 || batch.sequence == last_sequence + 1);
+        last_sequence = batch.sequence;
+        output += batch.text;
+        invalid += batch.invalid.size();
+    });
+    assert(invalid == 20);
+
+    std::string expected;
+    for (int i = 0; i < 20000; ++i)
+    {
+        Currency value = (i % 1000 == 7) ? Currency() : Currency(i) + Currency("0.25");
+        value = conversion.convert(value);
+        value.round(0, ROUND_HALF_UP);
+        expected += value.to_string() + "\n";
+    }
+    assert(output == expected);
+
+    // a failing stage stops the pipeline and rethrows
+    CurrencyPipeline failing;
+    failing.add_stage(parse_stage(), 2).add_stage([](PipelineBatch& batch) {
+        if (batch.sequence == 3)
+            throw std::runtime_error("stage failed");
+    }, 2);
+    bool thrown = false;
+    try
+    {
+        failing.run(text_source(input.data(), input.data() + input.size(), 10),
+                    [](const PipelineBatch&) {});
+    }
+    catch (const std::runtime_error& e)
+    {
+        thrown = std::string(e.what()) == "stage failed";
+    }
+    assert(thrown);
+
+    puts("CurrencyPipeline::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,425 @@
+// CurrencyPipeline.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "CurrencyFx.hpp"
+#include "CurrencyLocale.hpp"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// BoundedQueue
+//
+// A bounded lock-free multi-producer multi-consumer queue (a ring of cells
+// with sequence numbers). try_push fails when full and try_pop when empty.
+// The producers register themselves, so that the consumers of pop can tell
+// an empty queue from a finished one.
+
+template <typename T>
+class BoundedQueue
+{
+protected:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // the counters on separate cache lines
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    char m_pad0[64];
+    std::atomic<size_t> m_head;     // the next push
+    char m_pad1[64];
+    std::atomic<size_t> m_tail;     // the next pop
+    char m_pad2[64];
+    std::atomic<size_t> m_producers;
+
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedQueue(size_t capacity, size_t producers = 1)
+        : m_head(0)
+        , m_tail(0)
+        , m_producers(producers)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        m_cells.reset(new Cell[size]);
+        m_mask = size - 1;
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool try_push(const T& value)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == pos)
+            {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < pos)
+            {
+                return false;   // full
+            }
+            else
+            {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == pos + 1)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < pos + 1)
+            {
+                return false;   // empty
+            }
+            else
+            {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // waits while the queue is full
+    void push(const T& value)
+    {
+        for (unsigned int spins = 0; !try_push(value); )
+            backoff(spins);
+    }
+
+    // waits for a value; false once the queue is empty and every producer
+    // has called producer_done
+    bool pop(T& value)
+    {
+        for (unsigned int spins = 0; ; )
+        {
+            if (try_pop(value))
+                return true;
+            if (m_producers.load(std::memory_order_acquire) == 0)
+                return try_pop(value);
+            backoff(spins);
+        }
+    }
+
+    void producer_done()
+    {
+        m_producers.fetch_sub(1, std::memory_order_release);
+    }
+
+    // spins, then yields, then sleeps
+    static void backoff(unsigned int& spins)
+    {
+        if (++spins < 64)
+            return;
+        if (spins < 256)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyPipeline
+//
+// Runs batches of amounts through stages (e.g. parse, convert, round,
+// format), each on its own workers, with lock-free queues between them.
+// A fixed pool of batches circulates, which bounds the memory and makes a
+// fast source wait for slow stages (backpressure); the batches keep their
+// buffers, so the steady state does not allocate. The sink receives the
+// batches in input order. If a stage, the source or the sink throws, the
+// pipeline stops taking input, drains, and run rethrows the first exception.
+
+struct PipelineBatch
+{
+    size_t sequence;
+    std::string text;               // lines separated by '\n'
+    CurrencyColumn values;
+    std::vector<size_t> invalid;    // indices of the values that failed
+
+    void clear()
+    {
+        text.clear();
+        values.clear();
+        invalid.clear();
+    }
+};
+
+class CurrencyPipeline
+{
+public:
+    typedef std::function<void(PipelineBatch&)> Stage;
+    typedef std::function<bool(PipelineBatch&)> Source;   // false at the end
+    typedef std::function<void(const PipelineBatch&)> Sink;
+
+protected:
+    struct StageInfo
+    {
+        Stage stage;
+        unsigned int workers;
+    };
+
+    std::vector<StageInfo> m_stages;
+    size_t m_batches;
+
+public:
+    // batches is the number of batches in flight; 0 for twice the workers
+    explicit CurrencyPipeline(size_t batches = 0)
+        : m_batches(batches)
+    {
+    }
+
+    // workers 0 for one per hardware thread
+    CurrencyPipeline& add_stage(const Stage& stage, unsigned int workers = 1)
+    {
+        StageInfo info = { stage, workers ? workers
+                                          : std::max(1U, std::thread::hardware_concurrency()) };
+        m_stages.push_back(info);
+        return *this;
+    }
+
+    void run(const Source& source, const Sink& sink);
+
+    static void unittest();
+};
+
+inline void CurrencyPipeline::run(const Source& source, const Sink& sink)
+{
+    size_t workers = 0;
+    for (size_t i = 0; i < m_stages.size(); ++i)
+        workers += m_stages[i].workers;
+    const size_t batches = m_batches ? m_batches : 2 * workers + 2;
+
+    std::vector<std::unique_ptr<PipelineBatch> > pool;
+    BoundedQueue<PipelineBatch *> idle(batches);
+    for (size_t i = 0; i < batches; ++i)
+    {
+        pool.emplace_back(new PipelineBatch());
+        idle.push(pool.back().get());
+    }
+
+    // queues[i] feeds stage i, and queues.back() the sink
+    std::vector<std::unique_ptr<BoundedQueue<PipelineBatch *> > > queues;
+    queues.emplace_back(new BoundedQueue<PipelineBatch *>(batches, 1));
+    for (size_t i = 0; i < m_stages.size(); ++i)
+        queues.emplace_back(new BoundedQueue<PipelineBatch *>(batches, m_stages[i].workers));
+
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto fail = [&]() {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+            error = std::current_exception();
+        failed.store(true);
+    };
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        for (size_t sequence = 0; ; ++sequence)
+        {
+            PipelineBatch *batch = NULL;
+            if (!idle.pop(batch))
+                break;
+            batch->clear();
+            batch->sequence = sequence;
+            bool more = false;
+            if (!failed.load())
+            {
+                try
+                {
+                    more = source(*batch);
+                }
+                catch (...)
+                {
+                    fail();
+                }
+            }
+            if (!more)
+            {
+                idle.push(batch);
+                break;
+            }
+            queues[0]->push(batch);
+        }
+        queues[0]->producer_done();
+    });
+    for (size_t i = 0; i < m_stages.size(); ++i)
+    {
+        for (unsigned int w = 0; w < m_stages[i].workers; ++w)
+        {
+            threads.emplace_back([&, i]() {
+                PipelineBatch *batch;
+                while (queues[i]->pop(batch))
+                {
+                    if (!failed.load())
+                    {
+                        try
+                        {
+                            m_stages[i].stage(*batch);
+                        }
+                        catch (...)
+                        {
+                            fail();
+                        }
+                    }
+                    queues[i + 1]->push(batch);
+                }
+                queues[i + 1]->producer_done();
+            });
+        }
+    }
+
+    // at most batches are in flight, so their sequences differ modulo batches
+    std::vector<PipelineBatch *> pending(batches, NULL);
+    size_t next = 0;
+    PipelineBatch *batch;
+    while (queues.back()->pop(batch))
+    {
+        pending[batch->sequence % batches] = batch;
+        while ((batch = pending[next % batches]) != NULL)
+        {
+            pending[next % batches] = NULL;
+            ++next;
+            if (!failed.load())
+            {
+                try
+                {
+                    sink(*batch);
+                }
+                catch (...)
+                {
+                    fail();
+                }
+            }
+            idle.push(batch);
+        }
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ready-made stages and sources
+
+// cuts the lines of [first, last) into batches of up to lines_per_batch
+inline CurrencyPipeline::Source
+text_source(const char *first, const char *last, size_t lines_per_batch = 4096)
+{
+    std::shared_ptr<const char *> ptr(new const char *(first));
+    return [=](PipelineBatch& batch) {
+        const char *begin = *ptr, *end = begin;
+        for (size_t lines = 0; end != last && lines < lines_per_batch; ++lines)
+        {
+            const char *eol = (const char *)std::memchr(end, '\n', size_t(last - end));
+            end = eol ? eol + 1 : last;
+        }
+        if (begin == end)
+            return false;
+        batch.text.assign(begin, end);
+        *ptr = end;
+        return true;
+    };
+}
+
+// parses each line of text into values; a line that fails yields zero and
+// its index is appended to invalid
+inline CurrencyPipeline::Stage parse_stage(const AmountFormat& format = AmountFormat())
+{
+    return [format](PipelineBatch& batch) {
+        const char *ptr = batch.text.data(), *last = ptr + batch.text.size();
+        while (ptr != last)
+        {
+            const char *eol = (const char *)std::memchr(ptr, '\n', size_t(last - ptr));
+            const char *end = eol ? eol : last;
+            if (end != ptr && end[-1] == '\r')
+                --end;
+            Currency value;
+            if (!parse_amount(ptr, end, format, value))
+            {
+                batch.invalid.push_back(batch.values.size());
+                value = Currency();
+            }
+            batch.values.push_back(value);
+            ptr = eol ? eol + 1 : last;
+        }
+    };
+}
+
+inline CurrencyPipeline::Stage
+round_stage(exp10_t scale, RoundingMode mode = ROUND_HALF_EVEN)
+{
+    return [=](PipelineBatch& batch) {
+        for (size_t i = 0; i < batch.values.size(); ++i)
+        {
+            Currency value = batch.values[i];
+            value.round(scale, mode);
+            batch.values.set(i, value);
+        }
+    };
+}
+
+inline CurrencyPipeline::Stage
+convert_stage(const FxConversion& conversion, RoundingMode mode = ROUND_HALF_EVEN)
+{
+    return [=](PipelineBatch& batch) {
+        for (size_t i = 0; i < batch.values.size(); ++i)
+            batch.values.set(i, conversion.convert(batch.values[i], mode));
+    };
+}
+
+// formats values into text, one per line
+inline CurrencyPipeline::Stage
+format_stage(const FormatSpec& spec = FormatSpec(), char delimiter = '\n')
+{
+    return [=](PipelineBatch& batch) {
+        batch.text.clear();
+        format_column(batch.values, spec, delimiter, batch.text);
+    };
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,101 @@
+// CurrencyRangeIndex.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyRangeIndex.hpp"
+#include <thread>
+
+namespace khmz
+{
+
+void CurrencyRangeIndex::unittest()
+{
+    CurrencyRangeIndex index(-2);
+    std::vector<Currency> values;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Currency value(significand_t(i * 37 % 1001 - 500), -2);
+        values.push_back(value);
+        index.push_back(value, i / 10);
+    }
+    assert(index.size() == 1000);
+
+    for (size_t first = 0; first < 1000; first += 97)
+    {
+        for (size_t last = first; last <= 1000; last += 89)
+        {
+            Currency expected;
+            for (size_t i = first; i < last; ++i)
+                expected += values[i];
+            assert(index.sum(first, last) == expected);
+        }
+    }
+
+    // timestamps 5..9 cover the values 50..99
+    Currency expected;
+    for (size_t i = 50; i < 100; ++i)
+        expected += values[i];
+    assert(index.sum_between(5, 10) == expected);
+    assert(index.sum_between(10, 5) == "0");
+
+    // point updates
+    Currency total = index.total();
+    index.add(10, Currency("1.25"));
+    assert(index.get(10) == values[10] + "1.25");
+    assert(index.total() == total + "1.25");
+    index.set(10, values[10]);
+    assert(index.total() == total);
+
+    bool catched = false;
+    try
+    {
+        index.push_back(Currency("0.001"), 100);
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+    catched = false;
+    try
+    {
+        index.push_back(Currency("1"), 0);
+    }
+    catch (const std::runtime_error&)
+    {
+        catched = true;
+    }
+    assert(catched);
+
+    // exact beyond int64
+    CurrencyRangeIndex big(0);
+    big.push_back(Currency(max_significand));
+    big.push_back(Currency(max_significand));
+    assert(big.total() == Currency(max_significand / 5, 1));
+
+    // zero at a positive scale
+    CurrencyRangeIndex hundreds(2);
+    hundreds.push_back(Currency(0));
+    hundreds.push_back(Currency(500));
+    assert(hundreds.total() == "500");
+
+    // a writer with concurrent readers
+    CurrencyRangeIndex shared(-2);
+    std::thread writer([&]() {
+        for (int i = 0; i < 2000; ++i)
+            shared.push_back(Currency(1, -2), i);
+    });
+    std::thread reader([&]() {
+        for (int i = 0; i < 2000; ++i)
+        {
+            size_t size = shared.size();
+            assert(shared.sum(0, size) <= Currency(significand_t(size), -2));
+        }
+    });
+    writer.join();
+    reader.join();
+    assert(shared.total() == "20");
+
+    puts("CurrencyRangeIndex::unittest: OK.");
+}
+
+} // namespace khmz
@@ -0,0 +1,174 @@
+// CurrencyRangeIndex.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "SharedMutex.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyRangeIndex
+//
+// A Fenwick tree of exact sums over an append-only series of amounts at a
+// fixed scale, with optional non-decreasing timestamps. Range sums, point
+// updates and appends are O(log n). Any number of readers may run
+// concurrently with a single writer.
+
+class CurrencyRangeIndex
+{
+protected:
+    std::vector<__int128> m_tree;       // 1-based
+    std::vector<int64_t> m_units;       // the values
+    std::vector<int64_t> m_timestamps;
+    exp10_t m_scale;
+    mutable SharedMutex m_mutex;
+
+    int64_t to_units(const Currency& value) const
+    {
+        int64_t units;
+        if (!currency_to_units(value, m_scale, units))
+            throw std::runtime_error("CurrencyRangeIndex: out of scale");
+        return units;
+    }
+
+    // the sum of the first count values
+    __int128 prefix(size_t count) const
+    {
+        __int128 ret = 0;
+        for (size_t i = count; i > 0; i &= i - 1)
+            ret += m_tree[i];
+        return ret;
+    }
+
+public:
+    explicit CurrencyRangeIndex(exp10_t scale = -2)
+        : m_tree(1, 0)
+        , m_scale(scale)
+    {
+    }
+
+    CurrencyRangeIndex(const CurrencyRangeIndex&) = delete;
+    CurrencyRangeIndex& operator=(const CurrencyRangeIndex&) = delete;
+
+    exp10_t scale() const
+    {
+        return m_scale;
+    }
+    size_t size() const
+    {
+        SharedLock lock(m_mutex);
+        return m_units.size();
+    }
+
+    void reserve(size_t count)
+    {
+        std::lock_guard<SharedMutex> lock(m_mutex);
+        m_tree.reserve(count + 1);
+        m_units.reserve(count);
+        m_timestamps.reserve(count);
+    }
+
+    // timestamps must not decrease
+    void push_back(const Currency& value, int64_t timestamp = 0);
+
+    void add(size_t index, const Currency& delta);
+    void set(size_t index, const Currency& value);
+    Currency get(size_t index) const;
+
+    // the sum of [first, last)
+    Currency sum(size_t first, size_t last) const;
+    // the sum of the values whose timestamps are in [from, to)
+    Currency sum_between(int64_t from, int64_t to) const;
+    Currency total() const;
+
+    static void unittest();
+};
+
+inline void CurrencyRangeIndex::push_back(const Currency& value, int64_t timestamp)
+{
+    int64_t units = to_units(value);
+
+    std::lock_guard<SharedMutex> lock(m_mutex);
+    if (!m_timestamps.empty() && timestamp < m_timestamps.back())
+        throw std::runtime_error("CurrencyRangeIndex: timestamp out of order");
+
+    // node i covers (i - lowbit(i), i]
+    size_t i = m_units.size() + 1;
+    __int128 node = units + prefix(i - 1) - prefix(i & (i - 1));
+    m_tree.push_back(node);
+    m_units.push_back(units);
+    m_timestamps.push_back(timestamp);
+}
+
+inline void CurrencyRangeIndex::add(size_t index, const Currency& delta)
+{
+    int64_t units = to_units(delta);
+
+    std::lock_guard<SharedMutex> lock(m_mutex);
+    if (index >= m_units.size())
+        throw std::out_of_range("CurrencyRangeIndex::add");
+    int64_t sum;
+    if (__builtin_add_overflow(m_units[index], units, &sum))
+        throw std::runtime_error("CurrencyRangeIndex: overflow");
+    m_units[index] = sum;
+
+    for (size_t i = index + 1; i < m_tree.size(); i += i & (~i + 1))
+        m_tree[i] += units;
+}
+
+inline void CurrencyRangeIndex::set(size_t index, const Currency& value)
+{
+    int64_t units = to_units(value);
+
+    std::lock_guard<SharedMutex> lock(m_mutex);
+    if (index >= m_units.size())
+        throw std::out_of_range("CurrencyRangeIndex::set");
+
+    __int128 delta = __int128(units) - m_units[index];
+    m_units[index] = units;
+    for (size_t i = index + 1; i < m_tree.size(); i += i & (~i + 1))
+        m_tree[i] += delta;
+}
+
+inline Currency CurrencyRangeIndex::get(size_t index) const
+{
+    SharedLock lock(m_mutex);
+    if (index >= m_units.size())
+        throw std::out_of_range("CurrencyRangeIndex::get");
+    return Currency(significand_t(m_units[index]), m_scale);
+}
+
+inline Currency CurrencyRangeIndex::sum(size_t first, size_t last) const
+{
+    SharedLock lock(m_mutex);
+    if (first > last || last > m_units.size())
+        throw std::out_of_range("CurrencyRangeIndex::sum");
+    return currency_from_wide(prefix(last) - prefix(first), m_scale);
+}
+
+inline Currency CurrencyRangeIndex::sum_between(int64_t from, int64_t to) const
+{
+    SharedLock lock(m_mutex);
+    if (from >= to)
+        return Currency();
+    size_t first = std::lower_bound(m_timestamps.begin(), m_timestamps.end(), from) -
+                   m_timestamps.begin();
+    size_t last = std::lower_bound(m_timestamps.begin(), m_timestamps.end(), to) -
+                  m_timestamps.begin();
+    return currency_from_wide(prefix(last) - prefix(first), m_scale);
+}
+
+inline Currency CurrencyRangeIndex::total() const
+{
+    SharedLock lock(m_mutex);
+    return currency_from_wide(prefix(m_units.size()), m_scale);
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,122 @@
+// CurrencyReconcile.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyReconcile.hpp"
+#include <map>
+#include <random>
+
+namespace khmz
+{
+
+void Reconciler::unittest()
+{
+    // equals compares the fields, not the padding
+    Currency a("12.30"), b(123, -1);
+    assert(a.equals(b) && !a.equals(Currency("12.31")) && !a.equals(-b));
+
+    const uint64_t left_keys[] = { 1, 2, 3, 4, 5, 5 };
+    const Currency left_amounts[] =
+    {
+        Currency("10.00"), Currency("20"), Currency("30.01"), Currency("40"),
+        Currency("1"), Currency("2")
+    };
+    const uint64_t right_keys[] = { 5, 3, 2, 6, 5, 1 };
+    const Currency right_amounts[] =
+    {
+        Currency("1"), Currency("30"), Currency("20.5"), Currency("60"),
+        Currency("2.005"), Currency(10)
+    };
+
+    Reconciliation out;
+    Reconciler(Currency("0.01"), 1).reconcile(left_keys, left_amounts, 6,
+                                              right_keys, right_amounts, 6, out);
+    // 1 = 1, 3 within 0.01, 5 and 5 pair in order and 2.005 is within
+    std::map<size_t, size_t> matched(out.matched.begin(), out.matched.end());
+    assert(matched.size() == 4);
+    assert(matched[0] == 5 && matched[2] == 1 && matched[4] == 0 && matched[5] == 4);
+    assert(out.breaks.size() == 1 && out.breaks[0].left == 1 && out.breaks[0].right == 2);
+    assert(out.breaks[0].difference == "0.5");
+    assert(out.left_only.size() == 1 && out.left_only[0] == 3);
+    assert(out.right_only.size() == 1 && out.right_only[0] == 3);
+
+    Reconciler exact;
+    Currency difference;
+    assert(exact.within_tolerance(Currency("1.5"), Currency("1.50"), difference));
+    assert(difference.is_zero());
+    assert(!exact.within_tolerance(Currency("1.5"), Currency("1.25"), difference));
+    assert(difference == "-0.25");
+
+    // many partitions and threads against a std::map reference
+    const size_t count = 200000;
+    std::vector<uint64_t> lk(count), rk;
+    std::vector<Currency> la(count), ra;
+    std::mt19937_64 rng(46);
+    for (size_t i = 0; i < count; ++i)
+    {
+        lk[i] = rng();
+        la[i] = Currency(significand_t(rng() % 1000000), -2);
+        if (i % 10 == 3)
+            continue;   // left only
+        rk.push_back(lk[i]);
+        Currency amount = la[i];
+        if (i % 10 == 5)
+            amount += Currency("0.02");
+        else if (i % 10 == 7)
+            amount += Currency("0.001");
+        ra.push_back(amount);
+    }
+    for (size_t i = 0; i < count / 10; ++i)
+    {
+        rk.push_back(rng());
+        ra.push_back(Currency(1));
+    }
+
+    Reconciler parallel(Currency("0.01"), 4);
+    parallel.set_partition_bits(6);
+    parallel.reconcile(lk.data(), la.data(), count, rk.data(), ra.data(), rk.size(), out);
+    assert(out.left_only.size() == count / 10);
+    assert(out.right_only.size() == count / 10);
+    assert(out.breaks.size() == count / 10);
+    assert(out.matched.size() == count - 3 * count / 10 + count / 10);
+    for (size_t i = 0; i < out.breaks.size(); ++i)
+    {
+        assert(out.breaks[i].left % 10 == 5 && out.breaks[i].difference == "0.02");
+        assert(lk[out.breaks[i].left] == rk[out.breaks[i].right]);
+    }
+    for (size_t i = 0; i < out.matched.size(); ++i)
+        assert(lk[out.matched[i].first] == rk[out.matched[i].second]);
+
+    Reconciliation automatic;
+    Reconciler(Currency("0.01"), 3).reconcile(lk.data(), la.data(), count,
+                                              rk.data(), ra.data(), rk.size(), automatic);
+    assert(automatic.matched.size() == out.matched.size());
+    assert(automatic.breaks.size() == out.breaks.size());
+
+    // long runs of one key pair in order, in linear time
+    const size_t runs = 100000;
+    std::vector<uint64_t> dup_left(runs), dup_right(runs + 5);
+    std::vector<Currency> dup_left_amounts(runs), dup_right_amounts(runs + 5);
+    for (size_t i = 0; i < runs + 5; ++i)
+    {
+        dup_right[i] = i % 2;
+        dup_right_amounts[i] = Currency(significand_t(i));
+        if (i < runs)
+        {
+            dup_left[i] = i % 2;
+            dup_left_amounts[i] = Currency(significand_t(i));
+        }
+    }
+    Reconciler(Currency(), 2).reconcile(dup_left.data(), dup_left_amounts.data(), runs,
+                                        dup_right.data(), dup_right_amounts.data(), runs + 5,
+                                        out);
+    assert(out.matched.size() == runs && out.breaks.empty() && out.left_only.empty());
+    assert(out.right_only.size() == 5 && out.right_only[0] == runs);
+    for (size_t i = 0; i < out.matched.size(); ++i)
+        assert(out.matched[i].first == out.matched[i].second);
+
+    puts("Reconciler::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
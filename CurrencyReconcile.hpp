@@ -0,0 +1,299 @@
+// CurrencyReconcile.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// Reconciliation
+
+// a matched pair whose amounts differ by more than the tolerance
+struct ReconcileBreak
+{
+    size_t left;
+    size_t right;
+    Currency difference;    // right - left
+};
+
+struct Reconciliation
+{
+    std::vector<std::pair<size_t, size_t> > matched;    // (left, right) in tolerance
+    std::vector<ReconcileBreak> breaks;
+    std::vector<size_t> left_only;
+    std::vector<size_t> right_only;
+
+    void clear()
+    {
+        matched.clear();
+        breaks.clear();
+        left_only.clear();
+        right_only.clear();
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Reconciler
+//
+// Matches two ledgers of (key, amount) by key with a radix-partitioned hash
+// join: both sides are scattered into 2^bits partitions by a hash of the
+// key, and the partitions are joined independently on worker threads with
+// a small open-addressing table each, which stays in cache. A key that
+// occurs several times pairs its k-th left entry with its k-th right entry:
+// its slot keeps a cursor into the chain of its right entries in order, so
+// each duplicate is paired in constant time.
+//
+// Equal amounts are found by comparing the normalized forms, which also
+// rejects different exponents at once; only the others are subtracted
+// (without allocating) and compared with the tolerance.
+//
+// The results are grouped by partition and, within one, ordered by index.
+
+class Reconciler
+{
+protected:
+    Currency m_tolerance;
+    unsigned int m_threads;
+    unsigned int m_partition_bits;  // 0 to choose by size
+
+    struct Partitioned
+    {
+        std::vector<size_t> order;      // the indices, partition by partition
+        std::vector<size_t> offsets;    // partition p is [offsets[p], offsets[p + 1])
+    };
+
+    // the hash table of a join, reused by a thread across partitions
+    struct JoinTable
+    {
+        std::vector<size_t> heads;      // per slot: the first position of its key
+        std::vector<size_t> cursors;    // per slot: the next position to pair
+        std::vector<size_t> next;       // per position: the next one of the same key
+        std::vector<char> used;         // per position
+    };
+
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDULL;
+        key ^= key >> 33;
+        key *= 0xC4CEB9FE1A85EC53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+    void partition(const uint64_t *keys, size_t count, unsigned int bits,
+                   Partitioned& out) const;
+    void join(const uint64_t *left_keys, const Currency *left_amounts,
+              const uint64_t *right_keys, const Currency *right_amounts,
+              const size_t *left, size_t left_count, const size_t *right, size_t right_count,
+              JoinTable& table, Reconciliation& out) const;
+
+public:
+    explicit Reconciler(const Currency& tolerance = Currency(), unsigned int threads = 0)
+        : m_tolerance(tolerance)
+        , m_threads(threads ? threads : std::max(1U, std::thread::hardware_concurrency()))
+        , m_partition_bits(0)
+    {
+        if (tolerance.is_negative())
+            throw std::runtime_error("Reconciler: negative tolerance");
+    }
+
+    void set_partition_bits(unsigned int bits)
+    {
+        m_partition_bits = std::min(bits, 16U);
+    }
+
+    // true if |b - a| <= tolerance; difference receives b - a if they differ
+    bool within_tolerance(const Currency& a, const Currency& b, Currency& difference) const
+    {
+        if (a == b)
+        {
+            difference = Currency();
+            return true;
+        }
+        difference = b;
+        difference -= a;
+        if (m_tolerance.is_zero())
+            return false;
+        return difference.is_negative() ? -difference <= m_tolerance
+                                        : difference <= m_tolerance;
+    }
+
+    void reconcile(const uint64_t *left_keys, const Currency *left_amounts, size_t left_count,
+                   const uint64_t *right_keys, const Currency *right_amounts,
+                   size_t right_count, Reconciliation& out) const;
+
+    static void unittest();
+};
+
+inline void
+Reconciler::partition(const uint64_t *keys, size_t count, unsigned int bits,
+                      Partitioned& out) const
+{
+    const size_t partitions = size_t(1) << bits;
+    const unsigned int shift = 64 - bits;
+    auto part = [=](uint64_t key) -> size_t {
+        return bits ? size_t(hash(key) >> shift) : 0;
+    };
+
+    // a histogram per chunk, then a stable scatter
+    const size_t chunks = std::max<size_t>(1, std::min<size_t>(m_threads * 4, count / 65536));
+    const size_t chunk_size = (count + chunks - 1) / chunks;
+    std::vector<size_t> counts(chunks * partitions, 0);
+    parallel_for(chunks, m_threads, [&](unsigned int, size_t c) {
+        size_t *histogram = &counts[c * partitions];
+        const size_t last = std::min(count, (c + 1) * chunk_size);
+        for (size_t i = c * chunk_size; i < last; ++i)
+            ++histogram[part(keys[i])];
+    });
+
+    out.offsets.assign(partitions + 1, 0);
+    size_t total = 0;
+    for (size_t p = 0; p < partitions; ++p)
+    {
+        out.offsets[p] = total;
+        for (size_t c = 0; c < chunks; ++c)
+        {
+            size_t n = counts[c * partitions + p];
+            counts[c * partitions + p] = total;
+            total += n;
+        }
+    }
+    out.offsets[partitions] = total;
+
+    out.order.resize(count);
+    parallel_for(chunks, m_threads, [&](unsigned int, size_t c) {
+        size_t *cursor = &counts[c * partitions];
+        const size_t last = std::min(count, (c + 1) * chunk_size);
+        for (size_t i = c * chunk_size; i < last; ++i)
+            out.order[cursor[part(keys[i])]++] = i;
+    });
+}
+
+inline void
+Reconciler::join(const uint64_t *left_keys, const Currency *left_amounts,
+                 const uint64_t *right_keys, const Currency *right_amounts,
+                 const size_t *left, size_t left_count, const size_t *right, size_t right_count,
+                 JoinTable& table, Reconciliation& out) const
+{
+    const size_t empty = ~size_t(0);
+    size_t size = 16;
+    while (size < 2 * right_count)
+        size *= 2;
+    const size_t mask = size - 1;
+    std::vector<size_t>& heads = table.heads;
+    std::vector<size_t>& cursors = table.cursors;
+    std::vector<size_t>& next = table.next;
+    std::vector<char>& used = table.used;
+    heads.assign(size, empty);
+    cursors.resize(size);
+    next.assign(right_count, empty);
+    used.assign(right_count, 0);
+
+    // one slot per distinct key of right, chaining its positions in order;
+    // the cursor is the tail of the chain while building
+    for (size_t j = 0; j < right_count; ++j)
+    {
+        const uint64_t key = right_keys[right[j]];
+        size_t slot = size_t(hash(key)) & mask;
+        while (heads[slot] != empty && right_keys[right[heads[slot]]] != key)
+            slot = (slot + 1) & mask;
+        if (heads[slot] == empty)
+            heads[slot] = j;
+        else
+            next[cursors[slot]] = j;
+        cursors[slot] = j;
+    }
+    for (size_t slot = 0; slot < size; ++slot)
+        cursors[slot] = heads[slot];
+
+    for (size_t i = 0; i < left_count; ++i)
+    {
+        const size_t l = left[i];
+        const uint64_t key = left_keys[l];
+        size_t slot = size_t(hash(key)) & mask;
+        while (heads[slot] != empty && right_keys[right[heads[slot]]] != key)
+            slot = (slot + 1) & mask;
+        const size_t found = (heads[slot] == empty) ? empty : cursors[slot];
+        if (found == empty)
+        {
+            out.left_only.push_back(l);
+            continue;
+        }
+
+        cursors[slot] = next[found];
+        used[found] = 1;
+        const size_t r = right[found];
+        ReconcileBreak item;
+        if (within_tolerance(left_amounts[l], right_amounts[r], item.difference))
+        {
+            out.matched.push_back(std::make_pair(l, r));
+        }
+        else
+        {
+            item.left = l;
+            item.right = r;
+            out.breaks.push_back(item);
+        }
+    }
+
+    for (size_t j = 0; j < right_count; ++j)
+    {
+        if (!used[j])
+            out.right_only.push_back(right[j]);
+    }
+}
+
+inline void
+Reconciler::reconcile(const uint64_t *left_keys, const Currency *left_amounts, size_t left_count,
+                      const uint64_t *right_keys, const Currency *right_amounts,
+                      size_t right_count, Reconciliation& out) const
+{
+    out.clear();
+
+    // about 16K right entries per partition, and enough partitions to
+    // balance the threads
+    unsigned int bits = m_partition_bits;
+    if (bits == 0)
+    {
+        while (bits < 16 && ((right_count >> bits) > 16384 || (1U << bits) < 4 * m_threads))
+            ++bits;
+        if (right_count + left_count < 65536)
+            bits = 0;
+    }
+
+    Partitioned left, right;
+    partition(left_keys, left_count, bits, left);
+    partition(right_keys, right_count, bits, right);
+
+    const size_t partitions = size_t(1) << bits;
+    std::vector<Reconciliation> parts(partitions);
+    std::vector<JoinTable> tables(m_threads);
+    parallel_for(partitions, m_threads, [&](unsigned int t, size_t p) {
+        join(left_keys, left_amounts, right_keys, right_amounts,
+             left.order.data() + left.offsets[p], left.offsets[p + 1] - left.offsets[p],
+             right.order.data() + right.offsets[p], right.offsets[p + 1] - right.offsets[p],
+             tables[t], parts[p]);
+    });
+
+    for (size_t p = 0; p < partitions; ++p)
+    {
+        out.matched.insert(out.matched.end(), parts[p].matched.begin(), parts[p].matched.end());
+        out.breaks.insert(out.breaks.end(), parts[p].breaks.begin(), parts[p].breaks.end());
+        out.left_only.insert(out.left_only.end(), parts[p].left_only.begin(),
+                             parts[p].left_only.end());
+        out.right_only.insert(out.right_only.end(), parts[p].right_only.begin(),
+                              parts[p].right_only.end());
+    }
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
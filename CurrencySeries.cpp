@@ -0,0 +1,69 @@
+// CurrencySeries.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencySeries.hpp"
+
+namespace khmz
+{
+
+void CurrencySeries::unittest()
+{
+    // a random walk of tick prices
+    CurrencyColumn ticks;
+    significand_t price = 1234500;     // 12345.00
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < 100000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        price += significand_t((seed >> 16) % 21) - 10;
+        ticks.push_back(Currency(price, -2));
+    }
+
+    CurrencySeries series;
+    series.append(ticks);
+    assert(series.size() == ticks.size());
+    assert(series.block_count() == (ticks.size() + block_size - 1) / block_size);
+    assert(series.memory_usage() < ticks.size() * 2);
+
+    CurrencyColumn decoded;
+    series.decode(decoded);
+    assert(decoded.size() == ticks.size());
+    for (size_t i = 0; i < ticks.size(); ++i)
+    {
+        assert(decoded.significands()[i] == ticks.significands()[i]);
+        assert(decoded.exp10s()[i] == ticks.exp10s()[i]);
+    }
+    assert(series[0] == ticks[0]);
+    assert(series[77777] == ticks[77777]);
+    assert(series[ticks.size() - 1] == ticks[ticks.size() - 1]);
+
+    // wide ranges, a raw block and the unsealed tail
+    CurrencySeries mixed;
+    CurrencyColumn values;
+    for (int i = 0; i < int(block_size) * 3 + 5; ++i)
+    {
+        Currency cur;
+        switch (i % 5)
+        {
+        case 0: cur = Currency(max_significand); break;
+        case 1: cur = Currency(-max_significand); break;
+        case 2: cur = Currency(i, -12); break;
+        case 3: cur = Currency(); break;
+        default: cur = Currency(-i, 3); break;
+        }
+        if (i == int(block_size) * 2 + 7)
+            cur.set_inf();
+        values.push_back(cur);
+        mixed.push_back(cur);
+    }
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        Currency cur = mixed[i];
+        assert(cur.significand() == values.significands()[i]);
+        assert(cur.exp10() == values.exp10s()[i]);
+    }
+
+    puts("CurrencySeries::unittest: OK.");
+}
+
+} // namespace khmz
@@ -0,0 +1,277 @@
+// CurrencySeries.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencySeries
+//
+// A compressed append-only series of Currency values (e.g. tick prices).
+// Values are sealed in blocks of block_size. In a block, the significands
+// are scaled to the smallest exponent of the block, delta coded against
+// the previous value, and the deltas are bit-packed as frame-of-reference
+// residuals (delta - min_delta). A block that cannot share an exponent is
+// stored raw. The last, unsealed values are kept as they are.
+
+class CurrencySeries
+{
+public:
+    enum { block_size = 128 };
+
+protected:
+    struct Block
+    {
+        significand_t first;    // first scaled significand
+        uint64_t min_delta;     // frame of reference of the deltas
+        size_t offset;          // index into m_words
+        size_t raw_offset;      // index into m_raw_exp10s if raw
+        exp10_t exp10;          // shared exponent
+        unsigned char width;    // bits per residual
+        bool raw;
+    };
+
+    std::vector<Block> m_blocks;
+    std::vector<uint64_t> m_words;
+    std::vector<exp10_t> m_raw_exp10s;
+    significand_t m_tail_significands[block_size];
+    exp10_t m_tail_exp10s[block_size];
+    size_t m_tail_count;
+
+    void seal();
+    static void unpack(const uint64_t *words, unsigned int width, uint64_t *out);
+
+public:
+    CurrencySeries()
+        : m_tail_count(0)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_blocks.size() * block_size + m_tail_count;
+    }
+    bool empty() const
+    {
+        return size() == 0;
+    }
+    void clear()
+    {
+        m_blocks.clear();
+        m_words.clear();
+        m_raw_exp10s.clear();
+        m_tail_count = 0;
+    }
+
+    // the number of blocks, including the unsealed last one
+    size_t block_count() const
+    {
+        return (size() + block_size - 1) / block_size;
+    }
+
+    void push_back(significand_t significand, exp10_t exp10)
+    {
+        m_tail_significands[m_tail_count] = significand;
+        m_tail_exp10s[m_tail_count] = exp10;
+        if (++m_tail_count == block_size)
+            seal();
+    }
+    void push_back(const Currency& cur)
+    {
+        push_back(cur.significand(), cur.exp10());
+    }
+    void append(const CurrencyColumn& column)
+    {
+        for (size_t i = 0; i < column.size(); ++i)
+            push_back(column.significands()[i], column.exp10s()[i]);
+    }
+
+    // decodes a block into normalized significands and exponents.
+    // returns the number of values (block_size but for the last block).
+    size_t decode_block(size_t block, significand_t *significands, exp10_t *exp10s) const;
+    void decode(CurrencyColumn& column) const;
+
+    Currency operator[](size_t index) const;
+
+    // the bytes held by the compressed data
+    size_t memory_usage() const
+    {
+        return m_blocks.capacity() * sizeof(Block) +
+               m_words.capacity() * sizeof(uint64_t) +
+               m_raw_exp10s.capacity() * sizeof(exp10_t) +
+               sizeof(*this);
+    }
+
+    static void unittest();
+};
+
+inline void CurrencySeries::seal()
+{
+    assert(m_tail_count == block_size);
+
+    Block block;
+    block.offset = m_words.size();
+    block.raw_offset = 0;
+    block.exp10 = m_tail_exp10s[0];
+    for (size_t i = 1; i < block_size; ++i)
+        block.exp10 = std::min(block.exp10, m_tail_exp10s[i]);
+
+    significand_t scaled[block_size];
+    block.raw = false;
+    for (size_t i = 0; i < block_size && !block.raw; ++i)
+    {
+        block.raw = !rescale_significand(m_tail_significands[i], m_tail_exp10s[i],
+                                         block.exp10, scaled[i]);
+    }
+
+    if (block.raw)
+    {
+        block.first = 0;
+        block.min_delta = 0;
+        block.width = 64;
+        block.raw_offset = m_raw_exp10s.size();
+        m_words.insert(m_words.end(), m_tail_significands,
+                       m_tail_significands + block_size);
+        m_raw_exp10s.insert(m_raw_exp10s.end(), m_tail_exp10s,
+                            m_tail_exp10s + block_size);
+        m_blocks.push_back(block);
+        m_tail_count = 0;
+        return;
+    }
+
+    // deltas in wrap-around arithmetic; min_delta is the signed minimum
+    uint64_t deltas[block_size - 1];
+    int64_t min_delta = std::numeric_limits<int64_t>::max();
+    for (size_t i = 1; i < block_size; ++i)
+    {
+        deltas[i - 1] = uint64_t(scaled[i]) - uint64_t(scaled[i - 1]);
+        min_delta = std::min(min_delta, int64_t(deltas[i - 1]));
+    }
+    uint64_t max_residual = 0;
+    for (size_t i = 0; i < block_size - 1; ++i)
+    {
+        deltas[i] -= uint64_t(min_delta);
+        max_residual = std::max(max_residual, deltas[i]);
+    }
+
+    block.first = scaled[0];
+    block.min_delta = uint64_t(min_delta);
+    block.width = (unsigned char)(max_residual ? 64 - __builtin_clzll(max_residual) : 0);
+
+    // bit-pack the residuals
+    const unsigned int width = block.width;
+    size_t words = ((block_size - 1) * width + 63) / 64;
+    m_words.resize(block.offset + words, 0);
+    uint64_t *out = m_words.data() + block.offset;
+    for (size_t i = 0; i < block_size - 1; ++i)
+    {
+        size_t bit = i * width;
+        size_t word = bit >> 6;
+        unsigned int shift = bit & 63;
+        out[word] |= deltas[i] << shift;
+        if (shift + width > 64)
+            out[word + 1] |= deltas[i] >> (64 - shift);
+    }
+
+    m_blocks.push_back(block);
+    m_tail_count = 0;
+}
+
+// branch-free unpacking of (block_size - 1) residuals; the compiler can
+// vectorize the loop since width is fixed per call
+inline void
+CurrencySeries::unpack(const uint64_t *words, unsigned int width, uint64_t *out)
+{
+    if (width == 0)
+    {
+        std::fill(out, out + block_size - 1, 0);
+        return;
+    }
+
+    const uint64_t mask = (width == 64) ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    const size_t last_word = ((block_size - 1) * width - 1) >> 6;
+    for (size_t i = 0; i < block_size - 1; ++i)
+    {
+        size_t bit = i * width;
+        size_t word = bit >> 6;
+        unsigned int shift = bit & 63;
+        uint64_t lo = words[word] >> shift;
+        // (x << 1) << (63 - shift) is zero when shift == 0
+        uint64_t hi = (word < last_word) ? (words[word + 1] << 1) << (63 - shift) : 0;
+        out[i] = (lo | hi) & mask;
+    }
+}
+
+inline size_t
+CurrencySeries::decode_block(size_t index, significand_t *significands,
+                             exp10_t *exp10s) const
+{
+    assert(index < block_count());
+
+    if (index == m_blocks.size())
+    {
+        std::copy(m_tail_significands, m_tail_significands + m_tail_count, significands);
+        std::copy(m_tail_exp10s, m_tail_exp10s + m_tail_count, exp10s);
+        return m_tail_count;
+    }
+
+    const Block& block = m_blocks[index];
+    if (block.raw)
+    {
+        const uint64_t *words = m_words.data() + block.offset;
+        for (size_t i = 0; i < block_size; ++i)
+            significands[i] = significand_t(words[i]);
+        std::copy(m_raw_exp10s.begin() + block.raw_offset,
+                  m_raw_exp10s.begin() + block.raw_offset + block_size, exp10s);
+        return block_size;
+    }
+
+    uint64_t residuals[block_size - 1];
+    unpack(m_words.data() + block.offset, block.width, residuals);
+
+    uint64_t value = uint64_t(block.first);
+    significands[0] = significand_t(value);
+    for (size_t i = 1; i < block_size; ++i)
+    {
+        value += residuals[i - 1] + block.min_delta;
+        significands[i] = significand_t(value);
+    }
+
+    for (size_t i = 0; i < block_size; ++i)
+    {
+        exp10s[i] = block.exp10;
+        normalize_significand(significands[i], exp10s[i]);
+    }
+    return block_size;
+}
+
+inline void CurrencySeries::decode(CurrencyColumn& column) const
+{
+    size_t size = column.size();
+    column.resize(size + this->size());
+    for (size_t i = 0; i < block_count(); ++i)
+    {
+        size += decode_block(i, column.significands() + size,
+                             column.exp10s() + size);
+    }
+}
+
+inline Currency CurrencySeries::operator[](size_t index) const
+{
+    assert(index < size());
+
+    significand_t significands[block_size];
+    exp10_t exp10s[block_size];
+    decode_block(index / block_size, significands, exp10s);
+    return Currency(significands[index % block_size], exp10s[index % block_size]);
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
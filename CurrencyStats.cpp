@@ -0,0 +1,183 @@
+// CurrencyStats.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "CurrencyStats.hpp"
+#include <random>
+
+namespace khmz
+{
+
+void CurrencyStats::unittest()
+{
+    CurrencyStats stats;
+    const Currency values[] = { Currency(1), Currency(2), Currency(3), Currency(4) };
+    std::vector<size_t> invalid;
+    assert(stats.add(values, 4, invalid) == 0);
+    assert(stats.count() == 4 && stats.sum() == "10");
+    assert(stats.min() == "1" && stats.max() == "4");
+    assert(stats.mean(-2) == "2.5" && stats.mean(0) == "2");
+    assert(stats.mean(0, ROUND_HALF_UP) == "3");
+    assert(stats.variance(-2) == "1.25");
+    assert(stats.variance(-2, ROUND_HALF_EVEN, true) == "1.67");
+    // sqrt(1.25) = 1.118033...
+    assert(stats.stddev(-2) == "1.12" && stats.stddev(-4) == "1.118");
+    assert(stats.stddev(-6, ROUND_UP) == "1.118034");
+    assert(stats.stddev(-2, ROUND_HALF_EVEN, true) == "1.29");
+
+    assert(!stats.add(Currency("0.001")));
+    assert(stats.add(Currency("-0.5")));
+    assert(stats.min() == "-0.5" && stats.mean(-2) == "1.9");
+
+    // zero at a positive scale
+    CurrencyStats hundreds(2);
+    CurrencyQuantiles hundreds_quantiles(2);
+    CurrencyColumn zero_column;
+    zero_column.push_back(Currency(0));
+    zero_column.push_back(Currency(300));
+    assert(hundreds.add(zero_column, invalid) == 0 && hundreds.min().is_zero());
+    assert(hundreds_quantiles.add(zero_column, invalid) == 0);
+    assert(hundreds_quantiles.median() == "150");
+    assert(hundreds.add(Currency()) && hundreds.count() == 3);
+
+    // exactly halfway: the mean of 0 and 1, the stddev of 0 and 1 (0.5)
+    CurrencyStats half(0);
+    half.add(Currency(0));
+    half.add(Currency(1));
+    assert(half.mean(0) == "0" && half.mean(0, ROUND_HALF_UP) == "1");
+    assert(half.stddev(0) == "0" && half.stddev(0, ROUND_HALF_UP) == "1");
+    assert(half.stddev(-1) == "0.5");
+
+    CurrencyStats exact;
+    const int data[] = { 2, 4, 4, 4, 5, 5, 7, 9 };
+    for (int i = 0; i < 8; ++i)
+        exact.add_units(data[i] * 100);
+    assert(exact.variance(-2) == "4" && exact.stddev(-10) == "2");
+
+    CurrencyStats empty;
+    assert(empty.mean(-2).is_zero() && empty.stddev(-2, ROUND_HALF_EVEN, true).is_zero());
+
+    // large amounts whose mean a double cannot hold to the cent
+    CurrencyStats large;
+    for (int i = 0; i < 1000; ++i)
+        large.add(Currency(significand_t(900000000000000001LL + i), -2));
+    assert(large.mean(-3) == "9000000000000005.005");
+    assert(large.mean(-2) == "9000000000000005");
+    assert(large.mean(-2, ROUND_HALF_UP) == "9000000000000005.01");
+    // the variance of 0..999 is (1000^2 - 1) / 12 = 83333.25 units^2
+    assert(large.variance(-6) == "8.333325" && large.variance(-4) == "8.3333");
+
+    // chunks merged in any order, and in parallel
+    std::mt19937_64 rng(47);
+    CurrencyColumn column;
+    for (int i = 0; i < 300000; ++i)
+    {
+        column.push_back(Currency(significand_t(rng() % 2000000000) - 1000000000,
+                                  -exp10_t(rng() % 3)));
+    }
+    column.push_back(Currency("0.125"));
+
+    CurrencyStats whole;
+    invalid.clear();
+    assert(whole.add(column, invalid) == 1 && invalid[0] == 300000);
+    CurrencyStats a, b;
+    invalid.clear();
+    b.add(column, 150000, column.size(), invalid);
+    a.add(column, 0, 150000, invalid);
+    b.merge(a);
+    assert(b.count() == whole.count() && b.sum() == whole.sum());
+    assert(b.stddev(-4) == whole.stddev(-4) && b.min() == whole.min());
+
+    invalid.clear();
+    CurrencyStats parallel = column_stats(column, -2, invalid, 4);
+    assert(invalid.size() == 1 && invalid[0] == 300000);
+    assert(parallel.count() == whole.count() && parallel.sum() == whole.sum());
+    assert(parallel.mean(-6) == whole.mean(-6));
+    assert(parallel.variance(-6, ROUND_HALF_EVEN, true) ==
+           whole.variance(-6, ROUND_HALF_EVEN, true));
+
+    // against long double
+    long double sum = 0, sum_squares = 0;
+    for (size_t i = 0; i + 1 < column.size(); ++i)
+    {
+        long double x = (long double)column[i].significand() * std::pow(10.0L, column[i].exp10());
+        sum += x;
+        sum_squares += x * x;
+    }
+    const long double n = 300000, mean = sum / n;
+    const long double sd = std::sqrt(sum_squares / n - mean * mean);
+    assert(std::fabs((long double)whole.mean(-6).significand() * 1e-6L - mean) <= 1e-6L);
+    assert(std::fabs((long double)whole.stddev(-2).significand() * 1e-2L - sd) <= 0.01L);
+
+    try
+    {
+        a.merge(CurrencyStats(-3));
+        assert(0);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    puts("CurrencyStats::unittest: OK.");
+}
+
+void CurrencyQuantiles::unittest()
+{
+    CurrencyQuantiles quantiles;
+    for (int i = 10; i >= 1; --i)
+        quantiles.add(Currency(i));
+    assert(quantiles.size() == 10);
+    assert(quantiles.median() == "5.5");
+    assert(quantiles.percentile(Currency(0)) == "1");
+    assert(quantiles.percentile(Currency(1)) == "10");
+    assert(quantiles.percentile(Currency("0.9")) == "9.1");
+    assert(quantiles.percentile(Currency("0.95")) == "9.55");
+    assert(quantiles.percentile(Currency("0.125")) == "2.125");
+    quantiles.add(Currency("-0.01"));
+    assert(quantiles.median() == "5" && quantiles.percentile(Currency(0)) == "-0.01");
+    assert(!quantiles.add(Currency("0.001")));
+
+    const char *bad[] = { "-0.1", "1.01", "0.0000000000000000001" };
+    for (int i = 0; i < 3; ++i)
+    {
+        try
+        {
+            quantiles.percentile(Currency(bad[i]));
+            assert(0);
+        }
+        catch (const std::runtime_error&)
+        {
+        }
+    }
+    assert(CurrencyQuantiles().median().is_zero());
+
+    // against sorting, with parts merged
+    std::mt19937_64 rng(4747);
+    CurrencyColumn column;
+    std::vector<int64_t> sorted;
+    for (int i = 0; i < 10001; ++i)
+    {
+        int64_t units = int64_t(rng() % 1000000) - 500000;
+        column.push_back(Currency(significand_t(units), -2));
+        sorted.push_back(units);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    CurrencyQuantiles a, b;
+    std::vector<size_t> invalid;
+    a.add(column, invalid);
+    assert(invalid.empty());
+    b.merge(a);
+    assert(b.median() == Currency(significand_t(sorted[5000]), -2));
+    assert(b.percentile(Currency("0.99")) == Currency(significand_t(sorted[9900]), -2));
+    // rank 10000 * 0.3333 = 3333
+    assert(b.percentile(Currency("0.3333")) == Currency(significand_t(sorted[3333]), -2));
+    // rank 10000 * 0.00005 = 0.5
+    Currency expected = Currency(significand_t(sorted[0] + sorted[1]), -2);
+    expected /= Currency(2);
+    assert(b.percentile(Currency("0.00005")) == expected);
+
+    puts("CurrencyQuantiles::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
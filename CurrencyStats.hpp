@@ -0,0 +1,429 @@
+// CurrencyStats.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "WideDecimal.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyStats
+//
+// The count, sum, minimum, maximum, mean, variance and standard deviation
+// of amounts, computed exactly. The amounts are taken as integer units of
+// 10^scale; the sum is kept in 128 bits and the sum of squares in 256, so
+// nothing is rounded until a result is asked for, and then each result is
+// rounded once, by a single exact division, to the requested exponent.
+//
+// Partial states over parts of the data merge into the same result as one
+// pass over all of it, in any order.
+
+class CurrencyStats
+{
+protected:
+    exp10_t m_scale;
+    uint64_t m_count;
+    __int128 m_sum;
+    UInt256 m_sum_squares;
+    int64_t m_min;
+    int64_t m_max;
+
+    // num * 10^shift / den rounded to q; false if it does not fit 127 bits
+    static bool divide(UInt256 num, unsigned __int128 den, int shift, RoundingMode mode,
+                       bool negative, unsigned __int128& q);
+    // floor(num * 10^shift / den) in q and the remainder over den in r/den
+    static bool divide(UInt256 num, unsigned __int128& den, int shift,
+                       unsigned __int128& q, unsigned __int128& r);
+    // n * sum(x^2) - sum(x)^2, i.e. n^2 times the population variance
+    UInt256 scaled_variance() const;
+
+public:
+    explicit CurrencyStats(exp10_t scale = -2)
+        : m_scale(scale)
+    {
+        clear();
+    }
+
+    exp10_t scale() const
+    {
+        return m_scale;
+    }
+
+    void clear()
+    {
+        m_count = 0;
+        m_sum = 0;
+        m_sum_squares = UInt256();
+        m_min = m_max = 0;
+    }
+
+    void add_units(int64_t units)
+    {
+        if (m_count == 0)
+        {
+            m_min = m_max = units;
+        }
+        else
+        {
+            m_min = std::min(m_min, units);
+            m_max = std::max(m_max, units);
+        }
+        ++m_count;
+        m_sum += units;
+        m_sum_squares.add(UInt256((unsigned __int128)(__int128(units) * units)));
+    }
+
+    // false if value is finer than the scale, infinite, or too large
+    bool add(const Currency& value)
+    {
+        int64_t units;
+        if (!currency_to_units(value, m_scale, units))
+            return false;
+        add_units(units);
+        return true;
+    }
+
+    // the values that cannot be added are skipped and their indices
+    // appended to invalid; returns their number
+    size_t add(const Currency *values, size_t count, std::vector<size_t>& invalid);
+    size_t add(const CurrencyColumn& column, std::vector<size_t>& invalid)
+    {
+        return add(column, 0, column.size(), invalid);
+    }
+    // the rows [first, last) of column
+    size_t add(const CurrencyColumn& column, size_t first, size_t last,
+               std::vector<size_t>& invalid);
+
+    void merge(const CurrencyStats& another);
+
+    uint64_t count() const
+    {
+        return m_count;
+    }
+    Currency sum() const
+    {
+        return currency_from_wide(m_sum, m_scale);
+    }
+    Currency min() const
+    {
+        return Currency(significand_t(m_min), m_scale);
+    }
+    Currency max() const
+    {
+        return Currency(significand_t(m_max), m_scale);
+    }
+
+    // the results are rounded to units of 10^e10; zero without enough
+    // values. std::runtime_error if a result does not fit.
+    Currency mean(exp10_t e10, RoundingMode mode = ROUND_HALF_EVEN) const;
+    // sample divides by count - 1 instead of count
+    Currency variance(exp10_t e10, RoundingMode mode = ROUND_HALF_EVEN,
+                      bool sample = false) const;
+    Currency stddev(exp10_t e10, RoundingMode mode = ROUND_HALF_EVEN,
+                    bool sample = false) const;
+
+    static void unittest();
+};
+
+inline bool
+CurrencyStats::divide(UInt256 num, unsigned __int128& den, int shift,
+                      unsigned __int128& q, unsigned __int128& r)
+{
+    for (int k = shift; k > 0; k -= 19)
+    {
+        if (!num.mul(pow10_u64(std::min(k, 19))))
+            return false;
+    }
+    for (int k = -shift; k > 0; k -= 19)
+    {
+        if (__builtin_mul_overflow(den, (unsigned __int128)pow10_u64(std::min(k, 19)), &den))
+            return false;
+    }
+    r = num.divide(den);
+    if (num.hi || (num.lo >> 127))
+        return false;
+    q = num.lo;
+    return true;
+}
+
+inline bool
+CurrencyStats::divide(UInt256 num, unsigned __int128 den, int shift, RoundingMode mode,
+                      bool negative, unsigned __int128& q)
+{
+    unsigned __int128 r;
+    if (!divide(num, den, shift, q, r))
+        return false;
+    const int half_cmp = half_compare(r, den);
+    if (round_increment(mode, q & 1, half_cmp, r != 0, negative))
+        ++q;
+    return true;
+}
+
+inline UInt256 CurrencyStats::scaled_variance() const
+{
+    UInt256 ret = m_sum_squares;
+    if (!ret.mul(m_count))
+        throw std::runtime_error("CurrencyStats: variance overflow");
+    const unsigned __int128 sum = (m_sum < 0) ? 0 - (unsigned __int128)m_sum
+                                              : (unsigned __int128)m_sum;
+    ret.sub(UInt256::mul(sum, sum));
+    return ret;
+}
+
+inline size_t
+CurrencyStats::add(const Currency *values, size_t count, std::vector<size_t>& invalid)
+{
+    const size_t invalid_count = invalid.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!add(values[i]))
+            invalid.push_back(i);
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline size_t
+CurrencyStats::add(const CurrencyColumn& column, size_t first, size_t last,
+                   std::vector<size_t>& invalid)
+{
+    // straight from the arrays; a column holds no infinities
+    const significand_t *significands = column.significands();
+    const exp10_t *exp10s = column.exp10s();
+    const size_t invalid_count = invalid.size();
+    for (size_t i = first; i < last; ++i)
+    {
+        int64_t units;
+        if (exp10s[i] == m_scale || significands[i] == 0)
+            units = significands[i];
+        else if (exp10s[i] < m_scale ||
+                 !rescale_significand(significands[i], exp10s[i], m_scale, units))
+        {
+            invalid.push_back(i);
+            continue;
+        }
+        add_units(units);
+    }
+    return invalid.size() - invalid_count;
+}
+
+inline void CurrencyStats::merge(const CurrencyStats& another)
+{
+    if (another.m_scale != m_scale)
+        throw std::runtime_error("CurrencyStats: merging different scales");
+    if (another.m_count == 0)
+        return;
+    if (m_count == 0)
+    {
+        *this = another;
+        return;
+    }
+    m_count += another.m_count;
+    m_sum += another.m_sum;
+    m_sum_squares.add(another.m_sum_squares);
+    m_min = std::min(m_min, another.m_min);
+    m_max = std::max(m_max, another.m_max);
+}
+
+inline Currency CurrencyStats::mean(exp10_t e10, RoundingMode mode) const
+{
+    if (m_count == 0)
+        return Currency();
+    const bool negative = m_sum < 0;
+    unsigned __int128 q;
+    if (!divide(UInt256(negative ? 0 - (unsigned __int128)m_sum : (unsigned __int128)m_sum),
+                m_count, int(m_scale) - e10, mode, negative, q))
+        throw std::runtime_error("CurrencyStats: mean overflow");
+    return currency_from_wide(negative ? -__int128(q) : __int128(q), e10);
+}
+
+inline Currency CurrencyStats::variance(exp10_t e10, RoundingMode mode, bool sample) const
+{
+    if (m_count < (sample ? 2U : 1U))
+        return Currency();
+    // the variance is in units of 10^(2 * scale)
+    unsigned __int128 q;
+    if (!divide(scaled_variance(), (unsigned __int128)m_count * (m_count - sample),
+                2 * int(m_scale) - e10, mode, false, q))
+        throw std::runtime_error("CurrencyStats: variance overflow");
+    return currency_from_wide(__int128(q), e10);
+}
+
+inline Currency CurrencyStats::stddev(exp10_t e10, RoundingMode mode, bool sample) const
+{
+    if (m_count < (sample ? 2U : 1U))
+        return Currency();
+
+    // v + r/den is the exact variance in units of 10^(2 * e10), and x the
+    // integer square root of v, which is also that of the exact variance
+    unsigned __int128 den = (unsigned __int128)m_count * (m_count - sample), v, r;
+    if (!divide(scaled_variance(), den, 2 * (int(m_scale) - e10), v, r))
+        throw std::runtime_error("CurrencyStats: variance overflow");
+    unsigned __int128 x = (unsigned __int128)std::sqrt((long double)v);
+    while (x * x > v)
+        --x;
+    while ((x + 1) * (x + 1) <= v)
+        ++x;
+
+    // sqrt(variance) against x + 1/2, i.e. the variance against x^2 + x + 1/4
+    int half_cmp;
+    if (v != x * x + x)
+        half_cmp = (v < x * x + x) ? -1 : 1;
+    else
+        half_cmp = (r < den / 4 || (r == den / 4 && den % 4)) ? -1
+                 : (r == den / 4) ? 0 : 1;
+    if (round_increment(mode, x & 1, half_cmp, v != x * x || r != 0, false))
+        ++x;
+    return currency_from_wide(__int128(x), e10);
+}
+
+// the stats of the rows of column spread over threads, merged in order
+inline CurrencyStats
+column_stats(const CurrencyColumn& column, exp10_t scale, std::vector<size_t>& invalid,
+             unsigned int threads = 0)
+{
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    threads = unsigned(std::min<size_t>(threads, column.size() / 65536 + 1));
+
+    std::vector<CurrencyStats> parts(threads, CurrencyStats(scale));
+    std::vector<std::vector<size_t> > part_invalid(threads);
+    const size_t chunk = (column.size() + threads - 1) / threads;
+    parallel_for(threads, threads, [&](unsigned int, size_t t) {
+        const size_t first = std::min(column.size(), t * chunk);
+        parts[t].add(column, first, std::min(column.size(), first + chunk), part_invalid[t]);
+    });
+
+    for (unsigned int t = 1; t < threads; ++t)
+        parts[0].merge(parts[t]);
+    for (unsigned int t = 0; t < threads; ++t)
+        invalid.insert(invalid.end(), part_invalid[t].begin(), part_invalid[t].end());
+    return parts[0];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// CurrencyQuantiles
+//
+// Percentiles of amounts. The amounts are kept as integer units of
+// 10^scale, which order like the amounts themselves, and each percentile
+// selects its neighbours with std::nth_element in linear time instead of
+// sorting. A percentile between two values is interpolated linearly, as by
+// most spreadsheets (rank (count - 1) * p), and returned exactly.
+
+class CurrencyQuantiles
+{
+protected:
+    exp10_t m_scale;
+    std::vector<int64_t> m_keys;
+
+public:
+    explicit CurrencyQuantiles(exp10_t scale = -2)
+        : m_scale(scale)
+    {
+    }
+
+    size_t size() const
+    {
+        return m_keys.size();
+    }
+    void clear()
+    {
+        m_keys.clear();
+    }
+
+    void add_units(int64_t units)
+    {
+        m_keys.push_back(units);
+    }
+    bool add(const Currency& value)
+    {
+        int64_t units;
+        if (!currency_to_units(value, m_scale, units))
+            return false;
+        m_keys.push_back(units);
+        return true;
+    }
+    size_t add(const Currency *values, size_t count, std::vector<size_t>& invalid)
+    {
+        const size_t invalid_count = invalid.size();
+        m_keys.reserve(m_keys.size() + count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (!add(values[i]))
+                invalid.push_back(i);
+        }
+        return invalid.size() - invalid_count;
+    }
+    size_t add(const CurrencyColumn& column, std::vector<size_t>& invalid)
+    {
+        const size_t invalid_count = invalid.size();
+        m_keys.reserve(m_keys.size() + column.size());
+        for (size_t i = 0; i < column.size(); ++i)
+        {
+            int64_t units = 0;
+            if (column.significands()[i] != 0 &&
+                (column.exp10s()[i] < m_scale ||
+                 !rescale_significand(column.significands()[i], column.exp10s()[i], m_scale,
+                                      units)))
+                invalid.push_back(i);
+            else
+                m_keys.push_back(units);
+        }
+        return invalid.size() - invalid_count;
+    }
+    // appends the values of another, e.g. of a part filled on another thread
+    void merge(const CurrencyQuantiles& another)
+    {
+        if (another.m_scale != m_scale)
+            throw std::runtime_error("CurrencyQuantiles: merging different scales");
+        m_keys.insert(m_keys.end(), another.m_keys.begin(), another.m_keys.end());
+    }
+
+    // p is from 0 to 1 with at most 18 decimals; zero if there are no values
+    Currency percentile(const Currency& p);
+    Currency median()
+    {
+        return percentile(Currency(5, -1));
+    }
+
+    static void unittest();
+};
+
+inline Currency CurrencyQuantiles::percentile(const Currency& p)
+{
+    int64_t fraction;
+    const exp10_t e10 = std::min<exp10_t>(p.exp10(), 0);
+    if (!currency_to_units(p, e10, fraction) || e10 < -18 || p.is_negative() ||
+        uint64_t(fraction) > pow10_u64(-e10))
+        throw std::runtime_error("CurrencyQuantiles: invalid percentile");
+    if (m_keys.empty())
+        return Currency();
+
+    // the rank (size - 1) * p splits into index + remainder / 10^-e10
+    const uint64_t one = pow10_u64(-e10);
+    const unsigned __int128 rank = (unsigned __int128)(m_keys.size() - 1) * uint64_t(fraction);
+    const size_t index = size_t(rank / one);
+    const uint64_t remainder = uint64_t(rank % one);
+
+    std::vector<int64_t>::iterator nth = m_keys.begin() + index;
+    std::nth_element(m_keys.begin(), nth, m_keys.end());
+    __int128 units = __int128(*nth) * one;
+    if (remainder)
+    {
+        // the next value is the least of those after the nth
+        const int64_t next = *std::min_element(nth + 1, m_keys.end());
+        units += __int128(remainder) * (__int128(next) - *nth);
+    }
+    return currency_from_wide(units, exp10_t(m_scale + e10));
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -26,60 +26,66 @@ inline significand_t UnsignedCurrency::upow10(exp10_t e10)
     return ret;
 }
 
-inline std::string
-UnsignedCurrency::add_helper(std::string a, std::string b)
-{
-    assert(a.size() == b.size());
-
-    std::reverse(a.begin(), a.end());
-    std::reverse(b.begin(), b.end());
-
-    bool carry = false;
-    for (size_t i = 0; i < a.size(); ++i)
-    {
-        a[i] = char(a[i] + b[i] + carry - '0');
-        carry = (a[i] > '9');
-        if (carry)
+// scales a and b to a common exponent, which is returned. the coarser one
+// is scaled up by at most 10^19; below that, the digits of the finer one
+// are truncated (or rounded up if it is b and round_up_b is set), and
+// inexact tells whether any of them was nonzero.
+inline exp10_t
+UnsignedCurrency::align(const UnsignedCurrency& a, const UnsignedCurrency& b,
+                        unsigned __int128& x, unsigned __int128& y,
+                        bool round_up_b, bool& inexact)
+{
+    x = uint64_t(a.m_significand);
+    y = uint64_t(b.m_significand);
+    inexact = false;
+    if (a.m_exp10 == b.m_exp10)
+        return a.m_exp10;
+
+    const bool a_coarse = (a.m_exp10 > b.m_exp10);
+    unsigned __int128& coarse = (a_coarse ? x : y);
+    unsigned __int128& fine = (a_coarse ? y : x);
+    const int64_t diff = a_coarse ? int64_t(a.m_exp10) - b.m_exp10
+                                  : int64_t(b.m_exp10) - a.m_exp10;
+    const int shift = int(std::min<int64_t>(diff, 19));
+
+    coarse *= pow10_u64(shift);
+    if (diff > shift)
+    {
+        uint64_t f = uint64_t(fine), q = 0;
+        if (diff - shift <= 19)
         {
-            a[i] -= 10;
+            uint64_t p = pow10_u64(int(diff - shift));
+            q = f / p;
+            inexact = (q * p != f);
         }
+        else
+        {
+            inexact = (f != 0);
+        }
+        if (inexact && round_up_b && a_coarse)
+            ++q;
+        fine = q;
     }
-
-    if (carry)
-    {
-        a += char('0' + carry);
-    }
-
-    std::reverse(a.begin(), a.end());
-    return a;
+    return exp10_t(std::max(a.m_exp10, b.m_exp10) - shift);
 }
 
-inline std::string
-UnsignedCurrency::sub_helper(std::string a, std::string b)
+// sets significand * 10^exp10, truncating the digits that do not fit
+inline void
+UnsignedCurrency::assign_wide(unsigned __int128 significand, exp10_t exp10)
 {
-    assert(a.size() == b.size());
-
-    std::reverse(a.begin(), a.end());
-    std::reverse(b.begin(), b.end());
-
-    bool borrow = false;
-    for (size_t i = 0; i < a.size(); ++i)
+    while (significand > (unsigned __int128)max_significand)
     {
-        a[i] = char(a[i] - b[i] - borrow + '0');
-        borrow = (a[i] < '0');
-        if (borrow)
+        significand /= 10;
+        if (__builtin_add_overflow(exp10, 1, &exp10))
         {
-            a[i] += 10;
+            KHMZ_COUNT(CC_SATURATE_INF);
+            set_inf();
+            return;
         }
     }
-
-    if (borrow)
-    {
-        throw std::runtime_error("UnsignedCurrency::sub_helper");
-    }
-
-    std::reverse(a.begin(), a.end());
-    return a;
+    m_significand = significand_t(significand);
+    m_exp10 = exp10;
+    normalize();
 }
 
 inline void UnsignedCurrency::normalize()
@@ -100,26 +106,26 @@ inline void UnsignedCurrency::normalize()
     assert(is_normalized());
 }
 
-inline void UnsignedCurrency::parse(const char *str)
+inline bool UnsignedCurrency::try_parse(const char *first, const char *last)
 {
     m_significand = 0;
     m_exp10 = 0;
 
-    while (*str == ' ')
-        ++str;
+    while (first != last && *first == ' ')
+        ++first;
 
-    if (std::strcmp(str, "inf") == 0)
+    if (last - first == 3 && std::memcmp(first, "inf", 3) == 0)
     {
         set_inf();
-        return;
+        return true;
     }
 
-    while (*str == '0')
-        ++str;
+    while (first != last && *first == '0')
+        ++first;
 
-    for (bool found_dot = false; *str; ++str)
+    for (bool found_dot = false; first != last; ++first)
     {
-        if (*str == '.')
+        if (*first == '.')
         {
             found_dot = true;
             continue;
@@ -129,51 +135,63 @@ inline void UnsignedCurrency::parse(const char *str)
         {
             if (__builtin_sub_overflow(m_exp10, 1, &m_exp10))
             {
+                KHMZ_COUNT(CC_PARSE_TRUNCATE);
                 ++m_exp10;
                 normalize();
-                return;
+                return true;
             }
         }
 
-        if ('0' <= *str && *str <= '9')
+        if ('0' <= *first && *first <= '9')
         {
             significand_t save = m_significand;
             if (__builtin_mul_overflow(m_significand, 10, &m_significand))
             {
                 if (m_exp10 == 0)
                 {
+                    KHMZ_COUNT(CC_SATURATE_INF);
                     set_inf();
                 }
                 else
                 {
+                    KHMZ_COUNT(CC_PARSE_TRUNCATE);
                     m_significand = save;
                     ++m_exp10;
                 }
                 normalize();
-                return;
+                return true;
             }
-            if (__builtin_add_overflow(m_significand, *str - '0', &m_significand))
+            if (__builtin_add_overflow(m_significand, *first - '0', &m_significand))
             {
                 if (m_exp10 == 0)
                 {
+                    KHMZ_COUNT(CC_SATURATE_INF);
                     set_inf();
                 }
                 else
                 {
+                    KHMZ_COUNT(CC_PARSE_TRUNCATE);
                     m_significand = save;
                     ++m_exp10;
                 }
                 normalize();
-                return;
+                return true;
             }
         }
         else
         {
-            throw std::runtime_error("UnsignedCurrency::UnsignedCurrency: invalid character");
+            return false;
         }
     }
 
     normalize();
+    return true;
+}
+
+inline void UnsignedCurrency::parse(const char *str)
+{
+    if (!try_parse(str, str + std::strlen(str)))
+        throw std::runtime_error("UnsignedCurrency::UnsignedCurrency: invalid character");
 }
 
 inline UnsignedCurrency::UnsignedCurrency(double value)
@@ -190,7 +208,9 @@ inline bool UnsignedCurrency::equals(const UnsignedCurrency& another) const
 {
     assert(is_normalized());
     assert(another.is_normalized());
-    return std::memcmp(this, &another, sizeof(another)) == 0;
+    // normalized values are equal only if both fields are; memcmp would
+    // also compare the padding after m_exp10
+    return m_significand == another.m_significand && m_exp10 == another.m_exp10;
 }
 
 inline int UnsignedCurrency::compare(const UnsignedCurrency& another) const
@@ -213,39 +233,16 @@ inline int UnsignedCurrency::compare(const UnsignedCurrency& another) const
         return 0;
     }
 
-    std::string a = std::to_string(m_significand);
-    std::string b = std::to_string(another.m_significand);
-
-    if (m_exp10 < another.m_exp10)
-    {
-        std::string zeros(another.m_exp10 - m_exp10, '0');
-        b += zeros;
-    }
-    else
-    {
-        std::string zeros(m_exp10 - another.m_exp10, '0');
-        a += zeros;
-    }
-
-    if (a.size() != b.size())
-    {
-        if (a.size() < b.size())
-        {
-            std::string zeros(b.size() - a.size(), '0');
-            a = zeros + a;
-        }
-        else
-        {
-            std::string zeros(a.size() - b.size(), '0');
-            b = zeros + b;
-        }
-    }
-
-    if (a < b)
-        return -1;
-    if (a > b)
-        return 1;
-    return 0;
+    KHMZ_COUNT(CC_COMPARE_ALIGN);
+    unsigned __int128 x, y;
+    bool inexact;
+    align(*this, another, x, y, false, inexact);
+    if (x != y)
+        return (x < y) ? -1 : 1;
+    if (!inexact)
+        return 0;
+    // the finer one has more nonzero digits
+    return (m_exp10 < another.m_exp10) ? 1 : -1;
 }
 
 inline UnsignedCurrency&
@@ -260,49 +257,20 @@ UnsignedCurrency::operator+=(const UnsignedCurrency& another)
     if (is_zero())
         return (*this = another);
 
-    if (m_exp10 == another.m_exp10)
+    significand_t sum;
+    if (m_exp10 == another.m_exp10 &&
+        !__builtin_add_overflow(m_significand, another.m_significand, &sum))
     {
-        m_significand += another.m_significand;
+        m_significand = sum;
         normalize();
         return *this;
     }
 
-    std::string a = std::to_string(m_significand);
-    std::string b = std::to_string(another.m_significand);
-
-    exp10_t min_exp10;
-    if (m_exp10 < another.m_exp10)
-    {
-        min_exp10 = m_exp10;
-        std::string zeros(another.m_exp10 - m_exp10, '0');
-        b += zeros;
-    }
-    else
-    {
-        min_exp10 = another.m_exp10;
-        std::string zeros(m_exp10 - another.m_exp10, '0');
-        a += zeros;
-    }
-
-    if (a.size() != b.size())
-    {
-        if (a.size() < b.size())
-        {
-            std::string zeros(b.size() - a.size(), '0');
-            a = zeros + a;
-        }
-        else
-        {
-            std::string zeros(a.size() - b.size(), '0');
-            b = zeros + b;
-        }
-    }
-
-    std::string c = add_helper(a, b);
-    parse(c.c_str());
-    m_exp10 += min_exp10;
-
-    normalize();
+    KHMZ_COUNT(CC_ADD_ALIGN);
+    unsigned __int128 x, y;
+    bool inexact;
+    exp10_t e10 = align(*this, another, x, y, false, inexact);
+    assign_wide(x + y, e10);
     return *this;
 }
 
@@ -326,45 +294,13 @@ UnsignedCurrency::operator-=(const UnsignedCurrency& another)
         return *this;
     }
 
-    std::string a = std::to_string(m_significand);
-    std::string b = std::to_string(another.m_significand);
-
-    exp10_t min_exp10;
-    if (m_exp10 < another.m_exp10)
-    {
-        min_exp10 = m_exp10;
-        std::string zeros(another.m_exp10 - m_exp10, '0');
-        b += zeros;
-    }
-    else
-    {
-        min_exp10 = another.m_exp10;
-        std::string zeros(m_exp10 - another.m_exp10, '0');
-        a += zeros;
-    }
-
-    if (a.size() != b.size())
-    {
-        if (a.size() < b.size())
-        {
-            std::string zeros(b.size() - a.size(), '0');
-            a = zeros + a;
-        }
-        else
-        {
-            std::string zeros(a.size() - b.size(), '0');
-            b = zeros + b;
-        }
-    }
-
-    if (a < b)
+    KHMZ_COUNT(CC_SUB_ALIGN);
+    unsigned __int128 x, y;
+    bool inexact;
+    exp10_t e10 = align(*this, another, x, y, true, inexact);
+    if (x < y)
         throw std::runtime_error("UnsignedCurrency::operator-=");
-
-    std::string c = sub_helper(a, b);
-    parse(c.c_str());
-    m_exp10 += min_exp10;
-
-    normalize();
+    assign_wide(x - y, e10);
     return *this;
 }
 
@@ -382,9 +318,11 @@ inline UnsignedCurrency& UnsignedCurrency::operator*=(const UnsignedCurrency& an
     significand_t significand;
     while (__builtin_mul_overflow(m_significand, another.m_significand, &significand))
     {
+        KHMZ_COUNT(CC_MUL_TRUNCATE);
         m_significand /= 10;
         if (__builtin_add_overflow(m_exp10, 1, &m_exp10))
         {
+            KHMZ_COUNT(CC_SATURATE_INF);
             set_inf();
             return *this;
         }
@@ -393,6 +331,7 @@ inline UnsignedCurrency& UnsignedCurrency::operator*=(const UnsignedCurrency& an
 
     if (__builtin_add_overflow(m_exp10, another.m_exp10, &m_exp10))
     {
+        KHMZ_COUNT(CC_SATURATE_INF);
         set_inf();
         return *this;
     }
@@ -437,6 +376,59 @@ inline std::string UnsignedCurrency::to_string() const
     return str;
 }
 
+inline char *UnsignedCurrency::to_chars(char *first, char *last) const
+{
+    assert(is_normalized());
+
+    if (is_inf())
+    {
+        if (last - first < 3)
+            return NULL;
+        std::memcpy(first, "inf", 3);
+        return first + 3;
+    }
+
+    char digits[20];
+    char *end = digits + sizeof(digits), *begin = end;
+    uint64_t sig = uint64_t(m_significand);
+    do
+    {
+        *--begin = char('0' + sig % 10);
+        sig /= 10;
+    } while (sig);
+    const int64_t count = end - begin;
+
+    // 123456000...0, 1234.56... or 0.0000123456...
+    int64_t size = count;
+    if (m_exp10 > 0)
+        size += m_exp10;
+    else if (m_exp10 < 0)
+        size += (-int64_t(m_exp10) < count) ? 1 : 2 - m_exp10 - count;
+    if (last - first < size)
+        return NULL;
+
+    char *out = first;
+    if (m_exp10 >= 0)
+    {
+        out = std::copy(begin, end, out);
+        out = std::fill_n(out, m_exp10, '0');
+    }
+    else if (-int64_t(m_exp10) < count)
+    {
+        out = std::copy(begin, end + m_exp10, out);
+        *out++ = '.';
+        out = std::copy(end + m_exp10, end, out);
+    }
+    else
+    {
+        *out++ = '0';
+        *out++ = '.';
+        out = std::fill_n(out, -m_exp10 - count, '0');
+        out = std::copy(begin, end, out);
+    }
+    return out;
+}
+
 inline UnsignedCurrency&
 UnsignedCurrency::operator/=(const UnsignedCurrency& another)
 {
@@ -483,17 +475,26 @@ inline bool UnsignedCurrency::is_inf() const
 //////////////////////////////////////////////////////////////////////////////
 // Currency
 
-inline void Currency::parse(const char *str)
+inline bool Currency::try_parse(const char *first, const char *last)
 {
-    while (*str == ' ')
-        ++str;
+    while (first != last && *first == ' ')
+        ++first;
+
+    m_negative = (first != last && *first == '-');
+    if (first != last && (m_negative || *first == '+'))
+        ++first;
 
-    m_negative = (*str == '-');
-    if (m_negative || *str == '+')
-        ++str;
+    if (!m_base.try_parse(first, last))
+        return false;
 
-    m_base.parse(str);
     normalize();
+    return true;
+}
+
+inline void Currency::parse(const char *str)
+{
+    if (!try_parse(str, str + std::strlen(str)))
+        throw std::runtime_error("UnsignedCurrency::UnsignedCurrency: invalid character");
 }
 
 inline Currency::Currency(double value)
@@ -601,6 +602,17 @@ inline std::string Currency::to_string() const
     return m_base.to_string();
 }
 
+inline char *Currency::to_chars(char *first, char *last) const
+{
+    if (is_negative())
+    {
+        if (first == last)
+            return NULL;
+        *first++ = '-';
+    }
+    return m_base.to_chars(first, last);
+}
+
 inline Currency&
 Currency::operator/=(const Currency& another)
 {
@@ -614,10 +626,12 @@ inline void Currency::invert()
     base_t a = base();
     if (a <= base_t::epsilon)
     {
+        KHMZ_COUNT(CC_SATURATE_INF);
         set_inf();
         return;
     }
 
+    KHMZ_COUNT(CC_INVERT_DOUBLE);
     const Currency alpha(a), one(1), two(2);
     Currency x(1 / (double)a), y, h;
 
@@ -626,6 +640,32 @@ inline void Currency::invert()
     base() = x.base();
 }
 
+inline void Currency::round(exp10_t e10, RoundingMode mode)
+{
+    assert(is_normalized());
+
+    if (is_inf() || is_zero() || m_base.exp10() >= e10)
+        return;
+
+    uint64_t sig = uint64_t(m_base.significand());
+    int64_t diff = int64_t(e10) - m_base.exp10();
+    uint64_t q = 0, r = sig;
+    int half_cmp = -1;
+    if (diff <= 19)
+    {
+        uint64_t p = pow10_u64(int(diff));
+        q = sig / p;
+        r = sig % p;
+        half_cmp = half_compare(r, p);
+    }
+
+    if (round_increment(mode, q & 1, half_cmp, r != 0, m_negative))
+        ++q;
+
+    m_base = base_t(significand_t(q), e10);
+    normalize();
+}
+
 inline Currency Currency::get_inverted() const
 {
     Currency ret(*this);
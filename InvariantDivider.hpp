@@ -0,0 +1,110 @@
+// InvariantDivider.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// InvariantDivider
+//
+// Division of 128-bit dividends by a fixed 64-bit divisor with a
+// precomputed reciprocal, in the style of libdivide. Each step is one
+// multiply-high and a couple of corrections instead of a hardware (or
+// library) 128-bit division. See Moller & Granlund, "Improved division by
+// invariant integers" (2011), algorithm 4.
+
+class InvariantDivider
+{
+protected:
+    uint64_t m_divisor;
+    uint64_t m_normalized;  // m_divisor << m_shift; the top bit is set
+    uint64_t m_reciprocal;  // floor((2^128 - 1) / m_normalized) - 2^64
+    unsigned int m_shift;
+
+    // divides <u1, u0> by m_normalized; u1 must be less than it
+    uint64_t div_2by1(uint64_t u1, uint64_t u0, uint64_t& r) const
+    {
+        const uint64_t d = m_normalized;
+        unsigned __int128 q = (unsigned __int128)m_reciprocal * u1;
+        q += ((unsigned __int128)u1 << 64) | u0;
+        uint64_t q1 = uint64_t(q >> 64) + 1;
+        uint64_t q0 = uint64_t(q);
+        r = u0 - q1 * d;
+        if (r > q0)
+        {
+            --q1;
+            r += d;
+        }
+        if (r >= d)
+        {
+            ++q1;
+            r -= d;
+        }
+        return q1;
+    }
+
+public:
+    InvariantDivider()
+        : m_divisor(1)
+        , m_normalized(uint64_t(1) << 63)
+        , m_reciprocal(~uint64_t(0))
+        , m_shift(63)
+    {
+    }
+
+    explicit InvariantDivider(uint64_t divisor)
+        : m_divisor(divisor)
+    {
+        if (divisor == 0)
+            throw std::runtime_error("InvariantDivider: division by zero");
+        m_shift = __builtin_clzll(divisor);
+        m_normalized = divisor << m_shift;
+        m_reciprocal = uint64_t((((unsigned __int128)~m_normalized) << 64 | ~uint64_t(0)) /
+                                m_normalized);
+    }
+
+    uint64_t divisor() const
+    {
+        return m_divisor;
+    }
+
+    unsigned __int128 divide(unsigned __int128 n, uint64_t& remainder) const
+    {
+        uint64_t hi = uint64_t(n >> 64), lo = uint64_t(n);
+        uint64_t n2 = 0, n1 = hi, n0 = lo;
+        if (m_shift)
+        {
+            n2 = hi >> (64 - m_shift);
+            n1 = (hi << m_shift) | (lo >> (64 - m_shift));
+            n0 = lo << m_shift;
+        }
+        uint64_t r;
+        uint64_t q1 = div_2by1(n2, n1, r);
+        uint64_t q0 = div_2by1(r, n0, r);
+        remainder = r >> m_shift;
+        return ((unsigned __int128)q1 << 64) | q0;
+    }
+
+    uint64_t divide(uint64_t n, uint64_t& remainder) const
+    {
+        uint64_t n1 = 0, n0 = n;
+        if (m_shift)
+        {
+            n1 = n >> (64 - m_shift);
+            n0 = n << m_shift;
+        }
+        uint64_t r;
+        uint64_t q = div_2by1(n1, n0, r);
+        remainder = r >> m_shift;
+        return q;
+    }
+};
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,172 @@
+// MappedFile.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// MappedFile --- read-only memory mapping of a whole file
+
+class MappedFile
+{
+protected:
+    const char *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+
+public:
+    MappedFile()
+        : m_data(NULL)
+        , m_size(0)
+#ifdef _WIN32
+        , m_file(INVALID_HANDLE_VALUE)
+        , m_mapping(NULL)
+#else
+        , m_fd(-1)
+#endif
+    {
+    }
+
+    explicit MappedFile(const char *path)
+        : MappedFile()
+    {
+        open(path);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const char *path);
+    void close();
+
+    bool is_open() const
+    {
+#ifdef _WIN32
+        return m_file != INVALID_HANDLE_VALUE;
+#else
+        return m_fd != -1;
+#endif
+    }
+
+    const char *data() const
+    {
+        return m_data;
+    }
+    size_t size() const
+    {
+        return m_size;
+    }
+};
+
+inline bool MappedFile::open(const char *path)
+{
+    close();
+
+#ifdef _WIN32
+    m_file = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(m_file, &size))
+    {
+        close();
+        return false;
+    }
+    m_size = size_t(size.QuadPart);
+    if (m_size == 0)
+        return true;
+
+    m_mapping = ::CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_mapping)
+    {
+        close();
+        return false;
+    }
+
+    m_data = (const char *)::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data)
+    {
+        close();
+        return false;
+    }
+#else
+    m_fd = ::open(path, O_RDONLY);
+    if (m_fd == -1)
+        return false;
+
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0)
+    {
+        close();
+        return false;
+    }
+    m_size = size_t(st.st_size);
+    if (m_size == 0)
+        return true;
+
+    void *ptr = ::mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    ::madvise(ptr, m_size, MADV_SEQUENTIAL);
+    m_data = (const char *)ptr;
+#endif
+
+    return true;
+}
+
+inline void MappedFile::close()
+{
+#ifdef _WIN32
+    if (m_data)
+        ::UnmapViewOfFile(m_data);
+    if (m_mapping)
+        ::CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        ::CloseHandle(m_file);
+    m_mapping = NULL;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_data)
+        ::munmap((void *)m_data, m_size);
+    if (m_fd != -1)
+        ::close(m_fd);
+    m_fd = -1;
+#endif
+    m_data = NULL;
+    m_size = 0;
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
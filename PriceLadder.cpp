@@ -0,0 +1,141 @@
+// PriceLadder.cpp
+//////////////////////////////////////////////////////////////////////////////
+
+#include "PriceLadder.hpp"
+#include <random>
+
+namespace khmz
+{
+
+void PriceLadder::unittest()
+{
+    PriceLadder ladder(Currency("0.25"), -2, 128);
+    assert(ladder.tick() == "0.25");
+
+    int64_t ticks;
+    assert(ladder.to_ticks(Currency("100.75"), ticks) && ticks == 403);
+    assert(ladder.to_ticks(Currency("-0.5"), ticks) && ticks == -2);
+    assert(!ladder.to_ticks(Currency("100.1"), ticks));
+    assert(!ladder.to_ticks(Currency("0.125"), ticks));
+    assert(ladder.to_price(403) == "100.75");
+
+    Currency price, size;
+    assert(!ladder.best(SIDE_BID, price, size));
+    ladder.set(SIDE_BID, Currency("100"), Currency("5"));
+    ladder.set(SIDE_BID, Currency("99.75"), Currency("1.5"));
+    ladder.set(SIDE_ASK, Currency("100.25"), Currency("2"));
+    ladder.set(SIDE_ASK, Currency("100.5"), Currency("0.01"));
+    assert(ladder.best(SIDE_BID, price, size) && price == "100" && size == "5");
+    assert(ladder.best(SIDE_ASK, price, size) && price == "100.25" && size == "2");
+    assert(ladder.levels(SIDE_BID) == 2 && ladder.total_size(SIDE_BID) == "6.5");
+
+    assert(ladder.add(SIDE_BID, Currency("100"), Currency("-5")).is_zero());
+    assert(ladder.best(SIDE_BID, price, size) && price == "99.75" && size == "1.5");
+    assert(ladder.add(SIDE_ASK, Currency("100.25"), Currency("0.5")) == "2.5");
+    assert(ladder.size_at(SIDE_ASK, Currency("100.25")) == "2.5");
+    assert(ladder.size_at(SIDE_ASK, Currency("123")).is_zero());
+
+    // sizes in hundreds; a zero size still removes the level
+    PriceLadder lots(Currency("0.01"), 2);
+    lots.set(SIDE_BID, Currency(1), Currency(300));
+    assert(lots.levels(SIDE_BID) == 1);
+    lots.set(SIDE_BID, Currency(1), Currency());
+    assert(lots.levels(SIDE_BID) == 0);
+
+    // levels far from the best spill out of the window and come back
+    ladder.set(SIDE_BID, Currency("10"), Currency("7"));
+    ladder.set(SIDE_BID, Currency("200"), Currency("3"));
+    assert(ladder.best(SIDE_BID, price, size) && price == "200" && size == "3");
+    assert(ladder.levels(SIDE_BID) == 3 && ladder.total_size(SIDE_BID) == "11.5");
+    ladder.set(SIDE_BID, Currency("200"), Currency());
+    assert(ladder.best(SIDE_BID, price, size) && price == "99.75");
+    ladder.set(SIDE_BID, Currency("99.75"), Currency());
+    assert(ladder.best(SIDE_BID, price, size) && price == "10" && size == "7");
+    assert(ladder.levels(SIDE_BID) == 1);
+
+    std::vector<Currency> prices;
+    ladder.for_each(SIDE_ASK, [&](int64_t t, int64_t) {
+        prices.push_back(ladder.to_price(t));
+    });
+    assert(prices.size() == 2 && prices[0] == "100.25" && prices[1] == "100.5");
+
+    bool thrown = false;
+    try
+    {
+        ladder.set(SIDE_ASK, Currency("1.01"), Currency(1));
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    thrown = false;
+    try
+    {
+        ladder.add(SIDE_ASK, Currency("100.5"), Currency("-1"));
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // against std::map over a random walk
+    PriceLadder walk(Currency("0.01"), 0, 64);
+    std::map<int64_t, int64_t> reference[2];
+    std::mt19937_64 rng(43);
+    int64_t mid = 10000;
+    for (int i = 0; i < 20000; ++i)
+    {
+        mid += int64_t(rng() % 7) - 3;
+        LadderSide side = (rng() & 1) ? SIDE_BID : SIDE_ASK;
+        int64_t t = mid + ((side == SIDE_BID) ? -1 : 1) * int64_t(rng() % 200);
+        int64_t units = (rng() % 3 == 0) ? 0 : int64_t(rng() % 100);
+        walk.set_units(side, t, units);
+        if (units)
+            reference[side][t] = units;
+        else
+            reference[side].erase(t);
+
+        int64_t best_ticks, best_units;
+        const std::map<int64_t, int64_t>& ref = reference[side];
+        assert(walk.levels(side) == ref.size());
+        if (ref.empty())
+        {
+            assert(!walk.best(side, best_ticks, best_units));
+            continue;
+        }
+        assert(walk.best(side, best_ticks, best_units));
+        if (side == SIDE_BID)
+            assert(best_ticks == ref.rbegin()->first && best_units == ref.rbegin()->second);
+        else
+            assert(best_ticks == ref.begin()->first && best_units == ref.begin()->second);
+    }
+    for (int side = 0; side < 2; ++side)
+    {
+        __int128 total = 0;
+        std::vector<int64_t> order;
+        for (std::map<int64_t, int64_t>::const_iterator it = reference[side].begin();
+             it != reference[side].end(); ++it)
+        {
+            total += it->second;
+            order.push_back(it->first);
+        }
+        if (side == SIDE_BID)
+            std::reverse(order.begin(), order.end());
+        assert(walk.total_units(LadderSide(side)) == total);
+
+        size_t k = 0;
+        walk.for_each(LadderSide(side), [&](int64_t t, int64_t units) {
+            assert(k < order.size() && order[k] == t && units == reference[side][t]);
+            ++k;
+        });
+        assert(k == order.size());
+    }
+
+    puts("PriceLadder::unittest: OK.");
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,402 @@
+// PriceLadder.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include <map>
+#include <vector>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// PriceLadder
+//
+// The price levels of an order book. Prices are converted once to integer
+// tick indices (price / tick) and sizes to integer units of 10^size_scale,
+// so that no Currency is compared on the hot path. Each side keeps the
+// levels within a window of ticks in a flat array with a bitmap of the
+// nonempty ones; levels outside it spill into a sorted map. The window is
+// recentred on the best price when that leaves it. The best level is cached,
+// so best() is O(1), and so is updating a level within the window.
+//
+// A price that is not a multiple of the tick or a size finer than the size
+// scale throws std::runtime_error, as does a level size that overflows or
+// becomes negative.
+
+enum LadderSide
+{
+    SIDE_BID,
+    SIDE_ASK
+};
+
+class PriceLadder
+{
+protected:
+    struct Side
+    {
+        bool bid;
+        int64_t base;                       // the ticks of sizes[0]
+        std::vector<int64_t> sizes;         // the window, in size units
+        std::vector<uint64_t> bits;         // the nonempty levels of the window
+        size_t window_levels;
+        std::map<int64_t, int64_t> far;     // the levels outside the window
+        int64_t best;                       // valid if there is a level
+        __int128 total;
+
+        bool in_window(int64_t ticks) const
+        {
+            return ticks >= base && uint64_t(ticks - base) < sizes.size();
+        }
+        bool better(int64_t a, int64_t b) const
+        {
+            return bid ? a > b : a < b;
+        }
+        size_t levels() const
+        {
+            return window_levels + far.size();
+        }
+
+        int64_t get(int64_t ticks) const;
+        int64_t set(int64_t ticks, int64_t units);  // returns the old size
+        void find_best(int64_t removed);
+        void recenter(int64_t center);
+        void clear();
+    };
+
+    significand_t m_tick_units;
+    exp10_t m_tick_exp10;
+    exp10_t m_size_scale;
+    Side m_sides[2];
+
+public:
+    explicit PriceLadder(const Currency& tick, exp10_t size_scale = 0, size_t window = 4096);
+
+    Currency tick() const
+    {
+        return Currency(m_tick_units, m_tick_exp10);
+    }
+    exp10_t size_scale() const
+    {
+        return m_size_scale;
+    }
+
+    // price / tick; false if price is not a multiple of the tick
+    bool to_ticks(const Currency& price, int64_t& ticks) const;
+    Currency to_price(int64_t ticks) const
+    {
+        return currency_from_wide(__int128(ticks) * m_tick_units, m_tick_exp10);
+    }
+
+    // the tick-level interface; sizes are in units of 10^size_scale
+    int64_t units_at(LadderSide side, int64_t ticks) const
+    {
+        return m_sides[side].get(ticks);
+    }
+    // sets the size of a level; zero removes it
+    void set_units(LadderSide side, int64_t ticks, int64_t units)
+    {
+        if (units < 0)
+            throw std::runtime_error("PriceLadder: negative size");
+        m_sides[side].set(ticks, units);
+    }
+    // adds delta to the size of a level and returns the new size
+    int64_t add_units(LadderSide side, int64_t ticks, int64_t delta)
+    {
+        int64_t units;
+        if (__builtin_add_overflow(m_sides[side].get(ticks), delta, &units))
+            throw std::runtime_error("PriceLadder: size overflow");
+        set_units(side, ticks, units);
+        return units;
+    }
+    // the best (highest bid or lowest ask) level; false if the side is empty
+    bool best(LadderSide side, int64_t& ticks, int64_t& units) const
+    {
+        const Side& s = m_sides[side];
+        if (s.levels() == 0)
+            return false;
+        ticks = s.best;
+        units = s.get(ticks);
+        return true;
+    }
+
+    // the Currency interface
+    Currency size_at(LadderSide side, const Currency& price) const
+    {
+        return Currency(significand_t(units_at(side, price_ticks(price))), m_size_scale);
+    }
+    void set(LadderSide side, const Currency& price, const Currency& size)
+    {
+        set_units(side, price_ticks(price), size_units(size));
+    }
+    Currency add(LadderSide side, const Currency& price, const Currency& delta)
+    {
+        int64_t units = add_units(side, price_ticks(price), size_units(delta));
+        return Currency(significand_t(units), m_size_scale);
+    }
+    bool best(LadderSide side, Currency& price, Currency& size) const
+    {
+        int64_t ticks, units;
+        if (!best(side, ticks, units))
+            return false;
+        price = to_price(ticks);
+        size = Currency(significand_t(units), m_size_scale);
+        return true;
+    }
+
+    size_t levels(LadderSide side) const
+    {
+        return m_sides[side].levels();
+    }
+    // the exact sum of the sizes of a side
+    __int128 total_units(LadderSide side) const
+    {
+        return m_sides[side].total;
+    }
+    Currency total_size(LadderSide side) const
+    {
+        return currency_from_wide(m_sides[side].total, m_size_scale);
+    }
+
+    // calls fn(ticks, units) for each level of a side, best first
+    template <typename Fn>
+    void for_each(LadderSide side, Fn fn) const;
+
+    void clear()
+    {
+        m_sides[SIDE_BID].clear();
+        m_sides[SIDE_ASK].clear();
+    }
+
+    static void unittest();
+
+protected:
+    int64_t price_ticks(const Currency& price) const
+    {
+        int64_t ticks;
+        if (!to_ticks(price, ticks))
+            throw std::runtime_error("PriceLadder: price is not a multiple of the tick");
+        return ticks;
+    }
+    int64_t size_units(const Currency& size) const
+    {
+        int64_t units;
+        if (!currency_to_units(size, m_size_scale, units))
+            throw std::runtime_error("PriceLadder: size out of scale");
+        return units;
+    }
+};
+
+inline PriceLadder::PriceLadder(const Currency& tick, exp10_t size_scale, size_t window)
+    : m_tick_units(tick.significand())
+    , m_tick_exp10(tick.exp10())
+    , m_size_scale(size_scale)
+{
+    if (tick.is_inf() || m_tick_units <= 0)
+        throw std::runtime_error("PriceLadder: invalid tick");
+
+    window = std::max<size_t>((window + 63) / 64, 1) * 64;
+    for (int i = 0; i < 2; ++i)
+    {
+        Side& s = m_sides[i];
+        s.bid = (i == SIDE_BID);
+        s.sizes.assign(window, 0);
+        s.bits.assign(window / 64, 0);
+        s.clear();
+    }
+}
+
+inline bool PriceLadder::to_ticks(const Currency& price, int64_t& ticks) const
+{
+    int64_t units;
+    if (!currency_to_units(price, m_tick_exp10, units) || units % m_tick_units != 0)
+        return false;
+    ticks = units / m_tick_units;
+    return true;
+}
+
+inline int64_t PriceLadder::Side::get(int64_t ticks) const
+{
+    if (in_window(ticks))
+        return sizes[size_t(ticks - base)];
+    std::map<int64_t, int64_t>::const_iterator it = far.find(ticks);
+    return (it == far.end()) ? 0 : it->second;
+}
+
+inline int64_t PriceLadder::Side::set(int64_t ticks, int64_t units)
+{
+    // the first level centres the window on itself
+    if (levels() == 0 && !in_window(ticks))
+        base = ticks - int64_t(sizes.size() / 2);
+
+    int64_t old;
+    if (in_window(ticks))
+    {
+        const size_t index = size_t(ticks - base);
+        old = sizes[index];
+        sizes[index] = units;
+        const uint64_t bit = uint64_t(1) << (index & 63);
+        if (units)
+            bits[index >> 6] |= bit;
+        else
+            bits[index >> 6] &= ~bit;
+        window_levels += (units != 0);
+        window_levels -= (old != 0);
+    }
+    else
+    {
+        std::map<int64_t, int64_t>::iterator it = far.find(ticks);
+        old = (it == far.end()) ? 0 : it->second;
+        if (units)
+        {
+            if (it == far.end())
+                far.insert(std::make_pair(ticks, units));
+            else
+                it->second = units;
+        }
+        else if (it != far.end())
+        {
+            far.erase(it);
+        }
+    }
+    total += units - old;
+
+    if (units && (levels() == 1 || better(ticks, best)))
+        best = ticks;
+    else if (!units && old && ticks == best)
+        find_best(ticks);
+
+    if (levels() && !in_window(best))
+        recenter(best);
+    return old;
+}
+
+// finds the best level after removing the best one at removed
+inline void PriceLadder::Side::find_best(int64_t removed)
+{
+    if (levels() == 0)
+        return;
+
+    bool found = false;
+    if (window_levels)
+    {
+        // the levels between the removed one and the window edge are empty
+        const int64_t words = int64_t(bits.size());
+        if (bid)
+        {
+            int64_t index = std::min<int64_t>(removed - base, int64_t(sizes.size()) - 1);
+            for (int64_t w = index >> 6; w >= 0 && !found; --w)
+            {
+                uint64_t word = bits[size_t(w)];
+                if (w == index >> 6 && (index & 63) != 63)
+                    word &= (uint64_t(1) << ((index & 63) + 1)) - 1;
+                if (word)
+                {
+                    best = base + w * 64 + (63 - __builtin_clzll(word));
+                    found = true;
+                }
+            }
+        }
+        else
+        {
+            int64_t index = std::max<int64_t>(removed - base, 0);
+            for (int64_t w = index >> 6; w < words && !found; ++w)
+            {
+                uint64_t word = bits[size_t(w)];
+                if (w == index >> 6)
+                    word &= ~uint64_t(0) << (index & 63);
+                if (word)
+                {
+                    best = base + w * 64 + __builtin_ctzll(word);
+                    found = true;
+                }
+            }
+        }
+    }
+    if (!far.empty())
+    {
+        int64_t candidate = bid ? far.rbegin()->first : far.begin()->first;
+        if (!found || better(candidate, best))
+            best = candidate;
+    }
+}
+
+// moves the window so that center is in its middle
+inline void PriceLadder::Side::recenter(int64_t center)
+{
+    for (size_t w = 0; w < bits.size(); ++w)
+    {
+        for (uint64_t word = bits[w]; word; word &= word - 1)
+        {
+            const size_t index = w * 64 + size_t(__builtin_ctzll(word));
+            far.insert(std::make_pair(base + int64_t(index), sizes[index]));
+            sizes[index] = 0;
+        }
+        bits[w] = 0;
+    }
+    window_levels = 0;
+
+    base = center - int64_t(sizes.size() / 2);
+    std::map<int64_t, int64_t>::iterator first = far.lower_bound(base);
+    std::map<int64_t, int64_t>::iterator last = far.lower_bound(base + int64_t(sizes.size()));
+    for (std::map<int64_t, int64_t>::iterator it = first; it != last; ++it)
+    {
+        const size_t index = size_t(it->first - base);
+        sizes[index] = it->second;
+        bits[index >> 6] |= uint64_t(1) << (index & 63);
+        ++window_levels;
+    }
+    far.erase(first, last);
+}
+
+inline void PriceLadder::Side::clear()
+{
+    std::fill(sizes.begin(), sizes.end(), 0);
+    std::fill(bits.begin(), bits.end(), 0);
+    window_levels = 0;
+    far.clear();
+    base = 0;
+    best = 0;
+    total = 0;
+}
+
+template <typename Fn>
+inline void PriceLadder::for_each(LadderSide side, Fn fn) const
+{
+    const Side& s = m_sides[side];
+    const int64_t size = int64_t(s.sizes.size());
+
+    // the far levels better than the window, the window, then the rest
+    if (s.bid)
+    {
+        std::map<int64_t, int64_t>::const_reverse_iterator it = s.far.rbegin();
+        for (; it != s.far.rend() && it->first >= s.base + size; ++it)
+            fn(it->first, it->second);
+        for (int64_t i = size - 1; i >= 0; --i)
+        {
+            if (s.sizes[size_t(i)])
+                fn(s.base + i, s.sizes[size_t(i)]);
+        }
+        for (; it != s.far.rend(); ++it)
+            fn(it->first, it->second);
+    }
+    else
+    {
+        std::map<int64_t, int64_t>::const_iterator it = s.far.begin();
+        for (; it != s.far.end() && it->first < s.base; ++it)
+            fn(it->first, it->second);
+        for (int64_t i = 0; i < size; ++i)
+        {
+            if (s.sizes[size_t(i)])
+                fn(s.base + i, s.sizes[size_t(i)]);
+        }
+        for (; it != s.far.end(); ++it)
+            fn(it->first, it->second);
+    }
+}
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,86 @@
+// SharedMutex.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// SharedMutex --- a readers-writer lock (C++11 has no std::shared_mutex)
+
+class SharedMutex
+{
+protected:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_readers;
+    bool m_writer;
+
+public:
+    SharedMutex()
+        : m_readers(0)
+        , m_writer(false)
+    {
+    }
+
+    SharedMutex(const SharedMutex&) = delete;
+    SharedMutex& operator=(const SharedMutex&) = delete;
+
+    void lock()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return !m_writer; });
+        m_writer = true;
+        m_cond.wait(lock, [this]() { return m_readers == 0; });
+    }
+    void unlock()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_writer = false;
+        m_cond.notify_all();
+    }
+
+    void lock_shared()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return !m_writer; });
+        ++m_readers;
+    }
+    void unlock_shared()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_readers == 0)
+            m_cond.notify_all();
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// SharedLock --- RAII of lock_shared/unlock_shared
+
+class SharedLock
+{
+protected:
+    SharedMutex& m_mutex;
+
+public:
+    explicit SharedLock(SharedMutex& mutex)
+        : m_mutex(mutex)
+    {
+        m_mutex.lock_shared();
+    }
+    ~SharedLock()
+    {
+        m_mutex.unlock_shared();
+    }
+
+    SharedLock(const SharedLock&) = delete;
+    SharedLock& operator=(const SharedLock&) = delete;
+};
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////
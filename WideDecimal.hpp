@@ -0,0 +1,326 @@
+// WideDecimal.hpp
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Currency.hpp"
+#include "CurrencyColumn.hpp"
+#include "InvariantDivider.hpp"
+
+namespace khmz
+{
+
+//////////////////////////////////////////////////////////////////////////////
+// UInt256 --- just enough 256-bit arithmetic for wide intermediates
+
+struct UInt256
+{
+    unsigned __int128 hi;
+    unsigned __int128 lo;
+
+    UInt256(unsigned __int128 low = 0)
+        : hi(0)
+        , lo(low)
+    {
+    }
+
+    bool is_zero() const
+    {
+        return hi == 0 && lo == 0;
+    }
+
+    // the number of significant bits
+    int bit_width() const
+    {
+        if (hi)
+        {
+            uint64_t top = uint64_t(hi >> 64);
+            return top ? 256 - __builtin_clzll(top) : 192 - __builtin_clzll(uint64_t(hi));
+        }
+        uint64_t top = uint64_t(lo >> 64);
+        if (top)
+            return 128 - __builtin_clzll(top);
+        return lo ? 64 - __builtin_clzll(uint64_t(lo)) : 0;
+    }
+
+    static UInt256 mul(unsigned __int128 a, unsigned __int128 b)
+    {
+        uint64_t a0 = uint64_t(a), a1 = uint64_t(a >> 64);
+        uint64_t b0 = uint64_t(b), b1 = uint64_t(b >> 64);
+        unsigned __int128 p00 = (unsigned __int128)a0 * b0;
+        unsigned __int128 p01 = (unsigned __int128)a0 * b1;
+        unsigned __int128 p10 = (unsigned __int128)a1 * b0;
+        unsigned __int128 p11 = (unsigned __int128)a1 * b1;
+        unsigned __int128 mid = (p00 >> 64) + uint64_t(p01) + uint64_t(p10);
+
+        UInt256 ret;
+        ret.lo = (mid << 64) | uint64_t(p00);
+        ret.hi = p11 + (p01 >> 64) + (p10 >> 64) + (mid >> 64);
+        return ret;
+    }
+
+    // *this + x; returns false on overflow
+    bool add(const UInt256& x)
+    {
+        bool carry = __builtin_add_overflow(lo, x.lo, &lo);
+        if (__builtin_add_overflow(hi, x.hi, &hi))
+            return false;
+        return !__builtin_add_overflow(hi, (unsigned __int128)carry, &hi);
+    }
+
+    // *this - x; requires x <= *this
+    void sub(const UInt256& x)
+    {
+        assert(!(*this < x));
+        bool borrow = __builtin_sub_overflow(lo, x.lo, &lo);
+        hi -= x.hi + borrow;
+    }
+
+    bool operator<(const UInt256& x) const
+    {
+        return hi < x.hi || (hi == x.hi && lo < x.lo);
+    }
+
+    // *this * m; returns false on overflow
+    bool mul(uint64_t m)
+    {
+        UInt256 low = mul(lo, m);
+        UInt256 high = mul(hi, m);
+        if (high.hi)
+            return false;
+        hi = high.lo;
+        if (__builtin_add_overflow(hi, low.hi, &hi))
+            return false;
+        lo = low.lo;
+        return true;
+    }
+
+    // divides by an invariant 64-bit divisor; returns the remainder
+    uint64_t divide(const InvariantDivider& divider)
+    {
+        uint64_t r;
+        hi = divider.divide(hi, r);
+        unsigned __int128 q1 = divider.divide(((unsigned __int128)r << 64) | uint64_t(lo >> 64), r);
+        unsigned __int128 q0 = divider.divide(((unsigned __int128)r << 64) | uint64_t(lo), r);
+        lo = (q1 << 64) | q0;
+        return r;
+    }
+
+    // divides by a 128-bit divisor bit by bit; returns the remainder
+    unsigned __int128 divide(unsigned __int128 d)
+    {
+        assert(d != 0);
+        unsigned __int128 r = 0;
+        UInt256 q;
+        for (int i = bit_width() - 1; i >= 0; --i)
+        {
+            bool carry = (r >> 127) != 0;
+            unsigned __int128 bit = (i >= 128 ? hi >> (i - 128) : lo >> i) & 1;
+            r = (r << 1) | bit;
+            if (carry || r >= d)
+            {
+                r -= d;
+                if (i >= 128)
+                    q.hi |= (unsigned __int128)1 << (i - 128);
+                else
+                    q.lo |= (unsigned __int128)1 << i;
+            }
+        }
+        *this = q;
+        return r;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// WideDecimal
+//
+// A positive decimal m * 10^e with up to 38 significant digits. Wider
+// results are truncated back to 38 digits, and sticky records whether
+// nonzero digits were dropped, so that the final rounding stays correct
+// unless the exact value is within 10^-36 (relative) of a rounding boundary.
+
+struct WideDecimal
+{
+    unsigned __int128 m;
+    int64_t e;
+    bool sticky;
+
+    WideDecimal(unsigned __int128 mantissa = 0, int64_t exponent = 0)
+        : m(mantissa)
+        , e(exponent)
+        , sticky(false)
+    {
+    }
+
+    // the magnitude of value
+    static WideDecimal from(const Currency& value)
+    {
+        return WideDecimal(uint64_t(value.base().significand()), value.exp10());
+    }
+
+    static unsigned __int128 pow10(int e10)
+    {
+        assert(0 <= e10 && e10 <= 38);
+        unsigned __int128 ret = pow10_u64(std::min(e10, 19));
+        if (e10 > 19)
+            ret *= pow10_u64(e10 - 19);
+        return ret;
+    }
+
+    static int digits(unsigned __int128 value)
+    {
+        int ret = 1;
+        while (ret < 39 && value >= pow10(ret))
+            ++ret;
+        return ret;
+    }
+
+    // takes a 256-bit mantissa, truncating it to 38 digits
+    static WideDecimal from_wide(UInt256 value, int64_t e10, bool sticky)
+    {
+        int bits = value.bit_width();
+        // a lower bound of the number of digits
+        int low_digits = (bits <= 1) ? 1 : int((bits - 1) * 0.30102999566398) + 1;
+        int cut = std::max(0, low_digits - 38);
+        while (cut > 0)
+        {
+            int k = std::min(cut, 19);
+            sticky |= value.divide(InvariantDivider(pow10_u64(k))) != 0;
+            e10 += k;
+            cut -= k;
+        }
+        while (value.hi || value.lo >= pow10(38))
+        {
+            sticky |= value.divide(InvariantDivider(10)) != 0;
+            ++e10;
+        }
+
+        WideDecimal ret(value.lo, e10);
+        ret.sticky = sticky;
+        return ret;
+    }
+
+    friend WideDecimal operator*(const WideDecimal& a, const WideDecimal& b)
+    {
+        return from_wide(UInt256::mul(a.m, b.m), a.e + b.e, a.sticky || b.sticky);
+    }
+
+    friend WideDecimal operator/(const WideDecimal& a, const WideDecimal& b)
+    {
+        if (b.m == 0)
+            throw std::runtime_error("WideDecimal: division by zero");
+
+        // scale a up so that the quotient gets about 38 digits
+        int da = digits(a.m), db = digits(b.m);
+        int s = std::max(0, std::min(75 - da, 38 - da + db));
+        UInt256 n(a.m);
+        for (int k = s; k > 0; k -= 19)
+            n.mul(pow10_u64(std::min(k, 19)));
+        bool sticky = n.divide(b.m) != 0;
+        return from_wide(n, a.e - s - b.e, sticky || a.sticky || b.sticky);
+    }
+
+    // a + b; the addends must fit in 38 digits at the finer exponent
+    friend WideDecimal operator+(const WideDecimal& a, const WideDecimal& b)
+    {
+        const WideDecimal& fine = (a.e <= b.e) ? a : b;
+        const WideDecimal& coarse = (a.e <= b.e) ? b : a;
+        unsigned __int128 cm = coarse.m;
+        for (int64_t k = coarse.e - fine.e; k > 0; k -= 19)
+        {
+            if (__builtin_mul_overflow(cm, pow10_u64(int(std::min<int64_t>(k, 19))), &cm))
+                throw std::runtime_error("WideDecimal: overflow");
+        }
+        if (__builtin_add_overflow(fine.m, cm, &cm))
+            throw std::runtime_error("WideDecimal: overflow");
+        WideDecimal ret(cm, fine.e);
+        ret.sticky = a.sticky || b.sticky;
+        return ret;
+    }
+
+    // |a - b|
+    friend WideDecimal abs_diff(const WideDecimal& a, const WideDecimal& b)
+    {
+        const WideDecimal& fine = (a.e <= b.e) ? a : b;
+        const WideDecimal& coarse = (a.e <= b.e) ? b : a;
+        unsigned __int128 cm = coarse.m;
+        for (int64_t k = coarse.e - fine.e; k > 0; k -= 19)
+        {
+            if (__builtin_mul_overflow(cm, pow10_u64(int(std::min<int64_t>(k, 19))), &cm))
+                throw std::runtime_error("WideDecimal: overflow");
+        }
+        WideDecimal ret(fine.m >= cm ? fine.m - cm : cm - fine.m, fine.e);
+        ret.sticky = a.sticky || b.sticky;
+        return ret;
+    }
+
+    // rounds to the exponent e10 and returns the units of 10^e10
+    unsigned __int128 round_to(int64_t e10, RoundingMode mode, bool negative) const
+    {
+        if (e10 <= e)
+        {
+            unsigned __int128 ret = m;
+            for (int64_t k = e - e10; k > 0; k -= 19)
+            {
+                if (__builtin_mul_overflow(ret, pow10_u64(int(std::min<int64_t>(k, 19))), &ret))
+                    throw std::runtime_error("WideDecimal: overflow");
+            }
+            if (round_increment(mode, ret & 1, -1, sticky, negative))
+                ++ret;
+            return ret;
+        }
+
+        int64_t j = e10 - e;
+        unsigned __int128 q = 0, rem = m;
+        int half_cmp = -1;
+        if (j <= 38)
+        {
+            unsigned __int128 p = pow10(int(j));
+            q = m / p;
+            rem = m % p;
+            if (2 * rem < p)
+                half_cmp = -1;
+            else if (2 * rem == p)
+                half_cmp = sticky ? 1 : 0;
+            else
+                half_cmp = 1;
+        }
+        if (round_increment(mode, q & 1, half_cmp, rem != 0 || sticky, negative))
+            ++q;
+        return q;
+    }
+
+    // inf if the units of 10^scale do not fit 127 bits
+    Currency to_currency(exp10_t scale, RoundingMode mode, bool negative = false) const
+    {
+        bool overflow = false;
+        unsigned __int128 x = m;
+        for (int64_t k = int64_t(e) - scale; k > 0 && x && !overflow; k -= 19)
+            overflow = __builtin_mul_overflow(x, pow10_u64(int(std::min<int64_t>(k, 19))), &x);
+        unsigned __int128 units = overflow ? 0 : round_to(scale, mode, negative);
+        if (overflow || units >> 127)
+        {
+            Currency inf;
+            inf.set_inf(negative);
+            return inf;
+        }
+        return currency_from_wide(negative ? -__int128(units) : __int128(units), scale);
+    }
+
+    // rounds to 18 significant digits
+    Currency to_currency(RoundingMode mode, bool negative = false) const
+    {
+        int64_t e10 = e + std::max(0, digits(m) - 18);
+        if (e10 > max_exp10)
+        {
+            Currency inf;
+            inf.set_inf(negative);
+            return inf;
+        }
+        return to_currency(exp10_t(e10), mode, negative);
+    }
+};
+
+} // namespace khmz
+
+//////////////////////////////////////////////////////////////////////////////